@@ -89,6 +89,7 @@ typedef struct {
     char *filepath;
 } Source;
 
+// cc/x86_64_gen.c has the same definitions of the enum and Code.
 enum {
     REG_8 = 1 << 5,
     REG_AL = 0 | REG_8,
@@ -157,6 +158,7 @@ enum {
     REG_R15,
     REG_RBP,
     REG_RSP,
+    REG_RBX,  // only saved and restored by setjmp/longjmp in cc
 
     REG_RIP,
 
@@ -166,22 +168,48 @@ enum {
     INST_MOVSBL,
     INST_MOVSLQ,
     INST_MOVZB,
+    INST_MOVZW,
+    INST_MOVSBQ,
+    INST_MOVSW,
     INST_LEA,
     INST_PUSH,
     INST_POP,
     INST_ADD,
     INST_ADDQ,
     INST_SUB,
+    INST_ADC,
+    INST_SBB,
+    INST_MUL,
     INST_IMUL,
+    INST_DIV,
     INST_IDIV,
     INST_SAR,
     INST_SAL,
+    INST_SHR,
     INST_NEG,
     INST_NOT,
     INST_CMP,
+    INST_TEST,
     INST_SETL,
     INST_SETLE,
     INST_SETE,
+    INST_SETNE,
+    INST_SETG,
+    INST_SETGE,
+    INST_SETB,
+    INST_SETBE,
+    INST_SETA,
+    INST_SETAE,
+    INST_CMOVE,
+    INST_CMOVNE,
+    INST_CMOVL,
+    INST_CMOVLE,
+    INST_CMOVG,
+    INST_CMOVGE,
+    INST_CMOVB,
+    INST_CMOVBE,
+    INST_CMOVA,
+    INST_CMOVAE,
     INST_AND,
     INST_XOR,
     INST_OR,
@@ -192,7 +220,16 @@ enum {
     INST_JE,
     INST_JNE,
     INST_JAE,
+    INST_JGE,
+    INST_JB,
+    INST_JL,
+    INST_JLE,
+    INST_JG,
+    INST_JBE,
+    INST_JA,
     INST_LABEL,
+    INST_INC,
+    INST_DEC,
     INST_INCL,
     INST_INCQ,
     INST_DECL,
@@ -213,6 +250,8 @@ enum {
     CD_BYTE,
     CD_QUAD,
     CD_ASCII,
+    CD_FILE,  // .file ival "sval"
+    CD_LOC,   // .loc lhs rhs, whose values are the file and the line
 
     CD_COMMENT,
 
@@ -229,6 +268,8 @@ struct Code {
 
     Code *lhs, *rhs;
     int ival;
+    // CD_ADDR_OF: ival(lhs, rhs, scale) where rhs is the index register.
+    int scale;
     char *sval;  // size is ival
     char *label;
     Vector *read_dep;
@@ -280,6 +321,13 @@ Code *JMP(char *label);
 Code *JE(char *label);
 Code *JNE(char *label);
 Code *JAE(char *label);
+Code *JGE(char *label);
+Code *JB(char *label);
+Code *JL(char *label);
+Code *JLE(char *label);
+Code *JG(char *label);
+Code *JBE(char *label);
+Code *JA(char *label);
 Code *LABEL(char *label);
 Code *LEA(Code *lhs, Code *rhs);
 Code *MOV(Code *lhs, Code *rhs);
@@ -309,6 +357,7 @@ Code *RIP();
 Code *RSP();
 Code *SAL(Code *lhs, Code *rhs);
 Code *SAR(Code *lhs, Code *rhs);
+Code *SHR(Code *lhs, Code *rhs);
 Code *SETE(Code *lhs);
 Code *SETL(Code *lhs);
 Code *SETLE(Code *lhs);
@@ -316,6 +365,7 @@ Code *SUB(Code *lhs, Code *rhs);
 Code *XOR(Code *lhs, Code *rhs);
 Code *GLOBAL(char *label);
 Code *new_addrof_code(Code *reg, int offset);
+Code *new_addrof_index_code(Code *reg, Code *index, int scale, int offset);
 Code *new_addrof_label_code(Code *reg, char *label);
 Code *new_value_code(int value);
 Code *new_code(int kind);
@@ -325,9 +375,18 @@ Code *new_binop_code(int kind, Code *lhs, Code *rhs);
 Code *new_unary_code(int kind, Code *lhs);
 
 // assemble.c
-ObjectImage *assemble_code(Vector *code);
+void emit_label_disp32(char *label, int imm_size);
+// flags of assemble_code() to put each function or data object in its own
+// section, which lets ld remove the unused ones.
+enum { AS_FUNCTION_SECTIONS = 1, AS_DATA_SECTIONS = 2 };
+ObjectImage *assemble_code(Vector *code, int section_flags);
+Vector *emit_object_image(ObjectImage *objimg);
 void dump_object_image(ObjectImage *objimg, FILE *fh);
 
+// encode.c
+int encode_code(Code *code);
+int encode_branch(Code *code, int is_long);
+
 // object.c
 void add_byte(Vector *vec, int val);
 void set_byte(Vector *vec, int index, int val);
@@ -1,14 +1,25 @@
 #include "as.h"
 
+// A section of the object, into which code or data is emitted.
+typedef struct {
+    char *name;
+    int is_text;
+    int is_debug;   // not loaded into memory, e.g. .debug_line
+    Vector *bytes;  // vector<int>
+    Vector *rela;   // vector<RelaEntry *>
+} Section;
+
 struct ObjectImage {
-    Vector *text;    // vector<int>
-    Vector *data;    // vector<int>
-    Vector *rela;    // vector<RelaEntry *>
-    Vector *strtab;  // vecotr<int>
-    Vector *symtab;  // vector<SymbolInfo *>
+    Vector *sections;  // vector<Section *>
+    Vector *strtab;    // vecotr<int>
+    Vector *symtab;    // vector<SymbolInfo *>
 
     Map *symbol_map;    // map<char *, SymbolInfo *>
     Map *label2offset;  // map<char *, SectionOffset>
+
+    // the sections where .text and .data go now.
+    int text_section, data_section;
+    int section_flags;  // AS_FUNCTION_SECTIONS and AS_DATA_SECTIONS
 };
 
 ObjectImage *target_objimg = NULL;
@@ -16,10 +27,11 @@ ObjectImage *target_objimg = NULL;
 void init_target_objimg(ObjectImage *objimg) { target_objimg = objimg; }
 
 typedef struct {
-    int index;
+    int index;  // in the symbols following the section ones
     char *label;
     int st_name;
     int st_info;
+    int st_size;  // of a function
 } SymbolInfo;
 
 SymbolInfo *get_symbol_info(char *label)
@@ -28,10 +40,11 @@ SymbolInfo *get_symbol_info(char *label)
     if (kv != NULL) return (SymbolInfo *)kv_value(kv);
 
     SymbolInfo *symbol = (SymbolInfo *)safe_malloc(sizeof(SymbolInfo));
-    symbol->index = vector_size(target_objimg->symtab) + 4;
+    symbol->index = vector_size(target_objimg->symtab);
     symbol->label = label;
     symbol->st_name = vector_size(target_objimg->strtab);
     symbol->st_info = 0;
+    symbol->st_size = 0;
 
     add_string(target_objimg->strtab, label, strlen(label) + 1);
     map_insert(target_objimg->symbol_map, label, symbol);
@@ -40,24 +53,19 @@ SymbolInfo *get_symbol_info(char *label)
     return symbol;
 }
 
+// A relocation against symbol, or against the section symbol of section if
+// it isn't -1.
 typedef struct {
-    int offset, symtabidx, type, addend;
+    int offset, type, addend;
     SymbolInfo *symbol;
+    int section;
 } RelaEntry;
 
-void add_rela_entry(int offset, int type, int symtabidx, SymbolInfo *symbol)
+Section *get_section(int index)
 {
-    RelaEntry *entry = (RelaEntry *)safe_malloc(sizeof(RelaEntry));
-    entry->offset = offset;
-    entry->symtabidx = symtabidx;
-    entry->type = type;
-    entry->symbol = symbol;
-    entry->addend = -4;
-
-    vector_push_back(target_objimg->rela, entry);
+    return (Section *)vector_get(target_objimg->sections, index);
 }
 
-enum { TEXT_SECTION, DATA_SECTION };
 int current_section;
 
 int get_current_section() { return current_section; }
@@ -65,14 +73,40 @@ int get_current_section() { return current_section; }
 void set_current_section(int section)
 {
     current_section = section;
-    set_buffer_to_emit(section == TEXT_SECTION ? target_objimg->text
-                                               : target_objimg->data);
+    set_buffer_to_emit(get_section(section)->bytes);
+}
+
+int add_section(char *name, int is_text)
+{
+    Section *sec = (Section *)safe_malloc(sizeof(Section));
+    sec->name = name;
+    sec->is_text = is_text;
+    sec->is_debug = 0;
+    sec->bytes = new_vector();
+    sec->rela = new_vector();
+    vector_push_back(target_objimg->sections, sec);
+    return vector_size(target_objimg->sections) - 1;
 }
 
 Vector *get_current_section_buffer() { return get_buffer_to_emit(); }
 
 int get_current_section_buffer_size() { return emitted_size(); }
 
+// add a relocation at offset of the current section.
+RelaEntry *add_rela_entry(int offset, int type, SymbolInfo *symbol,
+                          int addend)
+{
+    RelaEntry *entry = (RelaEntry *)safe_malloc(sizeof(RelaEntry));
+    entry->offset = offset;
+    entry->type = type;
+    entry->symbol = symbol;
+    entry->addend = addend;
+    entry->section = -1;
+
+    vector_push_back(get_section(get_current_section())->rela, entry);
+    return entry;
+}
+
 typedef struct {
     int offset, section;
 } SectionOffset;
@@ -93,743 +127,335 @@ SectionOffset *lookup_label_offset(char *label)
     return (SectionOffset *)kv_value(kv);
 }
 
-int is_reg(Code *code) { return is_register_code(code); }
-
-int is_reg64(Code *code) { return is_reg(code) && (code->kind & REG_64); }
-
-int is_reg32(Code *code) { return is_reg(code) && (code->kind & REG_32); }
-
-int is_reg8(Code *code) { return is_reg(code) && (code->kind & REG_8); }
-
-int is_imm(Code *code) { return code->kind == CD_VALUE; }
-
-int is_reg_ext(Code *code)
+// With AS_FUNCTION_SECTIONS each function, whose label isn't local unlike
+// the ones of jumps in it, starts a new section e.g. .text.main. With
+// AS_DATA_SECTIONS each label in .data does so, since all of them are of
+// data objects.
+void start_section_of_label(char *label)
 {
-    if (!is_reg(code)) return 0;
-    int reg = reg_of_nbyte(8, code->kind);
-    return REG_R8 <= reg && reg <= REG_R15;
+    Section *sec = get_section(get_current_section());
+    if (sec->is_text) {
+        if (!(target_objimg->section_flags & AS_FUNCTION_SECTIONS) ||
+            label[0] == '.')
+            return;
+        target_objimg->text_section =
+            add_section(format(".text.%s", label), 1);
+        set_current_section(target_objimg->text_section);
+    }
+    else {
+        if (!(target_objimg->section_flags & AS_DATA_SECTIONS)) return;
+        target_objimg->data_section =
+            add_section(format(".data.%s", label), 0);
+        set_current_section(target_objimg->data_section);
+    }
 }
 
-int is_addrof(Code *code)
+// disp32 of label(%rip), which is relocated by linker. imm_size is the size
+// of the immediate following it, by which the displacement is off.
+void emit_label_disp32(char *label, int imm_size)
 {
-    return code->kind == CD_ADDR_OF || code->kind == CD_ADDR_OF_LABEL;
+    add_rela_entry(get_current_section_buffer_size(), 2,
+                   get_symbol_info(label), -4 - imm_size);
+    emit_dword_int(0);
 }
 
-int reg_field(Code *code)
-{
-    assert(is_reg(code));
-
-    int reg = reg_of_nbyte(8, code->kind);
-    switch (reg) {
-        case REG_RAX:
-            return 0;
-        case REG_RCX:
-            return 1;
-        case REG_RDX:
-            return 2;
-        // case REG_RBX:
-        //    return 3;
-        case REG_RSP:
-            return 4;
-        case REG_RBP:
-        case REG_RIP:
-            return 5;
-        case REG_RSI:
-            return 6;
-        case REG_RDI:
-            return 7;
-        case REG_R8:
-        case REG_R9:
-        case REG_R10:
-        case REG_R11:
-        case REG_R12:
-        case REG_R13:
-        case REG_R14:
-        case REG_R15:
-            return reg - REG_R8;
-    }
+// A row of the line table: the code at offset in the section of a function
+// is of the line of the file.
+typedef struct {
+    int offset, file, line;
+} LineRow;
 
-    assert(0);
+// emit val, which isn't negative, in ULEB128.
+void emit_uleb128(int val)
+{
+    do {
+        int byte = val & 0x7f;
+        val >>= 7;
+        emit_byte(val != 0 ? byte | 0x80 : byte);
+    } while (val != 0);
 }
 
-int modrm(int mod, int reg, int rm)
+// emit val in SLEB128.
+void emit_sleb128(int val)
 {
-    return ((mod & 3) << 6) | ((reg & 7) << 3) | (rm & 7);
+    while (1) {
+        int byte = val & 0x7f;
+        val >>= 7;
+        if ((val == 0 && !(byte & 0x40)) || (val == -1 && byte & 0x40)) {
+            emit_byte(byte);
+            return;
+        }
+        emit_byte(byte | 0x80);
+    }
 }
 
-int emit_modrm(int mod, int reg, int rm)
+// rewrite 4 bytes at index of the current section.
+void reemit_dword_int(int index, int ival)
 {
-    emit_byte(modrm(mod, reg, rm));
-
-    // If mod == 2 and rm == 4 then SIB byte is enabled.
-    // If I == 0 in SIB then index is disabled.
-    // That's why this line is needed.
-    // NOT CARGO CULT PROGRAMMING!!
-    // But this spec is awful, isn't it :thinking_face:
-    if (mod == 2 && rm == 4) emit_byte(modrm(0, 4, 4));
+    for (int i = 0; i < 4; i++)
+        reemit_byte(index + i, (ival >> (i * 8)) & 0xff);
 }
 
-int rex_prefix(int w, int r, int x, int b)
+// emit 8 or 4 bytes of the address of offset in section, which are
+// relocated by linker. For a debug section the address is the offset in the
+// merged section of the executable.
+void emit_section_address(int section, int offset, int size)
 {
-    // assume that w, r, x, b are either 0 or 1.
-    return 0x40 | (w << 3) | (r << 2) | (x << 1) | b;
+    add_rela_entry(get_current_section_buffer_size(), size == 8 ? 1 : 10, NULL,
+                   offset)
+        ->section = section;
+    emit_nbytes(size, 0);
 }
 
-int rex_prefix_reg_ext(int is64, Code *reg, Code *rm)
+int add_debug_section(char *name)
 {
-    return rex_prefix(is64, is_reg_ext(reg), 0, is_reg_ext(rm));
+    int index = add_section(name, 0);
+    get_section(index)->is_debug = 1;
+    set_current_section(index);
+    return index;
 }
 
-void emit_rex_prefix(int is64, Code *reg, Code *rm)
+// the line number program of the function func in .debug_line. Special
+// opcodes advance the address and the line at once where they can.
+void emit_line_program(SymbolInfo *func, Vector *rows)
 {
-    int pre = rex_prefix_reg_ext(is64, reg, rm);
-    if (pre == 0x40) return;  // no info
-    emit_byte(pre);
+    SectionOffset *so = lookup_label_offset(func->label);
+
+    // DW_LNE_set_address
+    emit_byte(0x00);
+    emit_uleb128(9);
+    emit_byte(0x02);
+    emit_section_address(so->section, so->offset, 8);
+
+    int offset = so->offset, file = 1, line = 1;
+    for (int i = 0; i < vector_size(rows); i++) {
+        LineRow *row = (LineRow *)vector_get(rows, i);
+        if (row->file != file) {
+            emit_byte(0x04);  // DW_LNS_set_file
+            emit_uleb128(row->file);
+            file = row->file;
+        }
+
+        int line_delta = row->line - line, addr_delta = row->offset - offset;
+        if (line_delta < -5 || 8 < line_delta) {
+            emit_byte(0x03);  // DW_LNS_advance_line
+            emit_sleb128(line_delta);
+            line_delta = 0;
+        }
+        // line_base is -5, line_range is 14 and opcode_base is 13.
+        int opcode = line_delta + 5 + 14 * addr_delta + 13;
+        if (opcode > 255) {
+            emit_byte(0x02);  // DW_LNS_advance_pc
+            emit_uleb128(addr_delta);
+            opcode = line_delta + 5 + 13;
+        }
+        emit_byte(opcode);
+        offset = row->offset;
+        line = row->line;
+    }
+
+    emit_byte(0x02);  // DW_LNS_advance_pc to the end of the function
+    emit_uleb128(so->offset + func->st_size - offset);
+    // DW_LNE_end_sequence
+    emit_byte(0x00);
+    emit_uleb128(1);
+    emit_byte(0x01);
 }
 
-void emit_addrof(int reg, Code *mem)
+// .debug_line from .file and .loc, and .debug_info with one compile unit
+// which points to it. The compile unit covers the functions listed in
+// .debug_ranges, each of which is a base address and the size from it, so
+// a function removed by linker isn't mistaken for the end of the list.
+// This is a subset of DWARF 4 which addr2line and perf can read.
+void add_debug_sections(Vector *functions, Vector *lines, Vector *files)
 {
-    assert(is_addrof(mem));
-
-    switch (mem->kind) {
-        case CD_ADDR_OF:
-            emit_modrm(2, reg, reg_field(mem->lhs));
-            emit_dword_int(mem->ival);
-            break;
-
-        case CD_ADDR_OF_LABEL: {
-            SymbolInfo *sym = get_symbol_info(mem->label);
-            emit_modrm(0, reg, reg_field(mem->lhs));
-            add_rela_entry(get_current_section_buffer_size(), 2, sym->index,
-                           sym);
-            emit_dword_int(0);
-        } break;
+    // .debug_line
+    int line_section = add_debug_section(".debug_line");
+    emit_dword_int(0);  // unit_length (placeholder)
+    emit_word_int(4);   // version
+    int header_length = emitted_size();
+    emit_dword_int(0);  // header_length (placeholder)
+    emit_byte(1);       // minimum_instruction_length
+    emit_byte(1);       // maximum_operations_per_instruction
+    emit_byte(1);       // default_is_stmt
+    emit_byte(-5);      // line_base
+    emit_byte(14);      // line_range
+    emit_byte(13);      // opcode_base
+    // standard_opcode_lengths
+    emit_qword(0, 1, 1, 1, 1, 0, 0, 0);
+    emit_dword(1, 0, 0, 1);
+    emit_byte(0);  // no include_directories
+    for (int i = 0; i < vector_size(files); i++) {
+        char *name = (char *)vector_get(files, i);
+        if (name == NULL) name = "";
+        emit_string(name, strlen(name) + 1);
+        emit_byte(0);  // the directory, the time and the size
+        emit_byte(0);
+        emit_byte(0);
+    }
+    emit_byte(0);
+    reemit_dword_int(header_length, emitted_size() - header_length - 4);
+
+    for (int i = 0; i < vector_size(functions); i++) {
+        Vector *rows = (Vector *)vector_get(lines, i);
+        if (vector_size(rows) > 0)
+            emit_line_program((SymbolInfo *)vector_get(functions, i), rows);
     }
+    reemit_dword_int(0, emitted_size() - 4);
+
+    // .debug_ranges
+    int ranges_section = add_debug_section(".debug_ranges");
+    for (int i = 0; i < vector_size(functions); i++) {
+        if (vector_size((Vector *)vector_get(lines, i)) == 0) continue;
+        SymbolInfo *func = (SymbolInfo *)vector_get(functions, i);
+        SectionOffset *so = lookup_label_offset(func->label);
+        emit_qword_int(-1, -1);  // base address selection
+        emit_section_address(so->section, so->offset, 8);
+        emit_qword_int(0, 0);
+        emit_qword_int(func->st_size, 0);
+    }
+    emit_qword_int(0, 0);  // end of list
+    emit_qword_int(0, 0);
+
+    // .debug_abbrev
+    int abbrev_section = add_debug_section(".debug_abbrev");
+    emit_uleb128(1);     // abbreviation code
+    emit_uleb128(0x11);  // DW_TAG_compile_unit
+    emit_byte(0);        // DW_CHILDREN_no
+    emit_word(0x25, 0x08);  // DW_AT_producer, DW_FORM_string
+    emit_word(0x13, 0x05);  // DW_AT_language, DW_FORM_data2
+    emit_word(0x03, 0x08);  // DW_AT_name, DW_FORM_string
+    emit_word(0x11, 0x01);  // DW_AT_low_pc, DW_FORM_addr
+    emit_word(0x55, 0x17);  // DW_AT_ranges, DW_FORM_sec_offset
+    emit_word(0x10, 0x17);  // DW_AT_stmt_list, DW_FORM_sec_offset
+    emit_word(0, 0);
+    emit_byte(0);
+
+    // .debug_info
+    add_debug_section(".debug_info");
+    emit_dword_int(0);  // unit_length (placeholder)
+    emit_word_int(4);   // version
+    emit_section_address(abbrev_section, 0, 4);
+    emit_byte(8);  // address_size
+    emit_uleb128(1);
+    emit_string("aqcc", 5);
+    emit_word_int(0x0c);  // DW_LANG_C99
+    char *name = (char *)vector_get(files, 0);
+    if (name == NULL) name = "";
+    emit_string(name, strlen(name) + 1);
+    emit_qword_int(0, 0);  // the base address of .debug_ranges
+    emit_section_address(ranges_section, 0, 4);
+    emit_section_address(line_section, 0, 4);
+    reemit_dword_int(0, emitted_size() - 4);
 }
 
 void assemble_code_detail_data(Vector *code_list, int index) {}
 
-ObjectImage *assemble_code_detail(Vector *code_list)
+// set when a rel8 branch can't reach its target in assemble_code_detail().
+int need_relaxation;
+
+// is_long[i] tells whether code_list[i] (jmp or jcc) should be encoded with
+// rel32 instead of rel8.
+ObjectImage *assemble_code_detail(Vector *code_list, Vector *is_long,
+                                  int section_flags)
 {
     // all data are stored in this variable.
     ObjectImage *objimg = (ObjectImage *)safe_malloc(sizeof(ObjectImage));
-    objimg->text = new_vector();
-    objimg->data = new_vector();
-    objimg->rela = new_vector();
+    objimg->sections = new_vector();
     objimg->strtab = new_vector();
     vector_push_back(objimg->strtab, 0x00);
     objimg->symtab = new_vector();
     objimg->symbol_map = new_map();
     objimg->label2offset = new_map();
+    objimg->section_flags = section_flags;
     init_target_objimg(objimg);
-    set_current_section(TEXT_SECTION);
-
+    objimg->text_section = add_section(".text", 1);
+    objimg->data_section = add_section(".data", 0);
+    set_current_section(objimg->text_section);
+
+    Vector *functions = new_vector();  // vector<SymbolInfo *> in order
+    // the files of .file, and the lines of .loc of each function.
+    Vector *files = new_vector();  // vector<char *>
+    Vector *lines = new_vector();  // vector<vector<LineRow *>>
     Vector *label_placeholders = new_vector();
     typedef struct {
         char *label;
-        int offset, size;
+        int offset, size, section;
+        int code_index;  // index in code_list of the branch
     } LabelPlaceholder;
 
     for (int i = 0; i < vector_size(code_list); i++) {
         Code *code = vector_get(code_list, i);
 
         switch (code->kind) {
-            case INST_MOV:
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->lhs, code->rhs));
-                    emit_byte(0x89);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x89);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg8(code->lhs) && is_reg8(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x88);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg32(code->rhs)) {
-                    if (is_reg_ext(code->rhs)) emit_byte(0x41);
-                    emit_byte(0xb8 + reg_field(code->rhs));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, NULL, code->rhs));
-                    emit_byte(0xc7);
-                    emit_byte(modrm(3, 0, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_addrof(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->rhs, code->lhs->lhs));
-                    emit_byte(0x8b);
-                    emit_addrof(reg_field(code->rhs), code->lhs);
-                    break;
-                }
-
-                if (is_addrof(code->lhs) && is_reg32(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(0, code->rhs, code->lhs->lhs));
-                    emit_byte(0x8b);
-                    emit_addrof(reg_field(code->rhs), code->lhs);
-                    break;
-                }
-
-                if (is_reg8(code->lhs) && is_addrof(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(0, code->lhs, code->rhs->lhs));
-                    emit_byte(0x88);
-                    emit_addrof(reg_field(code->lhs), code->rhs);
-                    break;
-                }
-
-                if (is_reg32(code->lhs) && is_addrof(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(0, code->lhs, code->rhs->lhs));
-                    emit_byte(0x89);
-                    emit_addrof(reg_field(code->lhs), code->rhs);
-                    break;
-                }
-
-                if (is_reg64(code->lhs) && is_addrof(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->lhs, code->rhs->lhs));
-                    emit_byte(0x89);
-                    emit_addrof(reg_field(code->lhs), code->rhs);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_MOVL:
-                if (is_imm(code->lhs) && is_addrof(code->rhs)) {
-                    emit_rex_prefix(0, NULL, code->rhs->lhs);
-                    emit_byte(0xc7);
-                    emit_addrof(0, code->rhs);
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_MOVSBL:
-                if (is_reg8(code->lhs) && is_reg32(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(0, code->rhs, code->lhs));
-                    emit_word(0x0f, 0xbe);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_addrof(code->lhs) && is_reg32(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(0, code->rhs, code->lhs->lhs));
-                    emit_word(0x0f, 0xbe);
-                    emit_addrof(reg_field(code->rhs), code->lhs);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_MOVSLQ:
-                if (is_reg32(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->rhs, code->lhs));
-                    emit_byte(0x63);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_MOVZB:
-                if (is_reg8(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->rhs, code->lhs);
-                    emit_word(0x0f, 0xb6);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_reg8(code->lhs) && is_reg64(code->rhs)) {
-                    emit_rex_prefix(1, code->rhs, code->lhs);
-                    emit_word(0x0f, 0xb6);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_ADD:
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, NULL, code->rhs));
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 0, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->lhs, code->rhs));
-                    emit_byte(0x01);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, NULL, code->rhs);
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 0, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x01);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_addrof(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->rhs, code->lhs->lhs));
-                    emit_byte(0x03);
-                    emit_addrof(reg_field(code->rhs), code->lhs);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_ADDQ:
-                if (is_imm(code->lhs) && is_addrof(code->rhs)) {
-                    emit_rex_prefix(1, NULL, code->rhs->lhs);
-                    emit_byte(0x81);
-                    emit_addrof(0, code->rhs);
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SUB:
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, NULL, code->rhs));
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 5, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->lhs, code->rhs));
-                    emit_byte(0x29);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, NULL, code->rhs);
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 5, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(1, code->lhs, code->rhs);
-                    emit_byte(0x29);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_IMUL:
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->lhs, code->rhs));
-                    emit_word(0x0f, 0xaf);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_word(0x0f, 0xaf);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->rhs, code->rhs));
-                    emit_byte(0x69);
-                    emit_byte(
-                        modrm(3, reg_field(code->rhs), reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_IDIV:
-                if (is_reg32(code->lhs)) {
-                    emit_rex_prefix(0, NULL, code->lhs);
-                    emit_byte(0xf7);
-                    emit_byte(modrm(3, 7, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_NEG:
-                if (is_reg32(code->lhs)) {
-                    emit_rex_prefix(0, NULL, code->lhs);
-                    emit_byte(0xf7);
-                    emit_byte(modrm(3, 3, reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_reg64(code->lhs)) {
-                    emit_rex_prefix(1, NULL, code->lhs);
-                    emit_byte(0xf7);
-                    emit_byte(modrm(3, 3, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_NOT:
-                if (is_reg32(code->lhs)) {
-                    emit_rex_prefix(0, NULL, code->lhs);
-                    emit_byte(0xf7);
-                    emit_byte(modrm(3, 2, reg_field(code->lhs)));
-                    break;
-                }
-
-                if (is_reg64(code->lhs)) {
-                    emit_rex_prefix(1, NULL, code->lhs);
-                    emit_byte(0xf7);
-                    emit_byte(modrm(3, 2, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SAL:
-                if (is_reg8(code->lhs) && is_reg32(code->rhs)) {
-                    // TODO: assume that code->lhs is CL.
-                    assert(code->lhs->kind == REG_CL);
-                    emit_rex_prefix(0, NULL, code->rhs);
-                    emit_byte(0xd3);
-                    emit_byte(modrm(3, 4, reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg8(code->lhs) && is_reg64(code->rhs)) {
-                    // TODO: assume that code->lhs is CL.
-                    assert(code->lhs->kind == REG_CL);
-                    emit_rex_prefix(1, NULL, code->rhs);
-                    emit_byte(0xd3);
-                    emit_byte(modrm(3, 4, reg_field(code->rhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SAR:
-                if (is_reg8(code->lhs) && is_reg32(code->rhs)) {
-                    // TODO: assume that code->lhs is CL.
-                    assert(code->lhs->kind == REG_CL);
-                    emit_rex_prefix(0, NULL, code->rhs);
-                    emit_byte(0xd3);
-                    emit_byte(modrm(3, 7, reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg8(code->lhs) && is_reg64(code->rhs)) {
-                    // TODO: assume that code->lhs is CL.
-                    assert(code->lhs->kind == REG_CL);
-                    emit_rex_prefix(1, NULL, code->rhs);
-                    emit_byte(0xd3);
-                    emit_byte(modrm(3, 7, reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_rex_prefix(1, NULL, code->rhs);
-                    emit_byte(0xc1);
-                    emit_byte(modrm(3, 7, reg_field(code->rhs)));
-                    emit_byte(code->lhs->ival);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_CMP:
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x39);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_rex_prefix(1, code->lhs, code->rhs);
-                    emit_byte(0x39);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, NULL, code->rhs);
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 7, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                if (is_imm(code->lhs) && is_reg64(code->rhs)) {
-                    emit_rex_prefix(1, NULL, code->rhs);
-                    emit_byte(0x81);
-                    emit_byte(modrm(3, 7, reg_field(code->rhs)));
-                    emit_dword_int(code->lhs->ival);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SETL:
-                if (is_reg8(code->lhs)) {
-                    emit_word(0x0f, 0x9c);
-                    emit_byte(modrm(3, 0, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SETLE:
-                if (is_reg8(code->lhs)) {
-                    emit_word(0x0f, 0x9e);
-                    emit_byte(modrm(3, 0, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_SETE:
-                if (is_reg8(code->lhs)) {
-                    emit_word(0x0f, 0x94);
-                    emit_byte(modrm(3, 0, reg_field(code->lhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_AND:
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x21);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_XOR:
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x31);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                if (is_reg64(code->lhs) && is_reg64(code->rhs)) {
-                    emit_rex_prefix(1, code->lhs, code->rhs);
-                    emit_byte(0x31);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_OR:
-                if (is_reg32(code->lhs) && is_reg32(code->rhs)) {
-                    emit_rex_prefix(0, code->lhs, code->rhs);
-                    emit_byte(0x09);
-                    emit_byte(
-                        modrm(3, reg_field(code->lhs), reg_field(code->rhs)));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_LEA:
-                if (is_addrof(code->lhs) && is_reg64(code->rhs)) {
-                    emit_byte(rex_prefix_reg_ext(1, code->rhs, code->lhs->lhs));
-                    emit_byte(0x8d);
-                    emit_addrof(reg_field(code->rhs), code->lhs);
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_PUSH:
-                if (is_reg64(code->lhs)) {
-                    if (is_reg_ext(code->lhs)) emit_byte(0x41);
-                    emit_byte(0x50 + reg_field(code->lhs));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_POP:
-                if (is_reg64(code->lhs)) {
-                    if (is_reg_ext(code->lhs)) emit_byte(0x41);
-                    emit_byte(0x58 + reg_field(code->lhs));
-                    break;
-                }
-
-                goto not_implemented_error;
-
-            case INST_RET:
-                emit_byte(0xc3);
-                break;
-
-            case INST_CLTD:
-                emit_byte(0x99);
-                break;
-
-            case INST_CLTQ:
-                emit_word(0x48, 0x98);
-                break;
-
-            case INST_JMP: {
-                emit_byte(0xe9);
-                emit_dword_int(0);  // placeholder
-
-                LabelPlaceholder *lph = safe_malloc(sizeof(LabelPlaceholder));
-                lph->label = code->label;
-                lph->offset = get_current_section_buffer_size();
-                lph->size = 4;
-                vector_push_back(label_placeholders, lph);
-            } break;
-
-            case INST_JE: {
-                emit_byte(0x74);
-                emit_byte(0);  // placeholder
-
-                LabelPlaceholder *lph = safe_malloc(sizeof(LabelPlaceholder));
-                lph->label = code->label;
-                lph->offset = get_current_section_buffer_size();
-                lph->size = 1;
-                vector_push_back(label_placeholders, lph);
-            } break;
-
-            case INST_JNE: {
-                emit_byte(0x75);
-                emit_byte(0);  // placeholder
-
-                LabelPlaceholder *lph = safe_malloc(sizeof(LabelPlaceholder));
-                lph->label = code->label;
-                lph->offset = get_current_section_buffer_size();
-                lph->size = 1;
-                vector_push_back(label_placeholders, lph);
-            } break;
-
-            case INST_JAE: {
-                emit_byte(0x73);
-                emit_byte(0);  // placeholder
+            case INST_JMP:
+            case INST_JE:
+            case INST_JNE:
+            case INST_JL:
+            case INST_JLE:
+            case INST_JG:
+            case INST_JGE:
+            case INST_JB:
+            case INST_JBE:
+            case INST_JA:
+            case INST_JAE:
+            case INST_CALL: {
+                // indirect one e.g. jmp *(%r11,%rax,8) has no placeholder.
+                if (code->lhs != NULL) goto encode;
 
                 LabelPlaceholder *lph = safe_malloc(sizeof(LabelPlaceholder));
+                lph->size = encode_branch(code, (int)vector_get(is_long, i));
                 lph->label = code->label;
                 lph->offset = get_current_section_buffer_size();
-                lph->size = 1;
+                lph->section = get_current_section();
+                lph->code_index = i;
                 vector_push_back(label_placeholders, lph);
             } break;
 
-            case INST_INCL:
-                if (is_addrof(code->lhs)) {
-                    emit_rex_prefix(0, NULL, code->lhs->lhs);
-                    emit_byte(0xff);
-                    emit_addrof(0, code->lhs);
-                    break;
-                }
-                goto not_implemented_error;
-
-            case INST_INCQ:
-                if (is_addrof(code->lhs)) {
-                    emit_rex_prefix(1, NULL, code->lhs->lhs);
-                    emit_byte(0xff);
-                    emit_addrof(0, code->lhs);
-                    break;
-                }
-                goto not_implemented_error;
-
-            case INST_DECL:
-                if (is_addrof(code->lhs)) {
-                    emit_rex_prefix(0, NULL, code->lhs->lhs);
-                    emit_byte(0xff);
-                    emit_addrof(1, code->lhs);
-                    break;
-                }
-                goto not_implemented_error;
-
-            case INST_DECQ:
-                if (is_addrof(code->lhs)) {
-                    emit_rex_prefix(1, NULL, code->lhs->lhs);
-                    emit_byte(0xff);
-                    emit_addrof(1, code->lhs);
-                    break;
-                }
-                goto not_implemented_error;
-
             case INST_LABEL: {
+                start_section_of_label(code->label);
                 add_label_offset(code->label);
-                if (get_current_section() == DATA_SECTION)
-                    // create symbol if not exists.
+                // create symbol if not exists. A label in text is of a
+                // function unless it is local e.g. of a jump.
+                if (!get_section(get_current_section())->is_text)
                     get_symbol_info(code->label);
+                else if (code->label[0] != '.') {
+                    vector_push_back(functions, get_symbol_info(code->label));
+                    vector_push_back(lines, new_vector());
+                }
             } break;
 
-            case INST_CALL: {
-                emit_byte(0xe8);
-                emit_dword_int(0);  // placeholder
-
-                LabelPlaceholder *lph = safe_malloc(sizeof(LabelPlaceholder));
-                lph->label = code->label;
-                lph->offset = get_current_section_buffer_size();
-                lph->size = 4;
-                vector_push_back(label_placeholders, lph);
-            } break;
-
-            case INST_NOP:
-                emit_byte(0x90);
+            case CD_FILE:
+                while (vector_size(files) < code->ival)
+                    vector_push_back(files, NULL);
+                vector_set(files, code->ival - 1, code->sval);
                 break;
 
-            case INST_SYSCALL:
-                emit_word(0x0f, 0x05);
-                break;
+            case CD_LOC: {
+                // the line of the code from here in the current function.
+                if (vector_size(functions) == 0) break;
+                Vector *rows = vector_get(lines, vector_size(lines) - 1);
+                LineRow *row = (LineRow *)safe_malloc(sizeof(LineRow));
+                row->offset = get_current_section_buffer_size();
+                row->file = code->lhs->ival;
+                row->line = code->rhs->ival;
+                // the last one wins if no code is between them.
+                int nrows = vector_size(rows);
+                if (nrows > 0 &&
+                    ((LineRow *)vector_get(rows, nrows - 1))->offset ==
+                        row->offset)
+                    vector_set(rows, nrows - 1, row);
+                else
+                    vector_push_back(rows, row);
+            } break;
 
+            // markers are left by cc when it passes Code directly.
             case CD_COMMENT:
+            case MRK_BASIC_BLOCK_START:
+            case MRK_BASIC_BLOCK_END:
+            case MRK_FUNCDEF_START:
+            case MRK_FUNCDEF_END:
+            case MRK_FUNCDEF_RETURN:
                 break;
 
             case CD_GLOBAL:
@@ -837,11 +463,11 @@ ObjectImage *assemble_code_detail(Vector *code_list)
                 break;
 
             case CD_TEXT:
-                set_current_section(TEXT_SECTION);
+                set_current_section(objimg->text_section);
                 break;
 
             case CD_DATA:
-                set_current_section(DATA_SECTION);
+                set_current_section(objimg->data_section);
                 break;
 
             case CD_ZERO:
@@ -857,6 +483,14 @@ ObjectImage *assemble_code_detail(Vector *code_list)
                 break;
 
             case CD_QUAD:
+                if (code->label != NULL) {
+                    // absolute address of the label, resolved by linker.
+                    assert(!get_section(get_current_section())->is_text);
+                    add_rela_entry(get_current_section_buffer_size(), 1,
+                                   get_symbol_info(code->label), 0);
+                    emit_nbytes(8, 0);
+                    break;
+                }
                 emit_nbytes(8, code->ival);
                 break;
 
@@ -865,17 +499,32 @@ ObjectImage *assemble_code_detail(Vector *code_list)
                 break;
 
             default:
-                goto not_implemented_error;
+                goto encode;
         }
 
         continue;
 
-    not_implemented_error:
+    encode:
+        if (encode_code(code)) continue;
         error("not implemented code: %d", code->kind);
     }
 
     SymbolInfo *sym = get_symbol_info("_GLOBAL_OFFSET_TABLE_");
 
+    // a function lasts until the next one in its section or the end of it.
+    for (int i = 0; i < vector_size(functions); i++) {
+        SymbolInfo *func = (SymbolInfo *)vector_get(functions, i);
+        SectionOffset *so = lookup_label_offset(func->label);
+        int end = vector_size(get_section(so->section)->bytes);
+        if (i + 1 < vector_size(functions)) {
+            SectionOffset *next = lookup_label_offset(
+                ((SymbolInfo *)vector_get(functions, i + 1))->label);
+            if (next->section == so->section) end = next->offset;
+        }
+        func->st_info |= 0x02;  // STT_FUNC
+        func->st_size = end - so->offset;
+    }
+
     // if symbol doesn't have an instance (offset), then it's global.
     for (int i = 0; i < vector_size(target_objimg->symtab); i++) {
         SymbolInfo *sym = (SymbolInfo *)vector_get(target_objimg->symtab, i);
@@ -883,40 +532,51 @@ ObjectImage *assemble_code_detail(Vector *code_list)
             sym->st_info |= 0x10;
     }
 
-    for (int i = 0; i < vector_size(objimg->rela); i++) {
-        RelaEntry *ent = (RelaEntry *)vector_get(objimg->rela, i);
-
-        // if rela variable entry has no instance (offset), then its symtabidx
-        // is sym->index. e.g. extern var
-        if (map_lookup(target_objimg->label2offset, ent->symbol->label) == NULL)
-            ent->symtabidx = ent->symbol->index;
-
-        // if rela variable entry isn't global, then its offset is calculated
-        // from section head.
-        // TODO: assume that is in .data section.
-        if (!(ent->symbol->st_info & 0x10)) {
+    // a local label is pointed by the symbol of its section, e.g. .quad
+    // label and label(%rip).
+    for (int i = 0; i < vector_size(objimg->sections); i++) {
+        Vector *rela = get_section(i)->rela;
+        for (int j = 0; j < vector_size(rela); j++) {
+            RelaEntry *ent = (RelaEntry *)vector_get(rela, j);
+            if (ent->symbol->st_info & 0x10) continue;
             SectionOffset *so = lookup_label_offset(ent->symbol->label);
-            if (so != NULL && so->section == DATA_SECTION) {
-                ent->addend += so->offset;
-                ent->symtabidx = 2;
-            }
+            ent->addend += so->offset;
+            ent->section = so->section;
         }
     }
 
     // write offset to label placeholders
-    set_current_section(TEXT_SECTION);  // TODO: DATA_SECTION?
+    need_relaxation = 0;
     for (int i = 0; i < vector_size(label_placeholders); i++) {
         LabelPlaceholder *lph =
             (LabelPlaceholder *)vector_get(label_placeholders, i);
         SectionOffset *secoff = lookup_label_offset(lph->label);
         SymbolInfo *sym = get_symbol_info(lph->label);
+        set_current_section(lph->section);
 
         if (sym->st_info & 0x10 || secoff == NULL) {
             // the label (symbol) we're looking for is global or not in this
             // file, so should be reallocated by linker.
-            assert(lph->size == 4);
+            if (lph->size == 1) {
+                vector_set(is_long, lph->code_index, (void *)1);
+                need_relaxation = 1;
+                continue;
+            }
             sym->st_info |= 0x10;  // make this global. TODO: is this right?
-            add_rela_entry(lph->offset - 4, 2, sym->index, sym);
+            add_rela_entry(lph->offset - 4, 2, sym, -4);
+            continue;
+        }
+
+        if (secoff->section != lph->section) {
+            // a local function in another section, e.g. a static one with
+            // AS_FUNCTION_SECTIONS.
+            if (lph->size == 1) {
+                vector_set(is_long, lph->code_index, (void *)1);
+                need_relaxation = 1;
+                continue;
+            }
+            add_rela_entry(lph->offset - 4, 2, sym, secoff->offset - 4)
+                ->section = secoff->section;
             continue;
         }
 
@@ -930,7 +590,11 @@ ObjectImage *assemble_code_detail(Vector *code_list)
                 break;
 
             case 1:
-                assert(-128 <= v && v <= 127);
+                if (v < -128 || 127 < v) {
+                    vector_set(is_long, lph->code_index, (void *)1);
+                    need_relaxation = 1;
+                    break;
+                }
                 reemit_byte(lph->offset - 1, v & 0xff);
                 break;
 
@@ -939,17 +603,76 @@ ObjectImage *assemble_code_detail(Vector *code_list)
         }
     }
 
+    if (!need_relaxation && vector_size(files) > 0)
+        add_debug_sections(functions, lines, files);
+
     return objimg;
 }
 
-ObjectImage *assemble_code(Vector *code) { return assemble_code_detail(code); }
+// Branch relaxation. All jmp and jcc start with rel8 and the ones which can't
+// reach their targets are changed to rel32, then the code is assembled again.
+// Branches only grow, so this terminates.
+ObjectImage *assemble_code(Vector *code, int section_flags)
+{
+    Vector *is_long = new_vector();
+    for (int i = 0; i < vector_size(code); i++)
+        vector_push_back(is_long, (void *)0);
+
+    while (1) {
+        ObjectImage *objimg =
+            assemble_code_detail(code, is_long, section_flags);
+        if (!need_relaxation) return objimg;
+    }
+}
+
+// emit the section header.
+void emit_section_header(int name, int type, int flags, int offset, int size,
+                         int link, int info, int align, int entsize)
+{
+    emit_dword_int(name);
+    emit_dword_int(type);
+    emit_qword_int(flags, 0);
+    emit_qword_int(0, 0);  // sh_addr
+    emit_qword_int(offset, 0);
+    emit_qword_int(size, 0);
+    emit_dword_int(link);
+    emit_dword_int(info);
+    emit_qword_int(align, 0);
+    emit_qword_int(entsize, 0);
+}
 
-void dump_object_image(ObjectImage *objimg, FILE *fh)
+// pad the output to 8 bytes.
+void emit_padding()
+{
+    while (emitted_size() % 8 != 0) emit_byte(0);
+}
+
+// the bytes of the ELF relocatable file of objimg. Each section of objimg is
+// followed by its relocation section, so the index of the i-th one is 1 + 2i
+// in the section header table. Then .symtab, .strtab and .shstrtab follow.
+// In .symtab the symbols of the sections come first and the labels follow,
+// the local ones before the global ones as ELF requires.
+Vector *emit_object_image(ObjectImage *objimg)
 {
     init_target_objimg(objimg);
     Vector *dumped = new_vector();
     set_buffer_to_emit(dumped);
 
+    int nsections = vector_size(objimg->sections);
+    int symtab_index = 1 + nsections * 2;
+
+    Vector *symbols = new_vector();
+    int nlocals = 0;
+    for (int global = 0; global <= 1; global++) {
+        for (int i = 0; i < vector_size(objimg->symtab); i++) {
+            SymbolInfo *sym = (SymbolInfo *)vector_get(objimg->symtab, i);
+            if (((sym->st_info & 0x10) != 0) != global) continue;
+            sym->index = vector_size(symbols);
+            vector_push_back(symbols, sym);
+        }
+        if (!global) nlocals = vector_size(symbols);
+    }
+
     //
     // *** ELF HEADER ***
     //
@@ -1001,9 +724,9 @@ void dump_object_image(ObjectImage *objimg, FILE *fh)
     // size of section header table entry
     emit_word(0x40, 0x00);
     // number of entries in section header table
-    emit_word(0x08, 0x00);
+    emit_word_int(symtab_index + 3);
     // index of section header entry containing section names
-    emit_word(0x07, 0x00);
+    emit_word_int(symtab_index + 2);
 
     int header_size = emitted_size() - header_offset;
 
@@ -1011,72 +734,45 @@ void dump_object_image(ObjectImage *objimg, FILE *fh)
     // *** PROGRAM ***
     //
 
-    int text_offset = emitted_size();
-
-    // .text
-    for (int i = 0; i < vector_size(objimg->text); i++)
-        emit_byte((int)vector_get(objimg->text, i));
-
-    int text_size = emitted_size() - text_offset;
-
-    // .data
-    int data_offset = emitted_size();
-
-    for (int i = 0; i < vector_size(objimg->data); i++)
-        emit_byte((int)vector_get(objimg->data, i));
-    // padding
-    while (emitted_size() % 8 != 0) emit_byte(0);
-
-    int data_size = emitted_size() - data_offset;
-
-    // .bss
-    int bss_offset = emitted_size();
-
-    // TODO: assume no data
-
-    int bss_size = emitted_size() - bss_offset;
+    // the sections and their relocations. Each one starts at 8 bytes.
+    Vector *offsets = new_vector(), *rela_offsets = new_vector();
+    for (int i = 0; i < nsections; i++) {
+        Section *sec = get_section(i);
+        vector_push_back(offsets, (void *)emitted_size());
+        for (int j = 0; j < vector_size(sec->bytes); j++)
+            emit_byte((int)vector_get(sec->bytes, j));
+        emit_padding();
+
+        vector_push_back(rela_offsets, (void *)emitted_size());
+        for (int j = 0; j < vector_size(sec->rela); j++) {
+            RelaEntry *ent = (RelaEntry *)vector_get(sec->rela, j);
+            int symtabidx = ent->section >= 0
+                                ? 1 + ent->section
+                                : 1 + nsections + ent->symbol->index;
+            emit_qword_int(ent->offset, 0);
+            emit_qword_int(ent->type, symtabidx);
+            emit_qword_int(ent->addend, ent->addend >= 0 ? 0 : -1);
+        }
+    }
 
     // .symtab
     int symtab_offset = emitted_size();
 
-    emit_dword(0x00, 0x00, 0x00, 0x00);  // st_name
-    emit_byte(0x00);                     // st_info
-    emit_byte(0x00);                     // st_other
-    emit_word(0x00, 0x00);               // st_shndx
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_value
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_size
-
-    emit_dword(0x00, 0x00, 0x00, 0x00);  // st_name
-    emit_byte(0x03);                     // st_info
-    emit_byte(0x00);                     // st_other
-    emit_word(0x01, 0x00);               // st_shndx
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_value
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_size
-
-    emit_dword(0x00, 0x00, 0x00, 0x00);  // st_name
-    emit_byte(0x03);                     // st_info
-    emit_byte(0x00);                     // st_other
-    emit_word(0x03, 0x00);               // st_shndx
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_value
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_size
-
-    emit_dword(0x00, 0x00, 0x00, 0x00);  // st_name
-    emit_byte(0x03);                     // st_info
-    emit_byte(0x00);                     // st_other
-    emit_word(0x04, 0x00);               // st_shndx
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_value
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-               0x00);  // st_size
+    emit_qword_int(0, 0);  // st_name, st_info, st_other and st_shndx
+    emit_qword_int(0, 0);  // st_value
+    emit_qword_int(0, 0);  // st_size
+
+    for (int i = 0; i < nsections; i++) {
+        emit_dword_int(0);     // st_name
+        emit_byte(0x03);       // st_info: STT_SECTION
+        emit_byte(0x00);       // st_other
+        emit_word_int(1 + i * 2);  // st_shndx
+        emit_qword_int(0, 0);  // st_value
+        emit_qword_int(0, 0);  // st_size
+    }
 
-    for (int i = 0; i < vector_size(target_objimg->symtab); i++) {
-        SymbolInfo *sym = (SymbolInfo *)vector_get(target_objimg->symtab, i);
+    for (int i = 0; i < vector_size(symbols); i++) {
+        SymbolInfo *sym = (SymbolInfo *)vector_get(symbols, i);
 
         emit_dword_int(sym->st_name);
         emit_byte(sym->st_info);
@@ -1088,11 +784,11 @@ void dump_object_image(ObjectImage *objimg, FILE *fh)
             emit_qword_int(0, 0);
         }
         else {
-            emit_word_int(so->section == TEXT_SECTION ? 1 : 3);
+            emit_word_int(1 + so->section * 2);
             emit_qword_int(so->offset, 0);
         }
 
-        emit_qword_int(0, 0);
+        emit_qword_int(sym->st_size, 0);
     }
 
     int symtab_size = emitted_size() - symtab_offset;
@@ -1102,34 +798,26 @@ void dump_object_image(ObjectImage *objimg, FILE *fh)
 
     for (int i = 0; i < vector_size(objimg->strtab); i++)
         emit_byte((int)vector_get(objimg->strtab, i));
-    // padding
-    while (emitted_size() % 8 != 0) emit_byte(0);
+    emit_padding();
 
     int strtab0_size = emitted_size() - strtab0_offset;
 
-    // .rela.text
-    int rela_text_offset = emitted_size();
-
-    for (int i = 0; i < vector_size(objimg->rela); i++) {
-        RelaEntry *ent = (RelaEntry *)vector_get(objimg->rela, i);
-        emit_qword_int(ent->offset, 0);
-        emit_qword_int(ent->type, ent->symtabidx);
-        emit_qword_int(ent->addend, ent->addend >= 0 ? 0 : -1);
-    }
-
-    int rela_text_size = emitted_size() - rela_text_offset;
-
-    // .strtab
+    // .shstrtab, which has e.g. ".rela.text" and ".text" in one string.
     int strtab1_offset = emitted_size();
 
     emit_byte(0x00);
     emit_string(".symtab\0", 8);
     emit_string(".strtab\0", 8);
     emit_string(".shstrtab\0", 10);
-    emit_string(".rela.text\0", 11);
-    emit_string(".data\0", 6);
-    emit_string(".bss\0", 5);
-    while (emitted_size() % 8 != 0) emit_byte(0);
+    Vector *name_offsets = new_vector();
+    for (int i = 0; i < nsections; i++) {
+        char *name = get_section(i)->name;
+        vector_push_back(name_offsets,
+                         (void *)(emitted_size() - strtab1_offset));
+        emit_string(".rela", 5);
+        emit_string(name, strlen(name) + 1);
+    }
+    emit_padding();
 
     int strtab1_size = emitted_size() - strtab1_offset;
 
@@ -1150,89 +838,41 @@ void dump_object_image(ObjectImage *objimg, FILE *fh)
     reemit_byte(sht_addr + 7, 0);
 
     // NULL
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .text
-    emit_qword(0x20, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00);
-    emit_qword(0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(text_offset, 0);
-    emit_qword_int(text_size, 0);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .rela.text
-    emit_qword(0x1b, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00);
-    emit_qword(0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(rela_text_offset, 0);
-    emit_qword_int(rela_text_size, 0);
-    emit_qword(0x05, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00);
-    emit_qword(0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .data
-    emit_qword(0x26, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00);
-    emit_qword(0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(data_offset, 0);
-    emit_qword_int(data_size, 0);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .bss
-    emit_qword(0x2c, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00);
-    emit_qword(0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(bss_offset, 0);
-    emit_qword_int(bss_size, 0);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .symtab
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(symtab_offset, 0);
-    emit_qword_int(symtab_size, 0);
-    emit_dword(0x06, 0x00, 0x00, 0x00);
-    emit_dword_int(4);  // number of local symbols
-    emit_qword(0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-
-    // .strtab
-    emit_qword(0x09, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(strtab0_offset, 0);
-    emit_qword_int(strtab0_size, 0);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+    emit_section_header(0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    for (int i = 0; i < nsections; i++) {
+        Section *sec = get_section(i);
+        int name = (int)vector_get(name_offsets, i);
+
+        // SHT_PROGBITS with SHF_ALLOC and SHF_EXECINSTR or SHF_WRITE, or
+        // without them for debug sections.
+        int flags = sec->is_text ? 0x06 : 0x03;
+        if (sec->is_debug) flags = 0;
+        emit_section_header(name + 5, 0x01, flags,
+                            (int)vector_get(offsets, i),
+                            vector_size(sec->bytes), 0, 0, 1, 0);
+        // SHT_RELA with SHF_INFO_LINK
+        emit_section_header(name, 0x04, 0x40, (int)vector_get(rela_offsets, i),
+                            vector_size(sec->rela) * 0x18, symtab_index,
+                            1 + i * 2, 8, 0x18);
+    }
 
+    // .symtab, whose local symbols are the null, section and local ones.
+    emit_section_header(0x01, 0x02, 0, symtab_offset, symtab_size,
+                        symtab_index + 1, 1 + nsections + nlocals, 8, 0x18);
     // .strtab
-    emit_qword(0x11, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword_int(strtab1_offset, 0);
-    emit_qword_int(strtab1_size, 0);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+    emit_section_header(0x09, 0x03, 0, strtab0_offset, strtab0_size, 0, 0, 1,
+                        0);
+    // .shstrtab
+    emit_section_header(0x11, 0x03, 0, strtab1_offset, strtab1_size, 0, 0, 1,
+                        0);
 
-    int sht_size = emitted_size() - sht_offset;
+    return dumped;
+}
 
-    // write dumped to file
+void dump_object_image(ObjectImage *objimg, FILE *fh)
+{
+    Vector *dumped = emit_object_image(objimg);
     for (int i = 0; i < vector_size(dumped); i++)
         write_byte(fh, (int)vector_get(dumped, i));
 }
@@ -6,6 +6,7 @@ Code *new_code(int kind)
     code->kind = kind;
     code->lhs = code->rhs = NULL;
     code->ival = 0;
+    code->scale = 1;
     code->sval = NULL;
     code->label = NULL;
     code->read_dep = new_vector();
@@ -55,6 +56,14 @@ Code *new_addrof_code(Code *reg, int offset)
     return code;
 }
 
+Code *new_addrof_index_code(Code *reg, Code *index, int scale, int offset)
+{
+    Code *code = new_addrof_code(reg, offset);
+    code->rhs = index;
+    code->scale = scale;
+    return code;
+}
+
 Code *MOV(Code *lhs, Code *rhs)
 {
     Code *code = new_code(INST_MOV);
@@ -133,6 +142,8 @@ Code *SAR(Code *lhs, Code *rhs) { return new_binop_code(INST_SAR, lhs, rhs); }
 
 Code *SAL(Code *lhs, Code *rhs) { return new_binop_code(INST_SAL, lhs, rhs); }
 
+Code *SHR(Code *lhs, Code *rhs) { return new_binop_code(INST_SHR, lhs, rhs); }
+
 Code *NEG(Code *lhs) { return new_unary_code(INST_NEG, lhs); }
 
 Code *NOT(Code *lhs) { return new_unary_code(INST_NOT, lhs); }
@@ -185,6 +196,55 @@ Code *JAE(char *label)
     return code;
 }
 
+Code *JGE(char *label)
+{
+    Code *code = new_code(INST_JGE);
+    code->label = label;
+    return code;
+}
+
+Code *JB(char *label)
+{
+    Code *code = new_code(INST_JB);
+    code->label = label;
+    return code;
+}
+
+Code *JL(char *label)
+{
+    Code *code = new_code(INST_JL);
+    code->label = label;
+    return code;
+}
+
+Code *JLE(char *label)
+{
+    Code *code = new_code(INST_JLE);
+    code->label = label;
+    return code;
+}
+
+Code *JG(char *label)
+{
+    Code *code = new_code(INST_JG);
+    code->label = label;
+    return code;
+}
+
+Code *JBE(char *label)
+{
+    Code *code = new_code(INST_JBE);
+    code->label = label;
+    return code;
+}
+
+Code *JA(char *label)
+{
+    Code *code = new_code(INST_JA);
+    code->label = label;
+    return code;
+}
+
 Code *LABEL(char *label)
 {
     Code *code = new_code(INST_LABEL);
@@ -355,6 +415,8 @@ char *code2str(Code *code)
             return "%rbp";
         case REG_RSP:
             return "%rsp";
+        case REG_RBX:
+            return "%rbx";
 
         case REG_RIP:
             return "%rip";
@@ -379,6 +441,18 @@ char *code2str(Code *code)
             return format("movzb %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_MOVZW:
+            return format("movzw %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_MOVSBQ:
+            return format("movsbq %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_MOVSW:
+            return format("movsw %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
         case INST_LEA:
             return format("lea %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
@@ -401,10 +475,26 @@ char *code2str(Code *code)
             return format("sub %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_ADC:
+            return format("adc %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_SBB:
+            return format("sbb %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_MUL:
+            return format("mul %s", code2str(code->lhs));
+
         case INST_IMUL:
+            if (code->rhs == NULL)
+                return format("imul %s", code2str(code->lhs));
             return format("imul %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_DIV:
+            return format("div %s", code2str(code->lhs));
+
         case INST_IDIV:
             return format("idiv %s", code2str(code->lhs));
 
@@ -416,6 +506,10 @@ char *code2str(Code *code)
             return format("sal %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_SHR:
+            return format("shr %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
         case INST_NEG:
             return format("neg %s", code2str(code->lhs));
 
@@ -426,6 +520,10 @@ char *code2str(Code *code)
             return format("cmp %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_TEST:
+            return format("test %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
         case INST_SETL:
             return format("setl %s", code2str(code->lhs));
 
@@ -435,6 +533,67 @@ char *code2str(Code *code)
         case INST_SETE:
             return format("sete %s", code2str(code->lhs));
 
+        case INST_SETNE:
+            return format("setne %s", code2str(code->lhs));
+
+        case INST_SETG:
+            return format("setg %s", code2str(code->lhs));
+
+        case INST_SETGE:
+            return format("setge %s", code2str(code->lhs));
+
+        case INST_SETB:
+            return format("setb %s", code2str(code->lhs));
+
+        case INST_SETBE:
+            return format("setbe %s", code2str(code->lhs));
+
+        case INST_SETA:
+            return format("seta %s", code2str(code->lhs));
+
+        case INST_SETAE:
+            return format("setae %s", code2str(code->lhs));
+
+        case INST_CMOVE:
+            return format("cmove %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVNE:
+            return format("cmovne %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVL:
+            return format("cmovl %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVLE:
+            return format("cmovle %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVG:
+            return format("cmovg %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVGE:
+            return format("cmovge %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVB:
+            return format("cmovb %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVBE:
+            return format("cmovbe %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVA:
+            return format("cmova %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
+        case INST_CMOVAE:
+            return format("cmovae %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
         case INST_AND:
             return format("and %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
@@ -457,6 +616,8 @@ char *code2str(Code *code)
             return "cltq";
 
         case INST_JMP:
+            if (code->lhs != NULL)
+                return format("jmp *%s", code2str(code->lhs));
             return format("jmp %s", code->label);
 
         case INST_JE:
@@ -468,9 +629,36 @@ char *code2str(Code *code)
         case INST_JAE:
             return format("jae %s", code->label);
 
+        case INST_JGE:
+            return format("jge %s", code->label);
+
+        case INST_JB:
+            return format("jb %s", code->label);
+
+        case INST_JL:
+            return format("jl %s", code->label);
+
+        case INST_JLE:
+            return format("jle %s", code->label);
+
+        case INST_JG:
+            return format("jg %s", code->label);
+
+        case INST_JBE:
+            return format("jbe %s", code->label);
+
+        case INST_JA:
+            return format("ja %s", code->label);
+
         case INST_LABEL:
             return format("%s:", code->label);
 
+        case INST_INC:
+            return format("inc %s", code2str(code->lhs));
+
+        case INST_DEC:
+            return format("dec %s", code2str(code->lhs));
+
         case INST_INCL:
             return format("incl %s", code2str(code->lhs));
 
@@ -484,6 +672,8 @@ char *code2str(Code *code)
             return format("decq %s", code2str(code->lhs));
 
         case INST_CALL:
+            if (code->lhs != NULL)
+                return format("call *%s", code2str(code->lhs));
             return format("call %s", code->label);
 
         case INST_NOP:
@@ -499,6 +689,12 @@ char *code2str(Code *code)
             return format("$%d", code->ival);
 
         case CD_ADDR_OF:
+            if (code->rhs != NULL) {
+                char *mem = format("(%s,%s,%d)", code2str(code->lhs),
+                                   code2str(code->rhs), code->scale);
+                if (code->ival == 0) return mem;
+                return format("%d%s", code->ival, mem);
+            }
             if (code->ival == 0) return format("(%s)", code2str(code->lhs));
             return format("%d(%s)", code->ival, code2str(code->lhs));
 
@@ -524,11 +720,19 @@ char *code2str(Code *code)
             return format(".byte %d", code->ival);
 
         case CD_QUAD:
+            if (code->label != NULL) return format(".quad %s", code->label);
             return format(".quad %d", code->ival);
 
         case CD_ASCII:
             return format(".ascii \"%s\"",
                           escape_string(code->sval, code->ival));
+
+        case CD_FILE:
+            return format(".file %d \"%s\"", code->ival,
+                          escape_string(code->sval, strlen(code->sval)));
+
+        case CD_LOC:
+            return format(".loc %d %d", code->lhs->ival, code->rhs->ival);
     }
     warn(format("code.c %d", code->kind));
     assert(0);
@@ -0,0 +1,518 @@
+#include "as.h"
+
+// Table-driven instruction encoder. Every instruction kind has a list of
+// encodings, each of which describes the operand classes it accepts and how
+// its operands are put into REX, opcode, ModRM, SIB and immediate.
+// The first encoding whose operand classes match is used, so shorter forms
+// (e.g. imm8) are registered before longer ones (e.g. imm32).
+
+// operand classes. An operand matches if its class overlaps the encoding's.
+enum {
+    OPR_NONE = 1 << 0,
+    OPR_IMM8 = 1 << 1,    // immediate which fits in signed 8 bits
+    OPR_IMM32 = 1 << 2,   // any immediate
+    OPR_UIMM32 = 1 << 3,  // non-negative immediate
+    OPR_ONE = 1 << 4,     // immediate 1
+    OPR_R8 = 1 << 5,
+    OPR_R16 = 1 << 6,
+    OPR_R32 = 1 << 7,
+    OPR_R64 = 1 << 8,
+    OPR_CL = 1 << 9,
+    OPR_MEM = 1 << 10,
+    OPR_AL = 1 << 11,
+    OPR_EAX = 1 << 12,
+    OPR_RAX = 1 << 13,
+    OPR_REL8 = 1 << 14,   // branch target by rel8
+    OPR_REL32 = 1 << 15,  // branch target by rel32
+};
+
+// how operands are placed. In AT&T syntax lhs is the source and rhs is the
+// destination, and an immediate is always lhs.
+enum {
+    ENC_NONE,     // opcode (and immediate) only e.g. ret, push $imm
+    ENC_MR,       // ModRM.reg = lhs, ModRM.rm = rhs e.g. mov %eax, (%rdi)
+    ENC_RM,       // ModRM.reg = rhs, ModRM.rm = lhs e.g. mov (%rdi), %eax
+    ENC_M_LHS,    // ModRM.reg = ext, ModRM.rm = lhs e.g. neg %eax
+    ENC_M_RHS,    // ModRM.reg = ext, ModRM.rm = rhs e.g. add $1, %eax
+    ENC_RM_RHS,   // ModRM.reg = ModRM.rm = rhs e.g. imul $3, %eax
+    ENC_O_LHS,    // lhs register in opcode e.g. push %rax
+    ENC_O_RHS,    // rhs register in opcode e.g. mov $1, %eax
+};
+
+typedef struct {
+    int lhs, rhs;  // operand classes
+    int rex_w;
+    int opcode;  // e.g. 0x0faf for imul %eax, %ecx
+    int form;
+    int ext;       // opcode extension in ModRM.reg
+    int imm_size;  // size of the immediate (lhs) in bytes
+} Encoding;
+
+// vector<vector<Encoding *>> indexed by kind - INST_
+Vector *encoding_table = NULL;
+
+void add_encoding(int kind, int lhs, int rhs, int rex_w, int opcode, int form,
+                  int ext, int imm_size)
+{
+    Encoding *enc = (Encoding *)safe_malloc(sizeof(Encoding));
+    enc->lhs = lhs;
+    enc->rhs = rhs;
+    enc->rex_w = rex_w;
+    enc->opcode = opcode;
+    enc->form = form;
+    enc->ext = ext;
+    enc->imm_size = imm_size;
+    vector_push_back(vector_get(encoding_table, kind - INST_), enc);
+}
+
+// add, or, adc, sbb, and, sub, xor and cmp share the layout of their opcodes.
+// base is the opcode of r/m8 += r8 and ext is the extension for 0x80-0x83.
+void add_alu_encodings(int kind, int base, int ext)
+{
+    add_encoding(kind, OPR_R8, OPR_R8 | OPR_MEM, 0, base, ENC_MR, 0, 0);
+    add_encoding(kind, OPR_R32, OPR_R32 | OPR_MEM, 0, base + 1, ENC_MR, 0, 0);
+    add_encoding(kind, OPR_R64, OPR_R64 | OPR_MEM, 1, base + 1, ENC_MR, 0, 0);
+    add_encoding(kind, OPR_MEM, OPR_R8, 0, base + 2, ENC_RM, 0, 0);
+    add_encoding(kind, OPR_MEM, OPR_R32, 0, base + 3, ENC_RM, 0, 0);
+    add_encoding(kind, OPR_MEM, OPR_R64, 1, base + 3, ENC_RM, 0, 0);
+    add_encoding(kind, OPR_IMM8, OPR_AL, 0, base + 4, ENC_NONE, 0, 1);
+    add_encoding(kind, OPR_IMM8, OPR_R8, 0, 0x80, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_IMM8, OPR_R32, 0, 0x83, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_IMM32, OPR_EAX, 0, base + 5, ENC_NONE, 0, 4);
+    add_encoding(kind, OPR_IMM32, OPR_R32, 0, 0x81, ENC_M_RHS, ext, 4);
+    add_encoding(kind, OPR_IMM8, OPR_R64, 1, 0x83, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_IMM32, OPR_RAX, 1, base + 5, ENC_NONE, 0, 4);
+    add_encoding(kind, OPR_IMM32, OPR_R64, 1, 0x81, ENC_M_RHS, ext, 4);
+}
+
+// sal, shr and sar. ext is the extension for 0xc0-0xd3.
+void add_shift_encodings(int kind, int ext)
+{
+    add_encoding(kind, OPR_ONE, OPR_R8, 0, 0xd0, ENC_M_RHS, ext, 0);
+    add_encoding(kind, OPR_ONE, OPR_R32, 0, 0xd1, ENC_M_RHS, ext, 0);
+    add_encoding(kind, OPR_ONE, OPR_R64, 1, 0xd1, ENC_M_RHS, ext, 0);
+    add_encoding(kind, OPR_IMM8, OPR_R8, 0, 0xc0, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_IMM8, OPR_R32, 0, 0xc1, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_IMM8, OPR_R64, 1, 0xc1, ENC_M_RHS, ext, 1);
+    add_encoding(kind, OPR_CL, OPR_R8, 0, 0xd2, ENC_M_RHS, ext, 0);
+    add_encoding(kind, OPR_CL, OPR_R32, 0, 0xd3, ENC_M_RHS, ext, 0);
+    add_encoding(kind, OPR_CL, OPR_R64, 1, 0xd3, ENC_M_RHS, ext, 0);
+}
+
+// not, neg, mul, imul, div and idiv. ext is the extension for 0xf6 and 0xf7.
+void add_group3_encodings(int kind, int ext)
+{
+    add_encoding(kind, OPR_R8, OPR_NONE, 0, 0xf6, ENC_M_LHS, ext, 0);
+    add_encoding(kind, OPR_R32, OPR_NONE, 0, 0xf7, ENC_M_LHS, ext, 0);
+    add_encoding(kind, OPR_R64, OPR_NONE, 1, 0xf7, ENC_M_LHS, ext, 0);
+}
+
+// setcc, cmovcc and jcc. tttn is the condition field in their opcodes.
+void add_condition_encodings(int setcc, int cmovcc, int jcc, int tttn)
+{
+    add_encoding(setcc, OPR_R8 | OPR_MEM, OPR_NONE, 0, 0x0f90 + tttn,
+                 ENC_M_LHS, 0, 0);
+    add_encoding(cmovcc, OPR_R32 | OPR_MEM, OPR_R32, 0, 0x0f40 + tttn, ENC_RM,
+                 0, 0);
+    add_encoding(cmovcc, OPR_R64 | OPR_MEM, OPR_R64, 1, 0x0f40 + tttn, ENC_RM,
+                 0, 0);
+    add_encoding(jcc, OPR_REL8, OPR_NONE, 0, 0x70 + tttn, ENC_NONE, 0, 1);
+    add_encoding(jcc, OPR_REL32, OPR_NONE, 0, 0x0f80 + tttn, ENC_NONE, 0, 4);
+}
+
+void init_encoding_table()
+{
+    encoding_table = new_vector();
+    for (int kind = INST_; kind < CD_VALUE; kind++)
+        vector_push_back(encoding_table, new_vector());
+
+    // mov
+    add_encoding(INST_MOV, OPR_R8, OPR_R8 | OPR_MEM, 0, 0x88, ENC_MR, 0, 0);
+    add_encoding(INST_MOV, OPR_R32, OPR_R32 | OPR_MEM, 0, 0x89, ENC_MR, 0, 0);
+    add_encoding(INST_MOV, OPR_R64, OPR_R64 | OPR_MEM, 1, 0x89, ENC_MR, 0, 0);
+    add_encoding(INST_MOV, OPR_MEM, OPR_R8, 0, 0x8a, ENC_RM, 0, 0);
+    add_encoding(INST_MOV, OPR_MEM, OPR_R32, 0, 0x8b, ENC_RM, 0, 0);
+    add_encoding(INST_MOV, OPR_MEM, OPR_R64, 1, 0x8b, ENC_RM, 0, 0);
+    add_encoding(INST_MOV, OPR_IMM8, OPR_R8, 0, 0xb0, ENC_O_RHS, 0, 1);
+    add_encoding(INST_MOV, OPR_IMM32, OPR_R32, 0, 0xb8, ENC_O_RHS, 0, 4);
+    // writing the 32-bit register clears the upper half,
+    // so mov $imm, %r32 is shorter and equivalent.
+    add_encoding(INST_MOV, OPR_UIMM32, OPR_R64, 0, 0xb8, ENC_O_RHS, 0, 4);
+    add_encoding(INST_MOV, OPR_IMM32, OPR_R64, 1, 0xc7, ENC_M_RHS, 0, 4);
+    add_encoding(INST_MOVL, OPR_IMM32, OPR_MEM, 0, 0xc7, ENC_M_RHS, 0, 4);
+
+    // movzx, movsx
+    add_encoding(INST_MOVZB, OPR_R8 | OPR_MEM, OPR_R32, 0, 0x0fb6, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVZB, OPR_R8 | OPR_MEM, OPR_R64, 1, 0x0fb6, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVZW, OPR_R16 | OPR_MEM, OPR_R32, 0, 0x0fb7, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVZW, OPR_R16 | OPR_MEM, OPR_R64, 1, 0x0fb7, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVSBL, OPR_R8 | OPR_MEM, OPR_R32, 0, 0x0fbe, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVSBQ, OPR_R8 | OPR_MEM, OPR_R64, 1, 0x0fbe, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVSW, OPR_R16 | OPR_MEM, OPR_R32, 0, 0x0fbf, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVSW, OPR_R16 | OPR_MEM, OPR_R64, 1, 0x0fbf, ENC_RM, 0,
+                 0);
+    add_encoding(INST_MOVSLQ, OPR_R32 | OPR_MEM, OPR_R64, 1, 0x63, ENC_RM, 0,
+                 0);
+
+    // lea
+    add_encoding(INST_LEA, OPR_MEM, OPR_R32, 0, 0x8d, ENC_RM, 0, 0);
+    add_encoding(INST_LEA, OPR_MEM, OPR_R64, 1, 0x8d, ENC_RM, 0, 0);
+
+    // push, pop
+    add_encoding(INST_PUSH, OPR_R64, OPR_NONE, 0, 0x50, ENC_O_LHS, 0, 0);
+    add_encoding(INST_PUSH, OPR_MEM, OPR_NONE, 0, 0xff, ENC_M_LHS, 6, 0);
+    add_encoding(INST_PUSH, OPR_IMM8, OPR_NONE, 0, 0x6a, ENC_NONE, 0, 1);
+    add_encoding(INST_PUSH, OPR_IMM32, OPR_NONE, 0, 0x68, ENC_NONE, 0, 4);
+    add_encoding(INST_POP, OPR_R64, OPR_NONE, 0, 0x58, ENC_O_LHS, 0, 0);
+    add_encoding(INST_POP, OPR_MEM, OPR_NONE, 0, 0x8f, ENC_M_LHS, 0, 0);
+
+    // integer ALU
+    add_alu_encodings(INST_ADD, 0x00, 0);
+    add_alu_encodings(INST_OR, 0x08, 1);
+    add_alu_encodings(INST_ADC, 0x10, 2);
+    add_alu_encodings(INST_SBB, 0x18, 3);
+    add_alu_encodings(INST_AND, 0x20, 4);
+    add_alu_encodings(INST_SUB, 0x28, 5);
+    add_alu_encodings(INST_XOR, 0x30, 6);
+    add_alu_encodings(INST_CMP, 0x38, 7);
+    add_encoding(INST_ADDQ, OPR_IMM8, OPR_MEM, 1, 0x83, ENC_M_RHS, 0, 1);
+    add_encoding(INST_ADDQ, OPR_IMM32, OPR_MEM, 1, 0x81, ENC_M_RHS, 0, 4);
+
+    add_encoding(INST_TEST, OPR_R8, OPR_R8 | OPR_MEM, 0, 0x84, ENC_MR, 0, 0);
+    add_encoding(INST_TEST, OPR_R32, OPR_R32 | OPR_MEM, 0, 0x85, ENC_MR, 0, 0);
+    add_encoding(INST_TEST, OPR_R64, OPR_R64 | OPR_MEM, 1, 0x85, ENC_MR, 0, 0);
+    add_encoding(INST_TEST, OPR_IMM8, OPR_AL, 0, 0xa8, ENC_NONE, 0, 1);
+    add_encoding(INST_TEST, OPR_IMM8, OPR_R8, 0, 0xf6, ENC_M_RHS, 0, 1);
+    add_encoding(INST_TEST, OPR_IMM32, OPR_EAX, 0, 0xa9, ENC_NONE, 0, 4);
+    add_encoding(INST_TEST, OPR_IMM32, OPR_R32, 0, 0xf7, ENC_M_RHS, 0, 4);
+    add_encoding(INST_TEST, OPR_IMM32, OPR_RAX, 1, 0xa9, ENC_NONE, 0, 4);
+    add_encoding(INST_TEST, OPR_IMM32, OPR_R64, 1, 0xf7, ENC_M_RHS, 0, 4);
+
+    add_group3_encodings(INST_NOT, 2);
+    add_group3_encodings(INST_NEG, 3);
+    add_group3_encodings(INST_MUL, 4);
+    add_group3_encodings(INST_IMUL, 5);  // imul %reg: edx:eax = eax * reg
+    add_group3_encodings(INST_DIV, 6);
+    add_group3_encodings(INST_IDIV, 7);
+    add_encoding(INST_IMUL, OPR_R32 | OPR_MEM, OPR_R32, 0, 0x0faf, ENC_RM, 0,
+                 0);
+    add_encoding(INST_IMUL, OPR_R64 | OPR_MEM, OPR_R64, 1, 0x0faf, ENC_RM, 0,
+                 0);
+    add_encoding(INST_IMUL, OPR_IMM8, OPR_R32, 0, 0x6b, ENC_RM_RHS, 0, 1);
+    add_encoding(INST_IMUL, OPR_IMM32, OPR_R32, 0, 0x69, ENC_RM_RHS, 0, 4);
+    add_encoding(INST_IMUL, OPR_IMM8, OPR_R64, 1, 0x6b, ENC_RM_RHS, 0, 1);
+    add_encoding(INST_IMUL, OPR_IMM32, OPR_R64, 1, 0x69, ENC_RM_RHS, 0, 4);
+
+    add_shift_encodings(INST_SAL, 4);
+    add_shift_encodings(INST_SHR, 5);
+    add_shift_encodings(INST_SAR, 7);
+
+    add_encoding(INST_INC, OPR_R8, OPR_NONE, 0, 0xfe, ENC_M_LHS, 0, 0);
+    add_encoding(INST_INC, OPR_R32, OPR_NONE, 0, 0xff, ENC_M_LHS, 0, 0);
+    add_encoding(INST_INC, OPR_R64, OPR_NONE, 1, 0xff, ENC_M_LHS, 0, 0);
+    add_encoding(INST_DEC, OPR_R8, OPR_NONE, 0, 0xfe, ENC_M_LHS, 1, 0);
+    add_encoding(INST_DEC, OPR_R32, OPR_NONE, 0, 0xff, ENC_M_LHS, 1, 0);
+    add_encoding(INST_DEC, OPR_R64, OPR_NONE, 1, 0xff, ENC_M_LHS, 1, 0);
+    add_encoding(INST_INCL, OPR_MEM, OPR_NONE, 0, 0xff, ENC_M_LHS, 0, 0);
+    add_encoding(INST_INCQ, OPR_MEM, OPR_NONE, 1, 0xff, ENC_M_LHS, 0, 0);
+    add_encoding(INST_DECL, OPR_MEM, OPR_NONE, 0, 0xff, ENC_M_LHS, 1, 0);
+    add_encoding(INST_DECQ, OPR_MEM, OPR_NONE, 1, 0xff, ENC_M_LHS, 1, 0);
+
+    add_encoding(INST_CLTD, OPR_NONE, OPR_NONE, 0, 0x99, ENC_NONE, 0, 0);
+    add_encoding(INST_CLTQ, OPR_NONE, OPR_NONE, 1, 0x98, ENC_NONE, 0, 0);
+
+    // setcc, cmovcc, jcc
+    add_condition_encodings(INST_SETB, INST_CMOVB, INST_JB, 0x2);
+    add_condition_encodings(INST_SETAE, INST_CMOVAE, INST_JAE, 0x3);
+    add_condition_encodings(INST_SETE, INST_CMOVE, INST_JE, 0x4);
+    add_condition_encodings(INST_SETNE, INST_CMOVNE, INST_JNE, 0x5);
+    add_condition_encodings(INST_SETBE, INST_CMOVBE, INST_JBE, 0x6);
+    add_condition_encodings(INST_SETA, INST_CMOVA, INST_JA, 0x7);
+    add_condition_encodings(INST_SETL, INST_CMOVL, INST_JL, 0xc);
+    add_condition_encodings(INST_SETGE, INST_CMOVGE, INST_JGE, 0xd);
+    add_condition_encodings(INST_SETLE, INST_CMOVLE, INST_JLE, 0xe);
+    add_condition_encodings(INST_SETG, INST_CMOVG, INST_JG, 0xf);
+
+    // jmp, call
+    add_encoding(INST_JMP, OPR_REL8, OPR_NONE, 0, 0xeb, ENC_NONE, 0, 1);
+    add_encoding(INST_JMP, OPR_REL32, OPR_NONE, 0, 0xe9, ENC_NONE, 0, 4);
+    add_encoding(INST_JMP, OPR_R64 | OPR_MEM, OPR_NONE, 0, 0xff, ENC_M_LHS, 4,
+                 0);
+    add_encoding(INST_CALL, OPR_REL32, OPR_NONE, 0, 0xe8, ENC_NONE, 0, 4);
+    add_encoding(INST_CALL, OPR_R64 | OPR_MEM, OPR_NONE, 0, 0xff, ENC_M_LHS,
+                 2, 0);
+
+    add_encoding(INST_RET, OPR_NONE, OPR_NONE, 0, 0xc3, ENC_NONE, 0, 0);
+    add_encoding(INST_NOP, OPR_NONE, OPR_NONE, 0, 0x90, ENC_NONE, 0, 0);
+    add_encoding(INST_SYSCALL, OPR_NONE, OPR_NONE, 0, 0x0f05, ENC_NONE, 0, 0);
+}
+
+int is_reg(Code *code) { return is_register_code(code); }
+
+int is_addrof(Code *code)
+{
+    return code != NULL &&
+           (code->kind == CD_ADDR_OF || code->kind == CD_ADDR_OF_LABEL);
+}
+
+int is_imm8(int ival) { return -128 <= ival && ival <= 127; }
+
+int is_reg_ext(Code *code)
+{
+    if (!is_reg(code)) return 0;
+    int reg = reg_of_nbyte(8, code->kind);
+    return REG_R8 <= reg && reg <= REG_R15;
+}
+
+// spl, bpl, sil and dil can be accessed only with a REX prefix.
+int needs_rex(Code *code)
+{
+    if (code == NULL) return 0;
+    switch (code->kind) {
+        case REG_SPL:
+        case REG_BPL:
+        case REG_SIL:
+        case REG_DIL:
+            return 1;
+    }
+    return 0;
+}
+
+int operand_class(Code *code)
+{
+    if (code == NULL) return OPR_NONE;
+    if (code->kind == CD_VALUE) {
+        int cls = OPR_IMM32;
+        if (is_imm8(code->ival)) cls |= OPR_IMM8;
+        if (code->ival >= 0) cls |= OPR_UIMM32;
+        if (code->ival == 1) cls |= OPR_ONE;
+        return cls;
+    }
+    if (is_addrof(code)) return OPR_MEM;
+    if (!is_reg(code)) return 0;
+    if (code->kind == REG_CL) return OPR_R8 | OPR_CL;
+    // al, eax and rax have short forms which take an immediate.
+    if (code->kind == REG_AL) return OPR_R8 | OPR_AL;
+    if (code->kind == REG_EAX) return OPR_R32 | OPR_EAX;
+    if (code->kind == REG_RAX) return OPR_R64 | OPR_RAX;
+    if (code->kind & REG_8) return OPR_R8;
+    if (code->kind & REG_16) return OPR_R16;
+    if (code->kind & REG_32) return OPR_R32;
+    return OPR_R64;
+}
+
+int reg_field(Code *code)
+{
+    assert(is_reg(code));
+
+    int reg = reg_of_nbyte(8, code->kind);
+    switch (reg) {
+        case REG_RAX:
+            return 0;
+        case REG_RCX:
+            return 1;
+        case REG_RDX:
+            return 2;
+        case REG_RBX:
+            return 3;
+        case REG_RSP:
+            return 4;
+        case REG_RBP:
+        case REG_RIP:
+            return 5;
+        case REG_RSI:
+            return 6;
+        case REG_RDI:
+            return 7;
+        case REG_R8:
+        case REG_R9:
+        case REG_R10:
+        case REG_R11:
+        case REG_R12:
+        case REG_R13:
+        case REG_R14:
+        case REG_R15:
+            return reg - REG_R8;
+    }
+
+    assert(0);
+}
+
+int modrm(int mod, int reg, int rm)
+{
+    return ((mod & 3) << 6) | ((reg & 7) << 3) | (rm & 7);
+}
+
+int sib(int scale, int index, int base)
+{
+    int ss = 0;
+    switch (scale) {
+        case 1:
+            ss = 0;
+            break;
+        case 2:
+            ss = 1;
+            break;
+        case 4:
+            ss = 2;
+            break;
+        case 8:
+            ss = 3;
+            break;
+        default:
+            assert(0);
+    }
+    return (ss << 6) | ((index & 7) << 3) | (base & 7);
+}
+
+int rex_prefix(int w, int r, int x, int b)
+{
+    // assume that w, r, x, b are either 0 or 1.
+    return 0x40 | (w << 3) | (r << 2) | (x << 1) | b;
+}
+
+// emit ModRM, SIB and displacement for the memory operand mem.
+// imm_size is the size of the immediate which follows them.
+void emit_addrof(int reg, Code *mem, int imm_size)
+{
+    assert(is_addrof(mem));
+
+    switch (mem->kind) {
+        case CD_ADDR_OF: {
+            int base = reg_field(mem->lhs), disp = mem->ival, mod = 2;
+            // rbp and r13 (rm = 5) as base always need a displacement.
+            if (disp == 0 && base != 5)
+                mod = 0;
+            else if (is_imm8(disp))
+                mod = 1;
+
+            if (mem->rhs != NULL) {
+                // rsp can't be an index.
+                assert(reg_of_nbyte(8, mem->rhs->kind) != REG_RSP);
+                emit_byte(modrm(mod, reg, 4));
+                emit_byte(sib(mem->scale, reg_field(mem->rhs), base));
+            }
+            else {
+                emit_byte(modrm(mod, reg, base));
+                // rsp and r12 (rm = 4) as base need SIB byte without index.
+                if (base == 4) emit_byte(sib(1, 4, 4));
+            }
+
+            if (mod == 1) emit_byte(disp);
+            if (mod == 2) emit_dword_int(disp);
+        } break;
+
+        case CD_ADDR_OF_LABEL:
+            emit_byte(modrm(0, reg, reg_field(mem->lhs)));
+            emit_label_disp32(mem->label, imm_size);
+            break;
+    }
+}
+
+Encoding *lookup_encoding(int kind, int lhs, int rhs)
+{
+    if (encoding_table == NULL) init_encoding_table();
+    if (kind < INST_ || CD_VALUE <= kind) return NULL;
+
+    Vector *encs = vector_get(encoding_table, kind - INST_);
+    for (int i = 0; i < vector_size(encs); i++) {
+        Encoding *enc = (Encoding *)vector_get(encs, i);
+        if ((enc->lhs & lhs) && (enc->rhs & rhs)) return enc;
+    }
+    return NULL;
+}
+
+void emit_encoding(Encoding *enc, Code *code)
+{
+    Code *reg = NULL, *rm = NULL;
+    switch (enc->form) {
+        case ENC_MR:
+            reg = code->lhs;
+            rm = code->rhs;
+            break;
+        case ENC_RM:
+            reg = code->rhs;
+            rm = code->lhs;
+            break;
+        case ENC_M_LHS:
+        case ENC_O_LHS:
+            rm = code->lhs;
+            break;
+        case ENC_M_RHS:
+        case ENC_O_RHS:
+            rm = code->rhs;
+            break;
+        case ENC_RM_RHS:
+            reg = rm = code->rhs;
+            break;
+    }
+
+    // REX prefix
+    int rex = rex_prefix(enc->rex_w, is_reg_ext(reg), 0, 0);
+    if (is_addrof(rm))
+        rex |= rex_prefix(0, 0, is_reg_ext(rm->rhs), is_reg_ext(rm->lhs));
+    else
+        rex |= rex_prefix(0, 0, 0, is_reg_ext(rm));
+    if (rex != 0x40 || needs_rex(reg) || needs_rex(rm)) emit_byte(rex);
+
+    // opcode
+    int opcode = enc->opcode;
+    if (enc->form == ENC_O_LHS || enc->form == ENC_O_RHS)
+        opcode += reg_field(rm);
+    if (opcode > 0xffff) emit_byte((opcode >> 16) & 0xff);
+    if (opcode > 0xff) emit_byte((opcode >> 8) & 0xff);
+    emit_byte(opcode & 0xff);
+
+    // ModRM, SIB and displacement
+    if (enc->form != ENC_NONE && enc->form != ENC_O_LHS &&
+        enc->form != ENC_O_RHS) {
+        int regfield = reg != NULL ? reg_field(reg) : enc->ext;
+        if (is_addrof(rm))
+            emit_addrof(regfield, rm, enc->imm_size);
+        else
+            emit_byte(modrm(3, regfield, reg_field(rm)));
+    }
+
+    // immediate. A branch target is left zero as a placeholder.
+    int ival = 0;
+    if (code->lhs != NULL && code->lhs->kind == CD_VALUE)
+        ival = code->lhs->ival;
+    switch (enc->imm_size) {
+        case 1:
+            emit_byte(ival);
+            break;
+        case 4:
+            emit_dword_int(ival);
+            break;
+    }
+}
+
+// encode code and return 1, or return 0 if no encoding matches it.
+int encode_code(Code *code)
+{
+    Encoding *enc = lookup_encoding(code->kind, operand_class(code->lhs),
+                                    operand_class(code->rhs));
+    if (enc == NULL) return 0;
+    emit_encoding(enc, code);
+    return 1;
+}
+
+// encode jmp, jcc or call to a label with a zero displacement, which is
+// rel32 if is_long is set or rel8 is unavailable, otherwise rel8.
+// Return the size of the displacement.
+int encode_branch(Code *code, int is_long)
+{
+    Encoding *enc = NULL;
+    if (!is_long) enc = lookup_encoding(code->kind, OPR_REL8, OPR_NONE);
+    if (enc == NULL) enc = lookup_encoding(code->kind, OPR_REL32, OPR_NONE);
+    assert(enc != NULL);
+    emit_encoding(enc, code);
+    return enc->imm_size;
+}
@@ -196,26 +196,57 @@ int read_asm_ival()
     return read_next_int() * mul;
 }
 
-char *read_asm_token()
+// the token read by scan_asm_token(), which is overwritten by the next call.
+char token_buffer[1024];
+
+// read a token into token_buffer without allocation.
+char *scan_asm_token()
 {
-    StringBuilder *sb = new_string_builder();
-    string_builder_append(sb, sgetch());
+    int len = 0;
+    token_buffer[len++] = sgetch();
     while (1) {
         int ch = peekch();
         if (!isalnum(ch) && ch != '_' && ch != '.' && ch != ':') break;
-        string_builder_append(sb, getch());
+        if (len == sizeof(token_buffer) - 1)
+            error("%s:%d:%d: too long token", source.filepath, source.line,
+                  source.column);
+        token_buffer[len++] = getch();
     }
-    char *str = string_builder_get(sb);
+    token_buffer[len] = '\0';
 
-    return str;
+    return token_buffer;
 }
 
+char *read_asm_token() { return new_str(scan_asm_token()); }
+
 Code *read_asm_memory()
 {
     sexpect_ch('(');
-    char *reg = read_asm_token();
+    Code *reg = str2reg(scan_asm_token());
+    sexpect_ch(')');
+    return reg;
+}
+
+// offset(base) or offset(base, index, scale)
+Code *read_asm_addrof(int offset)
+{
+    sexpect_ch('(');
+    Code *base = str2reg(scan_asm_token());
+    if (speekch() == ')') {
+        getch();
+        return new_addrof_code(base, offset);
+    }
+
+    sexpect_ch(',');
+    Code *index = str2reg(scan_asm_token());
+    int scale = 1;
+    if (speekch() == ',') {
+        getch();
+        skip_space();
+        scale = read_next_int();
+    }
     sexpect_ch(')');
-    return str2reg(reg);
+    return new_addrof_index_code(base, index, scale, offset);
 }
 
 Code *read_asm_param()
@@ -223,7 +254,7 @@ Code *read_asm_param()
     char ch = speekch();
     switch (ch) {
         case '%':
-            return str2reg(read_asm_token());
+            return str2reg(scan_asm_token());
 
         case '$': {
             getch();  // already skipped space
@@ -231,20 +262,147 @@ Code *read_asm_param()
         }
 
         case '(':
-            return new_addrof_code(read_asm_memory(), 0);
+            return read_asm_addrof(0);
     }
 
     if (isdigit(ch) || ch == '-') {
         int offset = read_asm_ival();
-        return new_addrof_code(read_asm_memory(), offset);
+        return read_asm_addrof(offset);
     }
 
     char *label = read_asm_token();
     return new_addrof_label_code(read_asm_memory(), label);
 }
 
+// syntax of the operands which follow a mnemonic or a directive.
+enum {
+    SYN_BINOP,   // one or two operands e.g. add $1, %eax
+    SYN_UNARY,   // one operand e.g. push %rax
+    SYN_SIMPLE,  // no operand e.g. ret
+    SYN_LABEL,   // label e.g. jmp .L1
+    SYN_IVAL,    // integer e.g. .zero 8
+    SYN_ASCII,   // string literal e.g. .ascii "foo"
+    SYN_FILE,    // file number and name e.g. .file 1 "foo.c"
+    SYN_LOC,     // file number and line e.g. .loc 1 10
+};
+
+typedef struct {
+    int kind, syntax;
+} Mnemonic;
+
+// map<char *, Mnemonic *> built once by init_mnemonic_table().
+Map *mnemonic_table = NULL;
+
+void add_mnemonic(char *name, int kind, int syntax)
+{
+    Mnemonic *mnemonic = (Mnemonic *)safe_malloc(sizeof(Mnemonic));
+    mnemonic->kind = kind;
+    mnemonic->syntax = syntax;
+    map_insert(mnemonic_table, name, mnemonic);
+}
+
+void init_mnemonic_table()
+{
+    mnemonic_table = new_map();
+
+    add_mnemonic("mov", INST_MOV, SYN_BINOP);
+    add_mnemonic("movl", INST_MOVL, SYN_BINOP);
+    add_mnemonic("movsbl", INST_MOVSBL, SYN_BINOP);
+    add_mnemonic("movslq", INST_MOVSLQ, SYN_BINOP);
+    add_mnemonic("movzb", INST_MOVZB, SYN_BINOP);
+    add_mnemonic("movzbl", INST_MOVZB, SYN_BINOP);
+    add_mnemonic("movzbq", INST_MOVZB, SYN_BINOP);
+    add_mnemonic("movzwl", INST_MOVZW, SYN_BINOP);
+    add_mnemonic("movzwq", INST_MOVZW, SYN_BINOP);
+    add_mnemonic("movsbq", INST_MOVSBQ, SYN_BINOP);
+    add_mnemonic("movswl", INST_MOVSW, SYN_BINOP);
+    add_mnemonic("movswq", INST_MOVSW, SYN_BINOP);
+    add_mnemonic("lea", INST_LEA, SYN_BINOP);
+    add_mnemonic("add", INST_ADD, SYN_BINOP);
+    add_mnemonic("addq", INST_ADDQ, SYN_BINOP);
+    add_mnemonic("sub", INST_SUB, SYN_BINOP);
+    add_mnemonic("adc", INST_ADC, SYN_BINOP);
+    add_mnemonic("sbb", INST_SBB, SYN_BINOP);
+    add_mnemonic("imul", INST_IMUL, SYN_BINOP);
+    add_mnemonic("sar", INST_SAR, SYN_BINOP);
+    add_mnemonic("sal", INST_SAL, SYN_BINOP);
+    add_mnemonic("shl", INST_SAL, SYN_BINOP);
+    add_mnemonic("shr", INST_SHR, SYN_BINOP);
+    add_mnemonic("cmp", INST_CMP, SYN_BINOP);
+    add_mnemonic("test", INST_TEST, SYN_BINOP);
+    add_mnemonic("cmove", INST_CMOVE, SYN_BINOP);
+    add_mnemonic("cmovne", INST_CMOVNE, SYN_BINOP);
+    add_mnemonic("cmovl", INST_CMOVL, SYN_BINOP);
+    add_mnemonic("cmovle", INST_CMOVLE, SYN_BINOP);
+    add_mnemonic("cmovg", INST_CMOVG, SYN_BINOP);
+    add_mnemonic("cmovge", INST_CMOVGE, SYN_BINOP);
+    add_mnemonic("cmovb", INST_CMOVB, SYN_BINOP);
+    add_mnemonic("cmovbe", INST_CMOVBE, SYN_BINOP);
+    add_mnemonic("cmova", INST_CMOVA, SYN_BINOP);
+    add_mnemonic("cmovae", INST_CMOVAE, SYN_BINOP);
+    add_mnemonic("and", INST_AND, SYN_BINOP);
+    add_mnemonic("xor", INST_XOR, SYN_BINOP);
+    add_mnemonic("or", INST_OR, SYN_BINOP);
+
+    add_mnemonic("push", INST_PUSH, SYN_UNARY);
+    add_mnemonic("pop", INST_POP, SYN_UNARY);
+    add_mnemonic("mul", INST_MUL, SYN_UNARY);
+    add_mnemonic("div", INST_DIV, SYN_UNARY);
+    add_mnemonic("idiv", INST_IDIV, SYN_UNARY);
+    add_mnemonic("neg", INST_NEG, SYN_UNARY);
+    add_mnemonic("not", INST_NOT, SYN_UNARY);
+    add_mnemonic("setl", INST_SETL, SYN_UNARY);
+    add_mnemonic("setle", INST_SETLE, SYN_UNARY);
+    add_mnemonic("sete", INST_SETE, SYN_UNARY);
+    add_mnemonic("setne", INST_SETNE, SYN_UNARY);
+    add_mnemonic("setg", INST_SETG, SYN_UNARY);
+    add_mnemonic("setge", INST_SETGE, SYN_UNARY);
+    add_mnemonic("setb", INST_SETB, SYN_UNARY);
+    add_mnemonic("setbe", INST_SETBE, SYN_UNARY);
+    add_mnemonic("seta", INST_SETA, SYN_UNARY);
+    add_mnemonic("setae", INST_SETAE, SYN_UNARY);
+    add_mnemonic("inc", INST_INC, SYN_UNARY);
+    add_mnemonic("dec", INST_DEC, SYN_UNARY);
+    add_mnemonic("incl", INST_INCL, SYN_UNARY);
+    add_mnemonic("incq", INST_INCQ, SYN_UNARY);
+    add_mnemonic("decl", INST_DECL, SYN_UNARY);
+    add_mnemonic("decq", INST_DECQ, SYN_UNARY);
+
+    add_mnemonic("ret", INST_RET, SYN_SIMPLE);
+    add_mnemonic("nop", INST_NOP, SYN_SIMPLE);
+    add_mnemonic("syscall", INST_SYSCALL, SYN_SIMPLE);
+    add_mnemonic("cltd", INST_CLTD, SYN_SIMPLE);
+    add_mnemonic("cltq", INST_CLTQ, SYN_SIMPLE);
+    add_mnemonic(".text", CD_TEXT, SYN_SIMPLE);
+    add_mnemonic(".data", CD_DATA, SYN_SIMPLE);
+
+    add_mnemonic("call", INST_CALL, SYN_LABEL);
+    add_mnemonic("jmp", INST_JMP, SYN_LABEL);
+    add_mnemonic("je", INST_JE, SYN_LABEL);
+    add_mnemonic("jne", INST_JNE, SYN_LABEL);
+    add_mnemonic("jae", INST_JAE, SYN_LABEL);
+    add_mnemonic("jge", INST_JGE, SYN_LABEL);
+    add_mnemonic("jb", INST_JB, SYN_LABEL);
+    add_mnemonic("jl", INST_JL, SYN_LABEL);
+    add_mnemonic("jle", INST_JLE, SYN_LABEL);
+    add_mnemonic("jg", INST_JG, SYN_LABEL);
+    add_mnemonic("jbe", INST_JBE, SYN_LABEL);
+    add_mnemonic("ja", INST_JA, SYN_LABEL);
+    add_mnemonic(".global", CD_GLOBAL, SYN_LABEL);
+
+    add_mnemonic(".zero", CD_ZERO, SYN_IVAL);
+    add_mnemonic(".long", CD_LONG, SYN_IVAL);
+    add_mnemonic(".byte", CD_BYTE, SYN_IVAL);
+    add_mnemonic(".quad", CD_QUAD, SYN_IVAL);
+
+    add_mnemonic(".ascii", CD_ASCII, SYN_ASCII);
+    add_mnemonic(".file", CD_FILE, SYN_FILE);
+    add_mnemonic(".loc", CD_LOC, SYN_LOC);
+}
+
 Vector *read_all_asm(char *src, char *filepath)
 {
+    if (mnemonic_table == NULL) init_mnemonic_table();
     init_source(src, filepath);
 
     Vector *code = new_vector();
@@ -266,119 +424,96 @@ Vector *read_all_asm(char *src, char *filepath)
                 ungetch();
         }
 
-        char *str = read_asm_token();
+        char *str = scan_asm_token();
         int len = strlen(str);
 
         if (str[len - 1] == ':') {  // label
             str[len - 1] = '\0';
-            vector_push_back(code, LABEL(str));
+            vector_push_back(code, LABEL(new_str(str)));
             continue;
         }
 
-        if (strcmp(str, ".ascii") == 0) {
-            sexpect_ch('"');
-            char *sval;
-            int ssize;
-            read_next_string_literal(&sval, &ssize);
-
-            Code *c = new_code(CD_ASCII);
-            c->sval = sval;
-            c->ival = ssize - 1;
-            vector_push_back(code, c);
-            continue;
-        }
-
-        KeyValue *kv;
-
-        Map *binop_table = new_map();
-        map_insert(binop_table, "mov", (void *)INST_MOV);
-        map_insert(binop_table, "movl", (void *)INST_MOVL);
-        map_insert(binop_table, "movsbl", (void *)INST_MOVSBL);
-        map_insert(binop_table, "movslq", (void *)INST_MOVSLQ);
-        map_insert(binop_table, "movzb", (void *)INST_MOVZB);
-        map_insert(binop_table, "lea", (void *)INST_LEA);
-        map_insert(binop_table, "add", (void *)INST_ADD);
-        map_insert(binop_table, "add", (void *)INST_ADD);
-        map_insert(binop_table, "addq", (void *)INST_ADDQ);
-        map_insert(binop_table, "sub", (void *)INST_SUB);
-        map_insert(binop_table, "imul", (void *)INST_IMUL);
-        map_insert(binop_table, "sar", (void *)INST_SAR);
-        map_insert(binop_table, "sal", (void *)INST_SAL);
-        map_insert(binop_table, "cmp", (void *)INST_CMP);
-        map_insert(binop_table, "and", (void *)INST_AND);
-        map_insert(binop_table, "xor", (void *)INST_XOR);
-        map_insert(binop_table, "or", (void *)INST_OR);
-        if (kv = map_lookup(binop_table, str)) {
-            Code *lhs = read_asm_param();
-            sexpect_ch(',');
-            Code *rhs = read_asm_param();
-            vector_push_back(code, new_binop_code((int)kv_value(kv), lhs, rhs));
-            continue;
-        }
-
-        Map *unary_table = new_map();
-        map_insert(unary_table, "push", (void *)INST_PUSH);
-        map_insert(unary_table, "pop", (void *)INST_POP);
-        map_insert(unary_table, "idiv", (void *)INST_IDIV);
-        map_insert(unary_table, "neg", (void *)INST_NEG);
-        map_insert(unary_table, "not", (void *)INST_NOT);
-        map_insert(unary_table, "setl", (void *)INST_SETL);
-        map_insert(unary_table, "setle", (void *)INST_SETLE);
-        map_insert(unary_table, "sete", (void *)INST_SETE);
-        map_insert(unary_table, "incl", (void *)INST_INCL);
-        map_insert(unary_table, "incq", (void *)INST_INCQ);
-        map_insert(unary_table, "decl", (void *)INST_DECL);
-        map_insert(unary_table, "decq", (void *)INST_DECQ);
-        if (kv = map_lookup(unary_table, str)) {
-            Code *lhs = read_asm_param();
-            vector_push_back(code, new_unary_code((int)kv_value(kv), lhs));
-            continue;
-        }
-
-        Map *simple_table = new_map();
-        map_insert(simple_table, "ret", (void *)INST_RET);
-        map_insert(simple_table, "nop", (void *)INST_NOP);
-        map_insert(simple_table, "syscall", (void *)INST_SYSCALL);
-        map_insert(simple_table, "cltd", (void *)INST_CLTD);
-        map_insert(simple_table, "cltq", (void *)INST_CLTQ);
-        map_insert(simple_table, ".text", (void *)CD_TEXT);
-        map_insert(simple_table, ".data", (void *)CD_DATA);
-        if (kv = map_lookup(simple_table, str)) {
-            vector_push_back(code, new_code((int)kv_value(kv)));
-            continue;
-        }
-
-        Map *label_table = new_map();
-        map_insert(label_table, "call", (void *)INST_CALL);
-        map_insert(label_table, "jmp", (void *)INST_JMP);
-        map_insert(label_table, "je", (void *)INST_JE);
-        map_insert(label_table, "jne", (void *)INST_JNE);
-        map_insert(label_table, "jae", (void *)INST_JAE);
-        map_insert(label_table, ".global", (void *)CD_GLOBAL);
-        if (kv = map_lookup(label_table, str)) {
-            char *label = read_asm_token();
-            Code *c = new_code((int)kv_value(kv));
-            c->label = label;
-            vector_push_back(code, c);
-            continue;
-        }
+        KeyValue *kv = map_lookup(mnemonic_table, str);
+        if (kv == NULL)
+            error("%s:%d:%d: not implemented assembly: %s", source.filepath,
+                  source.line, source.column, str);
+        Mnemonic *mnemonic = (Mnemonic *)kv_value(kv);
+
+        switch (mnemonic->syntax) {
+            case SYN_BINOP: {
+                Code *lhs = read_asm_param();
+                // one-operand form e.g. imul %ecx
+                if (speekch() != ',') {
+                    vector_push_back(code,
+                                     new_unary_code(mnemonic->kind, lhs));
+                    break;
+                }
+                sexpect_ch(',');
+                Code *rhs = read_asm_param();
+                vector_push_back(code,
+                                 new_binop_code(mnemonic->kind, lhs, rhs));
+            } break;
+
+            case SYN_UNARY: {
+                Code *lhs = read_asm_param();
+                vector_push_back(code, new_unary_code(mnemonic->kind, lhs));
+            } break;
+
+            case SYN_SIMPLE:
+                vector_push_back(code, new_code(mnemonic->kind));
+                break;
 
-        Map *ival_table = new_map();
-        map_insert(ival_table, ".zero", (void *)CD_ZERO);
-        map_insert(ival_table, ".long", (void *)CD_LONG);
-        map_insert(ival_table, ".byte", (void *)CD_BYTE);
-        map_insert(ival_table, ".quad", (void *)CD_QUAD);
-        if (kv = map_lookup(ival_table, str)) {
-            skip_space();
-            int ival = read_asm_ival();
-            Code *c = new_code((int)kv_value(kv));
-            c->ival = ival;
-            vector_push_back(code, c);
-            continue;
+            case SYN_LABEL: {
+                Code *c = new_code(mnemonic->kind);
+                if (speekch() == '*') {
+                    // indirect jump or call e.g. jmp *(%r11,%rax,8)
+                    getch();
+                    c->lhs = read_asm_param();
+                }
+                else
+                    c->label = read_asm_token();
+                vector_push_back(code, c);
+            } break;
+
+            case SYN_IVAL: {
+                Code *c = new_code(mnemonic->kind);
+                skip_space();
+                if (mnemonic->kind == CD_QUAD && !isdigit(peekch()) &&
+                    peekch() != '-')
+                    // .quad label
+                    c->label = read_asm_token();
+                else
+                    c->ival = read_asm_ival();
+                vector_push_back(code, c);
+            } break;
+
+            case SYN_ASCII: {
+                sexpect_ch('"');
+                char *sval;
+                int ssize;
+                read_next_string_literal(&sval, &ssize);
+
+                Code *c = new_code(CD_ASCII);
+                c->sval = sval;
+                c->ival = ssize - 1;
+                vector_push_back(code, c);
+            } break;
+
+            case SYN_FILE: {
+                Code *c = new_code(CD_FILE);
+                c->ival = read_asm_ival();
+                sexpect_ch('"');
+                int ssize;
+                read_next_string_literal(&c->sval, &ssize);
+                vector_push_back(code, c);
+            } break;
+
+            case SYN_LOC: {
+                Code *file = new_value_code(read_asm_ival());
+                Code *line = new_value_code(read_asm_ival());
+                vector_push_back(code, new_binop_code(CD_LOC, file, line));
+            } break;
         }
-
-        error("%s:%d:%d: not implemented assembly: %s", source.filepath,
-              source.line, source.column, str);
     }
 
     return code;
@@ -14,7 +14,7 @@ int main(int argc, char **argv)
     char *infile = argv[1], *outfile = argv[2];
 
     Vector *code = read_asm_from_filepath(infile);
-    ObjectImage *obj = assemble_code(code);
+    ObjectImage *obj = assemble_code(code, 0);
 
     FILE *fh = fopen(outfile, "wb");
     dump_object_image(obj, fh);
@@ -3,16 +3,41 @@
 struct KeyValue {
     const char *key;
     void *value;
+    int hash;
 };
 
+// Hash map with separate chaining. If a key is inserted twice, lookup finds
+// the first one.
 struct Map {
-    Vector *data;
+    Vector *data;     // vector<KeyValue *> in insertion order
+    Vector *buckets;  // vector<vector<KeyValue *>>
 };
 
+int hash_string(const char *str)
+{
+    int hash = 5381;
+    for (int i = 0; str[i] != '\0'; i++) hash = hash * 33 + str[i];
+    return hash;
+}
+
+Vector *new_buckets(int size)
+{
+    Vector *buckets = new_vector();
+    for (int i = 0; i < size; i++) vector_push_back(buckets, new_vector());
+    return buckets;
+}
+
+Vector *map_bucket(Map *map, int hash)
+{
+    // the number of buckets is a power of 2.
+    return vector_get(map->buckets, hash & (vector_size(map->buckets) - 1));
+}
+
 Map *new_map()
 {
     Map *map = safe_malloc(sizeof(Map));
     map->data = new_vector();
+    map->buckets = new_buckets(16);
     return map;
 }
 
@@ -23,17 +48,31 @@ KeyValue *map_insert(Map *map, const char *key, void *item)
     KeyValue *kv = safe_malloc(sizeof(KeyValue));
     kv->key = key;
     kv->value = item;
+    kv->hash = hash_string(key);
     vector_push_back(map->data, kv);
+
+    if (vector_size(map->data) <= 2 * vector_size(map->buckets)) {
+        vector_push_back(map_bucket(map, kv->hash), kv);
+        return kv;
+    }
+
+    // rehash in insertion order to keep the first one found first.
+    map->buckets = new_buckets(vector_size(map->buckets) * 4);
+    for (int i = 0; i < vector_size(map->data); i++) {
+        KeyValue *ent = (KeyValue *)vector_get(map->data, i);
+        vector_push_back(map_bucket(map, ent->hash), ent);
+    }
     return kv;
 }
 
 KeyValue *map_lookup(Map *map, const char *key)
 {
-    int i;
+    int hash = hash_string(key);
+    Vector *bucket = map_bucket(map, hash);
 
-    for (i = 0; i < vector_size(map->data); i++) {
-        KeyValue *kv = (KeyValue *)vector_get(map->data, i);
-        if (strcmp(kv->key, key) == 0) return kv;
+    for (int i = 0; i < vector_size(bucket); i++) {
+        KeyValue *kv = (KeyValue *)vector_get(bucket, i);
+        if (kv->hash == hash && strcmp(kv->key, key) == 0) return kv;
     }
 
     return NULL;
@@ -84,13 +84,15 @@ int vsprintf(char *str, const char *format, va_list ap)
                     break;
                 }
 
+                // keep ival negative so that INT_MIN can be printed.
+                int sign = 1;
                 if (ival < 0) {
                     *str++ = '-';
-                    ival *= -1;
+                    sign = -1;
                 }
 
                 int i = 0, buf[256];  // TODO: enough length?
-                for (; ival != 0; ival /= 10) buf[i++] = ival % 10;
+                for (; ival != 0; ival /= 10) buf[i++] = ival % 10 * sign;
                 while (--i >= 0) *str++ = '0' + buf[i];
             } break;
 
@@ -101,7 +101,7 @@ char *escape_string(char *str, int size)
 
             case '\r':
                 string_builder_append(sb, '\\');
-                string_builder_append(sb, 'n');
+                string_builder_append(sb, 'r');
                 break;
 
             case '\t':
@@ -139,6 +139,11 @@ char *escape_string(char *str, int size)
                 string_builder_append(sb, '"');
                 break;
 
+            case '\\':
+                string_builder_append(sb, '\\');
+                string_builder_append(sb, '\\');
+                break;
+
             default:
                 string_builder_append(sb, ch);
                 break;
@@ -195,9 +200,13 @@ Code *nbyte_reg(int nbyte, int reg)
     return new_code(reg_of_nbyte(nbyte, reg));
 }
 
-Code *str2reg(char *src)
+// map<char *, Code *> built once by init_register_table(). The register codes
+// are shared by all operands since they are never modified.
+Map *register_table = NULL;
+
+void init_register_table()
 {
-    Map *map = new_map();
+    Map *map = register_table = new_map();
 
     map_insert(map, "%al", nbyte_reg(1, 0));
     map_insert(map, "%dil", nbyte_reg(1, 1));
@@ -258,8 +267,13 @@ Code *str2reg(char *src)
     map_insert(map, "%rip", RIP());
     map_insert(map, "%rbp", RBP());
     map_insert(map, "%rsp", RSP());
+    map_insert(map, "%rbx", new_code(REG_RBX));
+}
 
-    KeyValue *kv = map_lookup(map, src);
-    assert(kv != NULL);
+Code *str2reg(char *src)
+{
+    if (register_table == NULL) init_register_table();
+    KeyValue *kv = map_lookup(register_table, src);
+    if (kv == NULL) error("unknown register: %s", src);
     return kv_value(kv);
 }
@@ -1,17 +1,14 @@
 #include "cc.h"
 
-Vector *gvar_list = NULL;
-int gvar_string_literal_label = 0;
-
-void init_gvar_list() { gvar_list = new_vector(); }
+void init_gvar_list() { ctx->gvar_list = new_vector(); }
 
 GVar *add_gvar(GVar *gvar)
 {
-    vector_push_back(gvar_list, gvar);
+    vector_push_back(ctx->gvar_list, gvar);
     return gvar;
 }
 
-Vector *get_gvar_list() { return gvar_list; }
+Vector *get_gvar_list() { return ctx->gvar_list; }
 
 GVar *new_gvar_from_decl(AST *ast)
 {
@@ -30,7 +27,7 @@ GVar *new_gvar_from_string_literal(AST *ast)
     assert(ast->kind == AST_STRING_LITERAL);
 
     GVar *gvar = (GVar *)safe_malloc(sizeof(GVar));
-    gvar->name = format(".LC%d", gvar_string_literal_label++);
+    gvar->name = format(".LC%d", ctx->gvar_string_literal_label++);
     gvar->type = new_array_type(type_char(), ast->ssize);
     gvar->is_global = 0;
     gvar->value = ast;
@@ -52,29 +49,26 @@ GVar *new_gvar_from_static_lvar(AST *lvar)
     return gvar;
 }
 
-Vector *switch_cases = NULL;
-char *default_label = NULL;
-
-#define SAVE_SWITCH_CXT                                   \
-    Vector *switch_cxt__prev_swtich_cases = switch_cases; \
-    char *switch_cxt__default_label = default_label;      \
-    switch_cases = new_vector();
+#define SAVE_SWITCH_CXT                                        \
+    Vector *switch_cxt__prev_swtich_cases = ctx->switch_cases; \
+    char *switch_cxt__default_label = ctx->default_label;      \
+    ctx->switch_cases = new_vector();
 
-#define RESTORE_SWITCH_CXT                        \
-    switch_cases = switch_cxt__prev_swtich_cases; \
-    default_label = switch_cxt__default_label;
+#define RESTORE_SWITCH_CXT                             \
+    ctx->switch_cases = switch_cxt__prev_swtich_cases; \
+    ctx->default_label = switch_cxt__default_label;
 
-Vector *get_switch_cases() { return switch_cases; }
+Vector *get_switch_cases() { return ctx->switch_cases; }
 
-char *get_default_label() { return default_label; }
+char *get_default_label() { return ctx->default_label; }
 
 Vector *reset_switch_cases(Vector *cases)
 {
-    Vector *prev = switch_cases;
+    Vector *prev = ctx->switch_cases;
     if (cases)
-        switch_cases = cases;
+        ctx->switch_cases = cases;
     else
-        switch_cases = new_vector();
+        ctx->switch_cases = new_vector();
     return prev;
 }
 
@@ -87,61 +81,56 @@ AST *add_switch_case(AST *case_ast)
     cas->cond = case_ast->lhs;
     assert(cas->cond->kind == AST_CONSTANT);
     cas->label_name = label->label_name;
-    vector_push_back(switch_cases, cas);
+    vector_push_back(ctx->switch_cases, cas);
 
     return label;
 }
 
 AST *add_switch_default(AST *default_ast)
 {
-    if (default_label) error("duplicate default label for switch");
+    if (ctx->default_label) error("duplicate default label for switch");
     AST *label = new_label_ast(make_label_string(), default_ast->lhs);
-    default_label = label->label_name;
+    ctx->default_label = label->label_name;
     return label;
 }
 
-Vector *va_start_params;
-
-void set_va_start_params(Vector *params) { va_start_params = params; }
+void set_va_start_params(Vector *params) { ctx->va_start_params = params; }
 
 int get_index_in_va_start_params(char *name)
 {
-    for (int i = 0; i < vector_size(va_start_params); i++) {
-        AST *param = (AST *)vector_get(va_start_params, i);
+    for (int i = 0; i < vector_size(ctx->va_start_params); i++) {
+        AST *param = (AST *)vector_get(ctx->va_start_params, i);
         if (strcmp(param->varname, name) == 0) return i;
     }
 
     return -1;
 }
 
-Vector *goto_asts;
-Map *label_asts;
-
 void init_goto_info()
 {
-    goto_asts = new_vector();
-    label_asts = new_map();
+    ctx->goto_asts = new_vector();
+    ctx->label_asts = new_map();
 }
 
 AST *append_goto_ast(AST *ast)
 {
     assert(ast->kind == AST_GOTO);
-    vector_push_back(goto_asts, ast);
+    vector_push_back(ctx->goto_asts, ast);
     return ast;
 }
 
 AST *append_label_ast(char *label_org_name, AST *ast)
 {
     assert(ast->kind == AST_LABEL);
-    map_insert(label_asts, label_org_name, ast);
+    map_insert(ctx->label_asts, label_org_name, ast);
     return ast;
 }
 
 void replace_goto_label()
 {
-    for (int i = 0; i < vector_size(goto_asts); i++) {
-        AST *ast = (AST *)vector_get(goto_asts, i);
-        KeyValue *kv = map_lookup(label_asts, ast->label_name);
+    for (int i = 0; i < vector_size(ctx->goto_asts); i++) {
+        AST *ast = (AST *)vector_get(ctx->goto_asts, i);
+        KeyValue *kv = map_lookup(ctx->label_asts, ast->label_name);
         if (kv == NULL) error(format("not found such label: '%s'", kv_key(kv)));
         ast->label_name = ((AST *)kv_value(kv))->label_name;
     }
@@ -602,11 +591,10 @@ AST *analyze_ast_detail(Env *env, AST *ast)
                 ast->rhs->rhs = analyze_constant(env, ast->rhs->rhs);
                 assert(ast->rhs->rhs->kind == AST_CONSTANT);
 
-                Vector *gvar_list = get_gvar_list();
                 // get gvar that was pushed by analyze_ast_detail() for ast->lhs
                 // above.
-                GVar *gvar =
-                    (GVar *)vector_get(gvar_list, vector_size(gvar_list) - 1);
+                Vector *gvars = ctx->gvar_list;
+                GVar *gvar = (GVar *)vector_get(gvars, vector_size(gvars) - 1);
                 gvar->value = ast->rhs->rhs;
                 ast->rhs = new_ast(AST_NOP);  // rhs should not be compiled.
             }
@@ -625,11 +613,10 @@ AST *analyze_ast_detail(Env *env, AST *ast)
                 error("extern variable can't have any initializer: '%s'",
                       ast->lhs->varname);
 
-            Vector *gvar_list = get_gvar_list();
             // get gvar that was pushed by analyze_ast_detail() for ast->lhs
             // above.
-            GVar *gvar =
-                (GVar *)vector_get(gvar_list, vector_size(gvar_list) - 1);
+            Vector *gvars = ctx->gvar_list;
+            GVar *gvar = (GVar *)vector_get(gvars, vector_size(gvars) - 1);
             gvar->value = ast->rhs->rhs;
             ast->rhs = new_ast(AST_NOP);  // rhs should not be compiled.
         } break;
@@ -754,7 +741,9 @@ AST *analyze_ast_detail(Env *env, AST *ast)
 
         case AST_WHILE: {
             AST *cond = ast->cond, *body = ast->then;
+            Source *source = ast->source;
             ast = new_ast(AST_FOR);
+            ast->source = source;
             ast->initer = NULL;
             ast->midcond = cond;
             ast->iterer = NULL;
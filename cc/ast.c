@@ -15,6 +15,7 @@ AST *new_ast(int kind)
     AST *ast = safe_malloc(sizeof(AST));
     ast->kind = kind;
     ast->type = NULL;
+    ast->source = NULL;
     return ast;
 }
 
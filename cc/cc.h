@@ -34,6 +34,7 @@ FILE *fopen(const char *pathname, const char *mode);
 int fclose(FILE *stream);
 int fputc(int c, FILE *stream);
 int fgetc(FILE *stream);
+int fwrite(const void *ptr, int size, int nmemb, FILE *stream);
 int fprintf(FILE *stream, const char *format, ...);
 int printf(const char *format, ...);
 int vsprintf(char *str, const char *format, va_list ap);
@@ -48,9 +49,17 @@ int isalpha(int c);
 int isalnum(int c);
 int isdigit(int c);
 int isspace(int c);
+int atoi(const char *str);
 void *memcpy(void *dest, const void *src, int n);
 void *memset(void *s, int c, int n);
+int memcmp(const void *s1, const void *s2, int n);
 void assert(int cond);
+int thread_create(void *arg);
+void futex_wait(int *addr, int val);
+void futex_wake(int *addr);
+int open(const char *path, int oflag, int mode);
+int close(int fd);
+int read(int fd, const void *buf, int count);
 
 // vector.c
 typedef struct Vector Vector;
@@ -343,6 +352,9 @@ enum {
 struct AST {
     int kind;
     Type *type;
+    // where a statement or a function definition starts, for -g. NULL for
+    // the others.
+    Source *source;
 
     union {
         int ival;
@@ -409,6 +421,71 @@ struct AST {
     };
 };
 
+// the maximum depth of nested inlining in optimize.c
+#define INLINE_MAX_DEPTH 4
+
+typedef struct Arena Arena;
+typedef struct CodeEnv CodeEnv;
+
+// All the state of a compilation, so that a process can compile any number
+// of translation units one after another. See context.c.
+typedef struct {
+    Arena *arena;
+    // emit .file and .loc for the debug information, which is kept across
+    // compilations like arena.
+    int debug_info;
+
+    // errors are returned by longjmp instead of exiting if catch_errors.
+    int catch_errors;
+    void *error_jmp[8];
+    char *error_message;
+
+    // lex.c
+    Source source;
+    // token.c
+    TokenSeq *tokenseq;
+    // cpp.c
+    Map *define_table;
+    // parse.c
+    Map *typedef_table;
+    // analyze.c
+    Vector *gvar_list;
+    int gvar_string_literal_label;
+    Vector *switch_cases;
+    char *default_label;
+    Vector *va_start_params;
+    Vector *goto_asts;
+    Map *label_asts;
+    // optimize.c
+    Map *inline_funcs;
+    Vector *clone_from, *clone_to, *clone_subst;
+    char *inline_chain[INLINE_MAX_DEPTH];
+    int inline_depth;
+    AST *inline_caller;
+    // AST_LVAR whose address is taken in the current function. The other
+    // local variables can't be written through pointers.
+    Vector *licm_addr_taken;
+    AST *licm_func;
+    // x86_64_gen.c
+    int temp_reg_table;
+    CodeEnv *codeenv;
+    Map *loc_files;    // map<char *, int>: the numbers of .file
+    Source *last_loc;  // of the last .loc in the current function
+    // utility.c
+    int label_count;
+} Context;
+
+// context.c
+extern Context *ctx;  // the context of the current compilation
+void *arena_alloc(Arena *arena, int size);
+int arena_capacity(Arena *arena);
+Context *aqcc_new_context();
+void begin_compilation(Context *context);
+Vector *preprocess_all_tokens(Vector *tokens);
+Vector *compile_tokens(Vector *tokens);
+char *assemble_code_to_bytes(Vector *code, int *size);
+char *aqcc_compile(Context *context, char *src, int len, int *size);
+
 // utility.c
 _Noreturn void error(const char *msg, ...);
 _Noreturn void error_unexpected_token_kind(int expect_kind, Token *got);
@@ -431,6 +508,8 @@ Vector *read_all_tokens(char *src, char *filepath);
 const char *token_kind2str(int kind);
 Vector *concatenate_string_literal_tokens(Vector *tokens);
 Vector *read_tokens_from_filepath(char *filepath);
+Map *keyword_table();
+char *read_entire_file(char *filepath);
 
 // parse.c
 Vector *parse_prog(Vector *tokens);
@@ -504,16 +583,49 @@ Token *pop_token_if(int kind);
 int match_token2(int kind0, int kind1);
 TokenSeqSaved *new_token_seq_saved();
 void restore_token_seq_saved(TokenSeqSaved *saved);
+void dump_tokens(Vector *tokens, FILE *fh);
 
 #define SAVE_TOKENSEQ \
     TokenSeqSaved *token_seq_saved__dummy = new_token_seq_saved();
 #define RESTORE_TOKENSEQ restore_token_seq_saved(token_seq_saved__dummy);
 
+// optimize.c
+void optimize_asts_inline(Vector *asts);
+void optimize_asts_licm(Vector *asts);
+
 // x86_64_gen.c
 typedef struct Code Code;
 Vector *x86_64_generate_code(Vector *asts);
 void x86_64_optimize_asts_constant(Vector *asts, Env *env);
 Vector *x86_64_optimize_code(Vector *code);
 void dump_code(Code *code, FILE *fh);
+int is_register_code(Code *code);
+int reg_of_nbyte(int nbyte, int reg);
+
+// ../as/assemble.c
+typedef struct ObjectImage ObjectImage;
+// flags of assemble_code() to put each function or data object in its own
+// section, which lets ld remove the unused ones.
+enum { AS_FUNCTION_SECTIONS = 1, AS_DATA_SECTIONS = 2 };
+ObjectImage *assemble_code(Vector *code, int section_flags);
+Vector *emit_object_image(ObjectImage *objimg);
+void dump_object_image(ObjectImage *objimg, FILE *fh);
+
+// ../as/encode.c
+void init_encoding_table();
+
+// ../ld/link.c
+typedef struct ObjectData ObjectData;
+ObjectData *new_object_data(char *data, int data_size);
+int load_objs(Vector *objs, char *entry);
+void read_input_files(Vector *objs, Vector *paths);
+
+// run.c
+int run_code(Vector *code, Vector *objfiles, Vector *args, char **envp);
+
+// system.s
+int call_main(int addr, int argc, char **argv);
+int setjmp(void **env);
+_Noreturn void longjmp(void **env, int val);
 
 #endif
@@ -0,0 +1,169 @@
+#include "cc.h"
+
+// A context holds all the state of a compilation, and everything allocated
+// during the compilation lives in the arena of the context. The arena is
+// emptied when the next compilation in the context starts, so a process can
+// compile any number of translation units without its memory growing.
+
+// the size of an arena block unless larger one is needed.
+#define ARENA_BLOCK_SIZE 0x1000000
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+    ArenaBlock *next;
+    char *data;
+    int size, used;
+};
+
+struct Arena {
+    ArenaBlock *head, *current;
+};
+
+Context *ctx = NULL;
+
+void *syscall(int number, ...);
+
+// arena blocks live across compilations, so they are allocated directly.
+ArenaBlock *new_arena_block(int size)
+{
+    ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock));
+    if (block == NULL) error("malloc failed.");
+    block->data = malloc(size);
+    if (block->data == NULL) error("malloc failed.");
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void *arena_alloc(Arena *arena, int size)
+{
+    size = roundup(size, 8);
+    ArenaBlock *block = arena->current;
+    while (block->size - block->used < size) {
+        if (block->next == NULL)
+            block->next = new_arena_block(max(size, ARENA_BLOCK_SIZE));
+        block = block->next;
+    }
+    arena->current = block;
+
+    char *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+// the total size of the blocks of the arena.
+int arena_capacity(Arena *arena)
+{
+    int size = 0;
+    for (ArenaBlock *block = arena->head; block != NULL; block = block->next)
+        size += block->size;
+    return size;
+}
+
+// free everything in the arena. Only the used part of each block is cleared
+// by memset, since the memory is expected to be zero like fresh memory from
+// malloc and the rest is still untouched.
+void reset_arena(Arena *arena)
+{
+    for (ArenaBlock *block = arena->head; block != NULL; block = block->next) {
+        memset(block->data, 0, block->used);
+        block->used = 0;
+    }
+    arena->current = arena->head;
+}
+
+// the tables built lazily but shared by all compilations.
+void init_shared_tables()
+{
+    Context *cur = ctx;
+    ctx = NULL;  // not in any arena
+    keyword_table();
+    type_int();
+    type_char();
+    type_void();
+    init_encoding_table();
+    ctx = cur;
+}
+
+Context *aqcc_new_context()
+{
+    init_shared_tables();
+
+    Context *context = (Context *)malloc(sizeof(Context));
+    if (context == NULL) error("malloc failed.");
+    memset(context, 0, sizeof(Context));
+    context->arena = (Arena *)malloc(sizeof(Arena));
+    if (context->arena == NULL) error("malloc failed.");
+    context->arena->head = new_arena_block(ARENA_BLOCK_SIZE);
+    context->arena->current = context->arena->head;
+    return context;
+}
+
+// make context current and clear it for a new compilation.
+void begin_compilation(Context *context)
+{
+    Arena *arena = context->arena;
+    int debug_info = context->debug_info;
+    reset_arena(arena);
+    memset(context, 0, sizeof(Context));
+    context->arena = arena;
+    context->debug_info = debug_info;
+    ctx = context;
+}
+
+Vector *preprocess_all_tokens(Vector *tokens)
+{
+    tokens = preprocess_tokens(tokens);
+    return concatenate_string_literal_tokens(tokens);
+}
+
+Vector *compile_tokens(Vector *tokens)
+{
+    Vector *asts = parse_prog(tokens);
+
+    Env *env = analyze_ast(asts);
+    optimize_asts_inline(asts);
+    x86_64_optimize_asts_constant(asts, env);
+    optimize_asts_licm(asts);
+
+    Vector *code = x86_64_generate_code(asts);
+    return x86_64_optimize_code(code);
+}
+
+// the bytes of the ELF relocatable file of code.
+char *assemble_code_to_bytes(Vector *code, int *size)
+{
+    Vector *image = emit_object_image(assemble_code(code, 0));
+    *size = vector_size(image);
+    char *data = safe_malloc(*size);
+    for (int i = 0; i < *size; i++) data[i] = (int)vector_get(image, i);
+    return data;
+}
+
+// Compile the C source src of len bytes into an ELF relocatable file and
+// return its bytes, which are valid until the next compilation in context.
+// On errors, return NULL and leave the message in context->error_message.
+// #include "file" is searched for in the current directory.
+char *aqcc_compile(Context *context, char *src, int len, int *size)
+{
+    // the caller allocates out of the arena after the compilation.
+    Context *caller = ctx;
+    begin_compilation(context);
+    if (setjmp(context->error_jmp) != 0) {
+        ctx = caller;
+        return NULL;
+    }
+    context->catch_errors = 1;
+
+    char *buf = safe_malloc(len + 1);
+    memcpy(buf, src, len);
+    buf[len] = '\0';
+    Vector *tokens = preprocess_all_tokens(read_all_tokens(buf, "<input>"));
+    Vector *code = compile_tokens(tokens);
+    char *data = assemble_code_to_bytes(code, size);
+
+    context->catch_errors = 0;
+    ctx = caller;
+    return data;
+}
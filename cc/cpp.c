@@ -6,21 +6,19 @@ void skip_newline()
         ;
 }
 
-Map *define_table;
-
-void init_preprocess() { define_table = new_map(); }
+void init_preprocess() { ctx->define_table = new_map(); }
 
 Vector *add_define(char *name, Vector *tokens)
 {
-    if (map_lookup(define_table, name))
+    if (map_lookup(ctx->define_table, name))
         error("duplicate define's name: '%s'", name);
-    map_insert(define_table, name, tokens);
+    map_insert(ctx->define_table, name, tokens);
     return tokens;
 }
 
 Vector *lookup_define(char *name)
 {
-    return (Vector *)kv_value(map_lookup(define_table, name));
+    return (Vector *)kv_value(map_lookup(ctx->define_table, name));
 }
 
 void preprocess_skip_until_else_or_endif()
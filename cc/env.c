@@ -38,6 +38,16 @@ AST *add_var(Env *env, AST *ast)
     // Create a local/global variable instance.
     // All AST_VAR that point the same variable will be replaced with
     // the pointer to this AST_LVAR/AST_GVAR instance when analyzing.
+    // A global variable declared extern can be defined later, and then the
+    // instance is shared with the definition.
+    KeyValue *kv = map_lookup(env->symbols, ast->varname);
+    if (ast->kind == AST_GVAR_DECL && kv != NULL) {
+        AST *decl = (AST *)kv_value(kv);
+        if (decl->kind == AST_GVAR && decl->type->is_extern) {
+            decl->type = ast->type;
+            return decl;
+        }
+    }
     AST *var = new_lgvar_ast(ast->kind == AST_LVAR_DECL ? AST_LVAR : AST_GVAR,
                              ast->type, ast->varname, -1);
 
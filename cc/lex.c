@@ -1,41 +1,39 @@
 #include "cc.h"
 
-char *read_entire_file(char *filepath);
+void *syscall(int number, ...);
 void erase_backslash_newline(char *src);
 
-Source source;
-
 void init_source(char *src, char *filepath)
 {
     // caluculate current working directory
     int i, j, len = strlen(filepath);
-    source.cwd = safe_malloc(sizeof(char *) * len);
+    ctx->source.cwd = safe_malloc(sizeof(char *) * len);
     // TODO: ad-hoc
     for (i = len - 1; i >= 0; i--) {
         if (filepath[i] == '/') {
             // detect last '/'
             for (j = 0; j <= i; j++) {
-                source.cwd[j] = filepath[j];
+                ctx->source.cwd[j] = filepath[j];
             }
-            source.cwd[i + 1] = '\0';
+            ctx->source.cwd[i + 1] = '\0';
             break;
         }
     }
-    // When this source code and aqcc are located in the same directory
-    if (source.cwd[0] == '\0') {
-        strcpy(source.cwd, "./");
+    // When this ctx->source code and aqcc are located in the same directory
+    if (ctx->source.cwd[0] == '\0') {
+        strcpy(ctx->source.cwd, "./");
     }
 
-    source.filepath = filepath;
-    source.src = src;
-    source.line = source.column = 1;
-    source.line2length = new_vector();
+    ctx->source.filepath = filepath;
+    ctx->source.src = src;
+    ctx->source.line = ctx->source.column = 1;
+    ctx->source.line2length = new_vector();
 
     // fill file.line2length
-    vector_push_back(source.line2length, NULL);  // line is 1-based index.
+    vector_push_back(ctx->source.line2length, NULL);  // line is 1-based index.
     for (int i = 0, column = 1; src[i] == '\0'; i++, column++) {
         if (src[i] == '\n') {
-            vector_push_back(source.line2length, (void *)column);
+            vector_push_back(ctx->source.line2length, (void *)column);
             column = 0;
         }
     }
@@ -44,23 +42,24 @@ void init_source(char *src, char *filepath)
 Token *make_token(int kind)
 {
     Source *src = (Source *)safe_malloc(sizeof(Source));
-    memcpy(src, &source, sizeof(Source));
+    memcpy(src, &ctx->source, sizeof(Source));
     return new_token(kind, src);
 }
 
 void ungetch()
 {
-    source.src--;
-    if (*source.src == '\n') {
-        source.line--;
-        source.column = (int)vector_get(source.line2length, source.line);
+    ctx->source.src--;
+    if (*ctx->source.src == '\n') {
+        ctx->source.line--;
+        ctx->source.column =
+            (int)vector_get(ctx->source.line2length, ctx->source.line);
     }
     else {
-        source.column--;
+        ctx->source.column--;
     }
 }
 
-char peekch() { return *source.src; }
+char peekch() { return *ctx->source.src; }
 
 char getch()
 {
@@ -68,13 +67,13 @@ char getch()
     if (ch == '\0') error("unexpected EOF");
 
     if (ch == '\n') {
-        source.line++;
-        source.column = 0;
+        ctx->source.line++;
+        ctx->source.column = 0;
     }
     else {
-        source.column++;
+        ctx->source.column++;
     }
-    return *source.src++;
+    return *ctx->source.src++;
 }
 
 int read_next_hex_int()
@@ -140,6 +139,43 @@ Token *read_next_int_token()
     return token;
 }
 
+// the table is shared by all compilations, so it must be built out of any
+// context. See init_shared_tables() in context.c.
+Map *keyword_table()
+{
+    static Map *table = NULL;
+    if (table == NULL) {
+        table = new_map();
+
+        map_insert(table, "return", (void *)kRETURN);
+        map_insert(table, "if", (void *)kIF);
+        map_insert(table, "else", (void *)kELSE);
+        map_insert(table, "while", (void *)kWHILE);
+        map_insert(table, "break", (void *)kBREAK);
+        map_insert(table, "continue", (void *)kCONTINUE);
+        map_insert(table, "for", (void *)kFOR);
+        map_insert(table, "int", (void *)kINT);
+        map_insert(table, "char", (void *)kCHAR);
+        map_insert(table, "sizeof", (void *)kSIZEOF);
+        map_insert(table, "switch", (void *)kSWITCH);
+        map_insert(table, "default", (void *)kDEFAULT);
+        map_insert(table, "case", (void *)kCASE);
+        map_insert(table, "goto", (void *)kGOTO);
+        map_insert(table, "struct", (void *)kSTRUCT);
+        map_insert(table, "typedef", (void *)kTYPEDEF);
+        map_insert(table, "do", (void *)kDO);
+        map_insert(table, "void", (void *)kVOID);
+        map_insert(table, "union", (void *)kUNION);
+        map_insert(table, "const", (void *)kCONST);
+        map_insert(table, "enum", (void *)kENUM);
+        map_insert(table, "_Noreturn", (void *)kNORETURN);
+        map_insert(table, "static", (void *)kSTATIC);
+        map_insert(table, "extern", (void *)kEXTERN);
+    }
+
+    return table;
+}
+
 Token *read_next_ident_token()
 {
     StringBuilder *sb = new_string_builder();
@@ -154,39 +190,9 @@ Token *read_next_ident_token()
         string_builder_append(sb, ch);
     }
 
-    static Map *str2keyword = NULL;
-    if (str2keyword == NULL) {
-        str2keyword = new_map();
-
-        map_insert(str2keyword, "return", (void *)kRETURN);
-        map_insert(str2keyword, "if", (void *)kIF);
-        map_insert(str2keyword, "else", (void *)kELSE);
-        map_insert(str2keyword, "while", (void *)kWHILE);
-        map_insert(str2keyword, "break", (void *)kBREAK);
-        map_insert(str2keyword, "continue", (void *)kCONTINUE);
-        map_insert(str2keyword, "for", (void *)kFOR);
-        map_insert(str2keyword, "int", (void *)kINT);
-        map_insert(str2keyword, "char", (void *)kCHAR);
-        map_insert(str2keyword, "sizeof", (void *)kSIZEOF);
-        map_insert(str2keyword, "switch", (void *)kSWITCH);
-        map_insert(str2keyword, "default", (void *)kDEFAULT);
-        map_insert(str2keyword, "case", (void *)kCASE);
-        map_insert(str2keyword, "goto", (void *)kGOTO);
-        map_insert(str2keyword, "struct", (void *)kSTRUCT);
-        map_insert(str2keyword, "typedef", (void *)kTYPEDEF);
-        map_insert(str2keyword, "do", (void *)kDO);
-        map_insert(str2keyword, "void", (void *)kVOID);
-        map_insert(str2keyword, "union", (void *)kUNION);
-        map_insert(str2keyword, "const", (void *)kCONST);
-        map_insert(str2keyword, "enum", (void *)kENUM);
-        map_insert(str2keyword, "_Noreturn", (void *)kNORETURN);
-        map_insert(str2keyword, "static", (void *)kSTATIC);
-        map_insert(str2keyword, "extern", (void *)kEXTERN);
-    }
-
     char *str;
     str = string_builder_get(sb);
-    KeyValue *kv = map_lookup(str2keyword, str);
+    KeyValue *kv = map_lookup(keyword_table(), str);
     if (kv) return make_token((int)kv_value(kv));
 
     Token *token = make_token(tIDENT);
@@ -394,8 +400,8 @@ Token *read_next_token()
                     return make_token(tDOT);
                 }
                 if (getch() != '.')
-                    error("%s:%d:%d: unexpected dot", source.filepath,
-                          source.line, source.column);
+                    error("%s:%d:%d: unexpected dot", ctx->source.filepath,
+                          ctx->source.line, ctx->source.column);
                 return make_token(tDOTS);  // ...
 
             case '{':
@@ -426,8 +432,8 @@ Token *read_next_token()
                 return make_token(tNEWLINE);
         }
 
-        error(format("%s:%d:%d:unexpected character", source.filepath,
-                     source.line, source.column));
+        error(format("%s:%d:%d:unexpected character", ctx->source.filepath,
+                     ctx->source.line, ctx->source.column));
     }
 
     return make_token(tEOF);
@@ -673,14 +679,21 @@ void erase_backslash_newline(char *src)
 
 char *read_entire_file(char *filepath)
 {
-    FILE *fh = fopen(filepath, "r");
-    if (fh == NULL) error("no such file: '%s'", filepath);
-
-    // read the file all
-    StringBuilder *sb = new_string_builder();
-    int ch;
-    while ((ch = fgetc(fh)) != EOF) string_builder_append(sb, ch);
-    return string_builder_get(sb);
+    int fd = open(filepath, 0, 0);  // O_RDONLY
+    if (fd < 0) error("no such file: '%s'", filepath);
+
+    // read the file all at once, knowing its size by fstat.
+    char st[144];
+    if ((int)syscall(5, fd, st) < 0) error("can't stat '%s'", filepath);
+    int size = *(int *)(st + 48);  // st_size
+    char *src = safe_malloc(size + 1);
+    for (int nread = 0; nread < size;) {
+        int res = read(fd, src + nread, size - nread);
+        if (res <= 0) error("can't read '%s'", filepath);
+        nread += res;
+    }
+    src[size] = '\0';
+    close(fd);
 
-    fclose(fh);
+    return src;
 }
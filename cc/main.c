@@ -2,6 +2,45 @@
 
 #include "test.inc"
 
+void *syscall(int number, ...);
+
+Vector *read_preprocessed_tokens(char *infile)
+{
+    return preprocess_all_tokens(read_tokens_from_filepath(infile));
+}
+
+// the current time in microseconds.
+int now_usec()
+{
+    char ts[16];
+    syscall(228, 1, ts);  // __NR_clock_gettime, CLOCK_MONOTONIC
+    return *(int *)ts * 1000000 + *(int *)(ts + 8) / 1000;
+}
+
+// cc -bench compiles the C file count times in one context, which is
+// reused like an embedder of aqcc_compile() would do.
+int bench(int count, char *infile, int debug_info)
+{
+    char *src = read_entire_file(infile);
+    Context *context = aqcc_new_context();
+    context->debug_info = debug_info;
+    int size = 0, first = 0;
+    int start = now_usec();
+    for (int i = 0; i < count; i++) {
+        if (aqcc_compile(context, src, strlen(src), &size) == NULL)
+            error("%s", context->error_message);
+        // the arena should stop growing after the first compilation.
+        if (i == 0) first = arena_capacity(context->arena);
+    }
+    int msec = max((now_usec() - start) / 1000, 1);
+
+    printf("%d compiles of %s in %d ms: %d compiles/sec, %d bytes of object\n",
+           count, infile, msec, count * 1000 / msec, size);
+    printf("arena: %d KiB after the first compile, %d KiB after the last\n",
+           first / 1024, arena_capacity(context->arena) / 1024);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     if (argc == 2 && strcmp(argv[1], "test") == 0) {
@@ -9,29 +48,72 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    if (argc != 3) goto usage;
+    // -g, -ffunction-sections and -fdata-sections go before the others.
+    int section_flags = 0, debug_info = 0;
+    for (; argc >= 2; argc--, argv++) {
+        if (strcmp(argv[1], "-g") == 0)
+            debug_info = 1;
+        else if (strcmp(argv[1], "-ffunction-sections") == 0)
+            section_flags |= AS_FUNCTION_SECTIONS;
+        else if (strcmp(argv[1], "-fdata-sections") == 0)
+            section_flags |= AS_DATA_SECTIONS;
+        else
+            break;
+    }
 
-    char *infile = argv[1], *outfile = argv[2];
+    if (argc == 4 && strcmp(argv[1], "-bench") == 0)
+        return bench(atoi(argv[2]), argv[3], debug_info);
 
-    Vector *tokens = read_tokens_from_filepath(infile);
-    tokens = preprocess_tokens(tokens);
-    tokens = concatenate_string_literal_tokens(tokens);
+    // the command line compiles only once, so errors simply exit.
+    begin_compilation(aqcc_new_context());
+    ctx->debug_info = debug_info;
 
-    Vector *asts = parse_prog(tokens);
+    // cc -run runs the C file in memory with the object files before "--",
+    // passing the arguments after it to main.
+    if (argc >= 3 && strcmp(argv[1], "-run") == 0) {
+        char *infile = argv[2];
+        Vector *objfiles = new_vector();
+        int i = 3;
+        for (; i < argc && strcmp(argv[i], "--") != 0; i++)
+            vector_push_back(objfiles, argv[i]);
+        Vector *args = new_vector_from_scalar(infile);
+        for (i++; i < argc; i++) vector_push_back(args, argv[i]);
 
-    Env *env = analyze_ast(asts);
-    x86_64_optimize_asts_constant(asts, env);
+        Vector *code = compile_tokens(read_preprocessed_tokens(infile));
+        return run_code(code, objfiles, args, argv + argc + 1);
+    }
 
-    Vector *code = x86_64_generate_code(asts);
-    code = x86_64_optimize_code(code);
+    // cc -c assembles the generated code into an object file by itself.
+    // cc -E writes the preprocessed tokens, which aqcc hashes for its cache.
+    int emit_object = argc == 4 && strcmp(argv[1], "-c") == 0;
+    int emit_tokens = argc == 4 && strcmp(argv[1], "-E") == 0;
+    if (argc != 3 && !emit_object && !emit_tokens) goto usage;
+
+    char *infile = argv[argc - 2], *outfile = argv[argc - 1];
+
+    Vector *tokens = read_preprocessed_tokens(infile);
+    if (emit_tokens) {
+        FILE *fh = fopen(outfile, "wb");
+        dump_tokens(tokens, fh);
+        fclose(fh);
+        return 0;
+    }
 
+    Vector *code = compile_tokens(tokens);
     FILE *fh = fopen(outfile, "wb");
-    for (int i = 0; i < vector_size(code); i++)
-        dump_code((Code *)vector_get(code, i), fh);
+    if (emit_object)
+        dump_object_image(assemble_code(code, section_flags), fh);
+    else
+        for (int i = 0; i < vector_size(code); i++)
+            dump_code((Code *)vector_get(code, i), fh);
     fclose(fh);
 
     return 0;
 
 usage:
-    error("Usage: cc input-c-file-path output-asm-file-path");
+    error("Usage: cc [-g] [-ffunction-sections] [-fdata-sections] [-c, -E] "
+          "input-c-file-path output-file-path\n"
+          "       cc [-g] -run input-c-file-path input-obj-file-path... "
+          "[-- args...]\n"
+          "       cc [-g] -bench count input-c-file-path");
 }
@@ -0,0 +1,1079 @@
+#include "cc.h"
+
+// Target-independent optimizations on analyzed ASTs.
+
+// Push all direct children of `ast` to `children`.
+static void collect_children(AST *ast, Vector *children)
+{
+    if (ast == NULL) return;
+
+    switch (ast->kind) {
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_DIV:
+        case AST_REM:
+        case AST_LSHIFT:
+        case AST_RSHIFT:
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ:
+        case AST_AND:
+        case AST_XOR:
+        case AST_OR:
+        case AST_LAND:
+        case AST_LOR:
+        case AST_ASSIGN:
+        case AST_VA_START:
+        case AST_LVAR_DECL_INIT:
+        case AST_GVAR_DECL_INIT:
+            vector_push_back(children, ast->lhs);
+            vector_push_back(children, ast->rhs);
+            break;
+
+        case AST_COMPL:
+        case AST_UNARY_MINUS:
+        case AST_PREINC:
+        case AST_POSTINC:
+        case AST_PREDEC:
+        case AST_POSTDEC:
+        case AST_ADDR:
+        case AST_INDIR:
+        case AST_CAST:
+        case AST_CHAR2INT:
+        case AST_LVALUE2RVALUE:
+        case AST_VA_ARG_INT:
+        case AST_VA_ARG_CHARP:
+        case AST_EXPR_STMT:
+        case AST_RETURN:
+            vector_push_back(children, ast->lhs);
+            break;
+
+        case AST_ARY2PTR:
+            vector_push_back(children, ast->ary);
+            break;
+
+        case AST_MEMBER_REF:
+            vector_push_back(children, ast->stsrc);
+            break;
+
+        case AST_COND:
+        case AST_IF:
+            vector_push_back(children, ast->cond);
+            vector_push_back(children, ast->then);
+            vector_push_back(children, ast->els);
+            break;
+
+        case AST_FOR:
+            vector_push_back(children, ast->initer);
+            vector_push_back(children, ast->midcond);
+            vector_push_back(children, ast->iterer);
+            vector_push_back(children, ast->for_body);
+            break;
+
+        case AST_DOWHILE:
+            vector_push_back(children, ast->cond);
+            vector_push_back(children, ast->then);
+            break;
+
+        case AST_SWITCH:
+            vector_push_back(children, ast->target);
+            vector_push_back(children, ast->switch_body);
+            break;
+
+        case AST_LABEL:
+            vector_push_back(children, ast->label_stmt);
+            break;
+
+        case AST_EXPR_LIST:
+        case AST_COMPOUND:
+        case AST_DECL_LIST:
+            // exprs, stmts and decls share the same storage.
+            vector_push_back_vector(children, ast->stmts);
+            break;
+
+        case AST_FUNCCALL:
+            vector_push_back_vector(children, ast->args);
+            break;
+
+        case AST_FUNCDEF:
+            vector_push_back(children, ast->body);
+            break;
+    }
+}
+
+static int count_ast_nodes(AST *ast)
+{
+    if (ast == NULL) return 0;
+
+    int count = 1;
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        count += count_ast_nodes((AST *)vector_get(children, i));
+    return count;
+}
+
+// Function inlining
+//
+// A function is inlinable when its body can be rewritten into one
+// expression, that is, when it consists of only expression statements,
+// declarations of local variables, if-statements and return-statements.
+// A call to such a function is replaced with an AST_EXPR_LIST that assigns
+// the arguments to fresh local variables of the caller and then evaluates
+// a copy of the rewritten body. All locals of the callee are moved into the
+// caller's frame in the same way.
+
+// The maximum size of inlined functions in AST nodes: for non-static
+// functions, static functions and static functions called only once.
+#define INLINE_MAX_SIZE 12
+#define INLINE_MAX_SIZE_STATIC 40
+#define INLINE_MAX_SIZE_ONCE 120
+// same as get_temp_reg() in x86_64_gen.c
+#define INLINE_NUM_TEMP_REGS 6
+
+typedef struct {
+    AST *funcdef;
+    AST *expr;                // NULL if not inlinable
+    int size;                 // the number of AST nodes of expr
+    int ncalls;               // the number of call sites except itself
+    Vector *readonly_params;  // int; 1 if the param is never written
+} InlineFunc;
+
+// Rewrite a statement `stmt` followed by an expression `cont` into one
+// expression. Return NULL if impossible.
+static AST *inline_stmt2expr(AST *stmt, AST *cont)
+{
+    if (stmt == NULL || cont == NULL) return cont;
+
+    switch (stmt->kind) {
+        case AST_NOP:
+        case AST_LVAR_DECL:
+            return cont;
+
+        case AST_RETURN:
+            if (stmt->lhs == NULL) return new_int_ast(0);
+            return stmt->lhs;
+
+        case AST_EXPR_STMT:
+        case AST_LVAR_DECL_INIT: {
+            AST *expr = stmt->kind == AST_EXPR_STMT ? stmt->lhs : stmt->rhs;
+            if (expr == NULL || expr->kind == AST_NOP) return cont;
+
+            AST *ast = new_ast(AST_EXPR_LIST);
+            ast->exprs = new_vector();
+            vector_push_back(ast->exprs, expr);
+            vector_push_back(ast->exprs, cont);
+            ast->type = cont->type;
+            return ast;
+        }
+
+        case AST_COMPOUND:
+        case AST_DECL_LIST:
+            for (int i = vector_size(stmt->stmts) - 1; i >= 0 && cont; i--)
+                cont = inline_stmt2expr((AST *)vector_get(stmt->stmts, i),
+                                        cont);
+            return cont;
+
+        case AST_IF: {
+            // `cont` can be shared by both branches because the rewritten
+            // body is always cloned before it is used.
+            AST *then = inline_stmt2expr(stmt->then, cont),
+                *els = inline_stmt2expr(stmt->els, cont);
+            if (then == NULL || els == NULL) return NULL;
+
+            AST *ast = new_ast(AST_COND);
+            ast->cond = stmt->cond;
+            ast->then = then;
+            ast->els = els;
+            ast->type = then->type;
+            return ast;
+        }
+    }
+
+    return NULL;
+}
+
+static AST *clone_expr(AST *ast);
+
+static int is_inlinable_expr(AST *ast)
+{
+    if (ast == NULL) return 1;
+
+    switch (ast->kind) {
+        case AST_VA_START:
+        case AST_VA_ARG_INT:
+        case AST_VA_ARG_CHARP:
+            return 0;
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        if (!is_inlinable_expr((AST *)vector_get(children, i))) return 0;
+    return 1;
+}
+
+// Return 1 if `var` is written or its address is taken in `ast`.
+static int is_var_modified(AST *ast, AST *var)
+{
+    if (ast == NULL) return 0;
+
+    switch (ast->kind) {
+        case AST_ASSIGN:
+        case AST_PREINC:
+        case AST_POSTINC:
+        case AST_PREDEC:
+        case AST_POSTDEC:
+        case AST_ADDR:
+            if (ast->lhs == var) return 1;
+            break;
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        if (is_var_modified((AST *)vector_get(children, i), var)) return 1;
+    return 0;
+}
+
+static InlineFunc *lookup_inline_func(char *fname)
+{
+    KeyValue *kv = map_lookup(ctx->inline_funcs, fname);
+    if (kv == NULL) return NULL;
+    return (InlineFunc *)kv_value(kv);
+}
+
+static void register_inline_func(AST *funcdef)
+{
+    InlineFunc *func = safe_malloc(sizeof(InlineFunc));
+    func->funcdef = funcdef;
+    func->expr = NULL;
+    func->size = 0;
+    func->ncalls = 0;
+    func->readonly_params = new_vector();
+    map_insert(ctx->inline_funcs, funcdef->fname, func);
+
+    if (funcdef->is_variadic) return;
+
+    // Falling off the end of the function yields 0 just as AST_FUNCDEF does.
+    AST *expr = inline_stmt2expr(funcdef->body, new_int_ast(0));
+    if (expr == NULL || !is_inlinable_expr(expr)) return;
+
+    AST *cast = new_ast(AST_CAST);
+    cast->lhs = expr;
+    cast->type = funcdef->type;
+    // Detach the rewritten body from the function's own body, which may be
+    // changed by inlining later.
+    ctx->clone_from = ctx->clone_to = ctx->clone_subst = new_vector();
+    func->expr = clone_expr(cast);
+    func->size = count_ast_nodes(func->expr);
+
+    int nparams = funcdef->params ? vector_size(funcdef->params) : 0;
+    for (int i = 0; i < nparams; i++) {
+        // Params are in reversed order in scoped_vars.
+        AST *param =
+            (AST *)vector_get(funcdef->env->scoped_vars, nparams - 1 - i);
+        vector_push_back(func->readonly_params,
+                         (void *)!is_var_modified(func->expr, param));
+    }
+}
+
+static void count_calls(AST *ast, char *fname)
+{
+    if (ast == NULL) return;
+
+    if (ast->kind == AST_FUNCCALL && strcmp(ast->fname, fname) != 0) {
+        InlineFunc *func = lookup_inline_func(ast->fname);
+        if (func) func->ncalls++;
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        count_calls((AST *)vector_get(children, i), fname);
+}
+
+static void count_all_calls(Vector *asts)
+{
+    for (int i = 0; i < vector_size(asts); i++) {
+        AST *ast = (AST *)vector_get(asts, i);
+        if (ast->kind != AST_FUNCDEF) continue;
+        lookup_inline_func(ast->fname)->ncalls = 0;
+    }
+    for (int i = 0; i < vector_size(asts); i++) {
+        AST *ast = (AST *)vector_get(asts, i);
+        if (ast->kind != AST_FUNCDEF) continue;
+        count_calls(ast->body, ast->fname);
+    }
+}
+
+// An upper bound of the number of temporary registers that
+// x86_64_generate_code_detail() uses at once to evaluate `ast`.
+static int inline_reg_need(AST *ast)
+{
+    if (ast == NULL) return 0;
+
+    switch (ast->kind) {
+        case AST_INT:
+        case AST_LVAR:
+        case AST_GVAR:
+        case AST_CONSTANT:
+            return 1;
+
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_DIV:
+        case AST_REM:
+        case AST_LSHIFT:
+        case AST_RSHIFT:
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ:
+        case AST_AND:
+        case AST_XOR:
+        case AST_OR:
+        case AST_LAND:
+        case AST_LOR:
+        case AST_ASSIGN:
+            return max(inline_reg_need(ast->lhs),
+                       inline_reg_need(ast->rhs) + 1);
+    }
+
+    int need = 2;
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        need = max(need, inline_reg_need((AST *)vector_get(children, i)));
+    return need;
+}
+
+// Deep-copy an expression. Local variables listed in `ctx->clone_from` are
+// replaced with the ones in `ctx->clone_to`, and reads of them are replaced
+// with `ctx->clone_subst` if it's not NULL.
+static AST *clone_expr(AST *ast)
+{
+    if (ast == NULL) return NULL;
+
+    switch (ast->kind) {
+        case AST_INT:
+        case AST_GVAR:
+        case AST_CONSTANT:
+            return ast;
+
+        case AST_LVAR:
+            for (int i = 0; i < vector_size(ctx->clone_from); i++)
+                if (vector_get(ctx->clone_from, i) == ast)
+                    return (AST *)vector_get(ctx->clone_to, i);
+            return ast;
+
+        case AST_LVALUE2RVALUE:
+            for (int i = 0; i < vector_size(ctx->clone_from); i++)
+                if (vector_get(ctx->clone_from, i) == ast->lhs &&
+                    vector_get(ctx->clone_subst, i) != NULL)
+                    return (AST *)vector_get(ctx->clone_subst, i);
+            break;
+    }
+
+    AST *nast = new_ast(ast->kind);
+    memcpy(nast, ast, sizeof(AST));
+
+    switch (ast->kind) {
+        case AST_EXPR_LIST:
+        case AST_FUNCCALL: {
+            Vector *src = ast->kind == AST_FUNCCALL ? ast->args : ast->exprs,
+                   *dst = new_vector();
+            for (int i = 0; i < vector_size(src); i++)
+                vector_push_back(dst, clone_expr((AST *)vector_get(src, i)));
+            if (ast->kind == AST_FUNCCALL)
+                nast->args = dst;
+            else
+                nast->exprs = dst;
+        } break;
+
+        case AST_ARY2PTR:
+            nast->ary = clone_expr(ast->ary);
+            break;
+
+        case AST_MEMBER_REF:
+            nast->stsrc = clone_expr(ast->stsrc);
+            break;
+
+        case AST_COND:
+            nast->cond = clone_expr(ast->cond);
+            nast->then = clone_expr(ast->then);
+            nast->els = clone_expr(ast->els);
+            break;
+
+        default: {
+            Vector *children = new_vector();
+            collect_children(ast, children);
+            assert(vector_size(children) <= 2);
+            if (vector_size(children) >= 1) nast->lhs = clone_expr(ast->lhs);
+            if (vector_size(children) == 2) nast->rhs = clone_expr(ast->rhs);
+        } break;
+    }
+
+    return nast;
+}
+
+static int can_inline(InlineFunc *func, AST *call, int live)
+{
+    if (func == NULL || func->expr == NULL) return 0;
+
+    AST *funcdef = func->funcdef;
+    int nparams = funcdef->params ? vector_size(funcdef->params) : 0;
+    if (nparams != vector_size(call->args)) return 0;
+
+    // recursion limit
+    if (ctx->inline_depth + 1 >= INLINE_MAX_DEPTH) return 0;
+    for (int i = 0; i <= ctx->inline_depth; i++)
+        if (strcmp(ctx->inline_chain[i], funcdef->fname) == 0) return 0;
+
+    // size/benefit heuristic
+    int max_size = INLINE_MAX_SIZE;
+    if (funcdef->type->is_static)
+        max_size =
+            func->ncalls == 1 ? INLINE_MAX_SIZE_ONCE : INLINE_MAX_SIZE_STATIC;
+    if (func->size > max_size) return 0;
+
+    // Inlined code must not run out of temporary registers.
+    int need = inline_reg_need(func->expr);
+    for (int i = 0; i < nparams; i++)
+        need = max(need, inline_reg_need((AST *)vector_get(call->args, i)) + 1);
+    return live + need <= INLINE_NUM_TEMP_REGS;
+}
+
+static AST *inline_expand(InlineFunc *func, AST *call)
+{
+    AST *funcdef = func->funcdef;
+    Vector *vars = funcdef->env->scoped_vars;
+    int nparams = vector_size(call->args);
+
+    ctx->clone_from = new_vector();
+    ctx->clone_to = new_vector();
+    ctx->clone_subst = new_vector();
+    for (int i = 0; i < vector_size(vars); i++) {
+        AST *var = (AST *)vector_get(vars, i);
+        if (var->type->is_static || var->type->is_extern) continue;
+
+        // A read-only param whose argument is an integer constant is
+        // replaced with the constant itself.
+        AST *subst = NULL;
+        if (i < nparams) {
+            int index = nparams - 1 - i;
+            AST *arg = (AST *)vector_get(call->args, index);
+            if (vector_get(func->readonly_params, index) &&
+                arg->kind == AST_INT && var->type->kind == TY_INT)
+                subst = arg;
+        }
+
+        AST *nvar = NULL;
+        if (subst == NULL) {
+            nvar = new_lgvar_ast(AST_LVAR, var->type, var->varname, -1);
+            vector_push_back(ctx->inline_caller->env->scoped_vars, nvar);
+        }
+
+        vector_push_back(ctx->clone_from, var);
+        vector_push_back(ctx->clone_to, nvar);
+        vector_push_back(ctx->clone_subst, subst);
+    }
+
+    AST *ast = new_ast(AST_EXPR_LIST);
+    ast->exprs = new_vector();
+    // Evaluate arguments from right to left as AST_FUNCCALL does.
+    for (int i = 0; i < nparams; i++) {
+        AST *nvar = (AST *)vector_get(ctx->clone_to, i);
+        if (nvar == NULL) continue;
+        AST *assign = new_binop_ast(AST_ASSIGN, nvar,
+                                    (AST *)vector_get(call->args, nparams - 1 - i));
+        assign->type = nvar->type;
+        vector_push_back(ast->exprs, assign);
+    }
+    vector_push_back(ast->exprs, clone_expr(func->expr));
+    ast->type = func->expr->type;
+
+    return ast;
+}
+
+static AST *inline_ast(AST *ast, int live);
+
+static AST *inline_call(AST *call, int live)
+{
+    InlineFunc *func = lookup_inline_func(call->fname);
+    if (!can_inline(func, call, live)) return call;
+
+    AST *ast = inline_expand(func, call);
+
+    // Calls in the inlined body may also be inlined. The arguments have
+    // already been processed.
+    int last = vector_size(ast->exprs) - 1;
+    ctx->inline_chain[++ctx->inline_depth] = call->fname;
+    vector_set(ast->exprs, last,
+               inline_ast((AST *)vector_get(ast->exprs, last), live));
+    ctx->inline_depth--;
+
+    return ast;
+}
+
+// `live` is the number of temporary registers that are in use when `ast` is
+// evaluated.
+static AST *inline_ast(AST *ast, int live)
+{
+    if (ast == NULL) return NULL;
+
+    switch (ast->kind) {
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_DIV:
+        case AST_REM:
+        case AST_LSHIFT:
+        case AST_RSHIFT:
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ:
+        case AST_AND:
+        case AST_XOR:
+        case AST_OR:
+        case AST_LAND:
+        case AST_LOR:
+        case AST_ASSIGN:
+            ast->lhs = inline_ast(ast->lhs, live);
+            ast->rhs = inline_ast(ast->rhs, live + 1);
+            break;
+
+        case AST_LVAR_DECL_INIT:
+        case AST_GVAR_DECL_INIT:
+            ast->rhs = inline_ast(ast->rhs, live);
+            break;
+
+        case AST_COMPL:
+        case AST_UNARY_MINUS:
+        case AST_PREINC:
+        case AST_POSTINC:
+        case AST_PREDEC:
+        case AST_POSTDEC:
+        case AST_ADDR:
+        case AST_INDIR:
+        case AST_CAST:
+        case AST_CHAR2INT:
+        case AST_LVALUE2RVALUE:
+        case AST_EXPR_STMT:
+        case AST_RETURN:
+            ast->lhs = inline_ast(ast->lhs, live);
+            break;
+
+        case AST_ARY2PTR:
+            ast->ary = inline_ast(ast->ary, live);
+            break;
+
+        case AST_MEMBER_REF:
+            ast->stsrc = inline_ast(ast->stsrc, live);
+            break;
+
+        case AST_COND:
+        case AST_IF:
+            ast->cond = inline_ast(ast->cond, live);
+            ast->then = inline_ast(ast->then, live);
+            ast->els = inline_ast(ast->els, live);
+            break;
+
+        case AST_FOR:
+            ast->initer = inline_ast(ast->initer, live);
+            ast->midcond = inline_ast(ast->midcond, live);
+            ast->iterer = inline_ast(ast->iterer, live);
+            ast->for_body = inline_ast(ast->for_body, live);
+            break;
+
+        case AST_DOWHILE:
+            ast->cond = inline_ast(ast->cond, live);
+            ast->then = inline_ast(ast->then, live);
+            break;
+
+        case AST_SWITCH:
+            ast->target = inline_ast(ast->target, live);
+            ast->switch_body = inline_ast(ast->switch_body, live);
+            break;
+
+        case AST_LABEL:
+            ast->label_stmt = inline_ast(ast->label_stmt, live);
+            break;
+
+        case AST_EXPR_LIST:
+        case AST_COMPOUND:
+        case AST_DECL_LIST:
+            for (int i = 0; i < vector_size(ast->stmts); i++)
+                vector_set(ast->stmts, i,
+                           inline_ast((AST *)vector_get(ast->stmts, i), live));
+            break;
+
+        case AST_FUNCCALL:
+            for (int i = 0; i < vector_size(ast->args); i++)
+                vector_set(ast->args, i,
+                           inline_ast((AST *)vector_get(ast->args, i), live));
+            return inline_call(ast, live);
+    }
+
+    return ast;
+}
+
+static int has_static_lvar(AST *funcdef)
+{
+    Vector *vars = funcdef->env->scoped_vars;
+    for (int i = 0; i < vector_size(vars); i++)
+        if (((AST *)vector_get(vars, i))->type->is_static) return 1;
+    return 0;
+}
+
+void optimize_asts_inline(Vector *asts)
+{
+    ctx->inline_funcs = new_map();
+    for (int i = 0; i < vector_size(asts); i++) {
+        AST *ast = (AST *)vector_get(asts, i);
+        if (ast->kind == AST_FUNCDEF) register_inline_func(ast);
+    }
+    count_all_calls(asts);
+
+    for (int i = 0; i < vector_size(asts); i++) {
+        AST *ast = (AST *)vector_get(asts, i);
+        if (ast->kind != AST_FUNCDEF) continue;
+        ctx->inline_caller = ast;
+        ctx->inline_chain[0] = ast->fname;
+        ctx->inline_depth = 0;
+        ast->body = inline_ast(ast->body, 0);
+    }
+
+    // Remove static functions that are no longer called.
+    int removed = 1;
+    while (removed) {
+        removed = 0;
+        count_all_calls(asts);
+        for (int i = 0; i < vector_size(asts); i++) {
+            AST *ast = (AST *)vector_get(asts, i);
+            if (ast->kind != AST_FUNCDEF || !ast->type->is_static) continue;
+            if (lookup_inline_func(ast->fname)->ncalls != 0 ||
+                has_static_lvar(ast))
+                continue;
+            vector_set(asts, i, new_ast(AST_NOP));
+            removed = 1;
+        }
+    }
+}
+
+// Set the children of `ast` in the same order as collect_children().
+static void replace_children(AST *ast, Vector *children)
+{
+    switch (ast->kind) {
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_DIV:
+        case AST_REM:
+        case AST_LSHIFT:
+        case AST_RSHIFT:
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ:
+        case AST_AND:
+        case AST_XOR:
+        case AST_OR:
+        case AST_LAND:
+        case AST_LOR:
+        case AST_ASSIGN:
+        case AST_VA_START:
+        case AST_LVAR_DECL_INIT:
+        case AST_GVAR_DECL_INIT:
+            ast->lhs = (AST *)vector_get(children, 0);
+            ast->rhs = (AST *)vector_get(children, 1);
+            break;
+
+        case AST_COMPL:
+        case AST_UNARY_MINUS:
+        case AST_PREINC:
+        case AST_POSTINC:
+        case AST_PREDEC:
+        case AST_POSTDEC:
+        case AST_ADDR:
+        case AST_INDIR:
+        case AST_CAST:
+        case AST_CHAR2INT:
+        case AST_LVALUE2RVALUE:
+        case AST_VA_ARG_INT:
+        case AST_VA_ARG_CHARP:
+        case AST_EXPR_STMT:
+        case AST_RETURN:
+            ast->lhs = (AST *)vector_get(children, 0);
+            break;
+
+        case AST_ARY2PTR:
+            ast->ary = (AST *)vector_get(children, 0);
+            break;
+
+        case AST_MEMBER_REF:
+            ast->stsrc = (AST *)vector_get(children, 0);
+            break;
+
+        case AST_COND:
+        case AST_IF:
+            ast->cond = (AST *)vector_get(children, 0);
+            ast->then = (AST *)vector_get(children, 1);
+            ast->els = (AST *)vector_get(children, 2);
+            break;
+
+        case AST_FOR:
+            ast->initer = (AST *)vector_get(children, 0);
+            ast->midcond = (AST *)vector_get(children, 1);
+            ast->iterer = (AST *)vector_get(children, 2);
+            ast->for_body = (AST *)vector_get(children, 3);
+            break;
+
+        case AST_DOWHILE:
+            ast->cond = (AST *)vector_get(children, 0);
+            ast->then = (AST *)vector_get(children, 1);
+            break;
+
+        case AST_SWITCH:
+            ast->target = (AST *)vector_get(children, 0);
+            ast->switch_body = (AST *)vector_get(children, 1);
+            break;
+
+        case AST_LABEL:
+            ast->label_stmt = (AST *)vector_get(children, 0);
+            break;
+
+        case AST_EXPR_LIST:
+        case AST_COMPOUND:
+        case AST_DECL_LIST:
+            for (int i = 0; i < vector_size(children); i++)
+                vector_set(ast->stmts, i, vector_get(children, i));
+            break;
+
+        case AST_FUNCCALL:
+            for (int i = 0; i < vector_size(children); i++)
+                vector_set(ast->args, i, vector_get(children, i));
+            break;
+
+        case AST_FUNCDEF:
+            ast->body = (AST *)vector_get(children, 0);
+            break;
+    }
+}
+
+static int contains_ast(Vector *vec, AST *ast)
+{
+    for (int i = 0; i < vector_size(vec); i++)
+        if (vector_get(vec, i) == ast) return 1;
+    return 0;
+}
+
+// Loop-invariant code motion
+//
+// Invariant expressions in AST_FOR (AST_WHILE is converted to it when
+// analyzing) and AST_DOWHILE loops are computed once into fresh local
+// variables in a preheader that is placed just before the loop.
+// Only expressions that have no side effects and can't fault are hoisted
+// because the preheader runs even if the loop body never does. The only
+// exception is loads through pointers in the condition of AST_FOR, which is
+// always evaluated when the loop is entered.
+
+typedef struct {
+    Vector *written;         // AST_LVAR/AST_GVAR written in the loop
+    int has_call;            // calls may write any memory
+    int has_indirect_store;  // stores through pointers
+    int has_label;           // the loop may be entered by goto or case
+} LoopInfo;
+
+static AST *lvalue_root_var(AST *lvalue)
+{
+    while (lvalue->kind == AST_MEMBER_REF) lvalue = lvalue->stsrc;
+    if (lvalue->kind == AST_LVAR || lvalue->kind == AST_GVAR) return lvalue;
+    return NULL;
+}
+
+static int is_aliased_var(AST *var)
+{
+    return var->kind == AST_GVAR || var->type->is_static ||
+           var->type->is_extern || contains_ast(ctx->licm_addr_taken, var);
+}
+
+static void collect_addr_taken(AST *ast)
+{
+    if (ast == NULL) return;
+
+    if (ast->kind == AST_ADDR || ast->kind == AST_ARY2PTR) {
+        AST *var = lvalue_root_var(ast->kind == AST_ADDR ? ast->lhs : ast->ary);
+        if (var && !contains_ast(ctx->licm_addr_taken, var))
+            vector_push_back(ctx->licm_addr_taken, var);
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        collect_addr_taken((AST *)vector_get(children, i));
+}
+
+static void collect_loop_info(AST *ast, LoopInfo *info)
+{
+    if (ast == NULL) return;
+
+    switch (ast->kind) {
+        case AST_ASSIGN:
+        case AST_PREINC:
+        case AST_POSTINC:
+        case AST_PREDEC:
+        case AST_POSTDEC: {
+            AST *var = lvalue_root_var(ast->lhs);
+            if (var == NULL)
+                info->has_indirect_store = 1;
+            else
+                vector_push_back(info->written, var);
+        } break;
+
+        case AST_FUNCCALL:
+        case AST_VA_START:
+        case AST_VA_ARG_INT:
+        case AST_VA_ARG_CHARP:
+            info->has_call = 1;
+            break;
+
+        case AST_LABEL:
+            info->has_label = 1;
+            break;
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        collect_loop_info((AST *)vector_get(children, i), info);
+}
+
+// Return 1 if the loop may write memory that is not a local variable whose
+// address is never taken.
+static int loop_writes_memory(LoopInfo *info)
+{
+    if (info->has_call || info->has_indirect_store) return 1;
+    for (int i = 0; i < vector_size(info->written); i++)
+        if (is_aliased_var((AST *)vector_get(info->written, i))) return 1;
+    return 0;
+}
+
+static int is_var_unchanged(AST *var, LoopInfo *info)
+{
+    if (contains_ast(info->written, var)) return 0;
+    if (!is_aliased_var(var)) return 1;
+    return !info->has_call && !info->has_indirect_store;
+}
+
+static int is_invariant(AST *ast, LoopInfo *info, int can_load);
+
+// Return 1 if the address that the lvalue `ast` points to is invariant.
+static int is_invariant_address(AST *ast, LoopInfo *info, int can_load)
+{
+    switch (ast->kind) {
+        case AST_LVAR:
+        case AST_GVAR:
+            return 1;
+
+        case AST_MEMBER_REF:
+            return is_invariant_address(ast->stsrc, info, can_load);
+
+        case AST_INDIR:
+            return is_invariant(ast->lhs, info, can_load);
+    }
+
+    return 0;
+}
+
+// `can_load` is 1 if `ast` is always evaluated when the loop is entered.
+static int is_invariant(AST *ast, LoopInfo *info, int can_load)
+{
+    if (ast == NULL) return 0;
+
+    switch (ast->kind) {
+        case AST_INT:
+        case AST_LVAR:
+        case AST_GVAR:
+            return 1;
+
+        case AST_LVALUE2RVALUE: {
+            AST *var = lvalue_root_var(ast->lhs);
+            if (var) return is_var_unchanged(var, info);
+            return can_load && !loop_writes_memory(info) &&
+                   is_invariant_address(ast->lhs, info, can_load);
+        }
+
+        case AST_ADDR:
+            return is_invariant_address(ast->lhs, info, can_load);
+
+        case AST_ARY2PTR:
+            return is_invariant_address(ast->ary, info, can_load);
+
+        case AST_DIV:
+        case AST_REM:
+            // division by zero and INT_MIN / -1 fault.
+            if (ast->rhs->kind != AST_INT || ast->rhs->ival == 0 ||
+                ast->rhs->ival == -1)
+                return 0;
+            return is_invariant(ast->lhs, info, can_load);
+
+        case AST_ADD:
+        case AST_SUB:
+        case AST_MUL:
+        case AST_LSHIFT:
+        case AST_RSHIFT:
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ:
+        case AST_AND:
+        case AST_XOR:
+        case AST_OR:
+            return is_invariant(ast->lhs, info, can_load) &&
+                   is_invariant(ast->rhs, info, can_load);
+
+        case AST_COMPL:
+        case AST_UNARY_MINUS:
+        case AST_CHAR2INT:
+        case AST_CAST:
+            return is_invariant(ast->lhs, info, can_load);
+    }
+
+    return 0;
+}
+
+// Hoisting a single load or a constant doesn't pay since the temporary
+// variable would have to be loaded instead.
+static int is_worth_hoisting(AST *ast)
+{
+    if (ast->type == NULL ||
+        (ast->type->kind != TY_INT && ast->type->kind != TY_PTR))
+        return 0;
+
+    switch (ast->kind) {
+        case AST_INT:
+        case AST_LVAR:
+        case AST_GVAR:
+        case AST_INDIR:
+        case AST_MEMBER_REF:
+            return 0;
+
+        case AST_CHAR2INT:
+        case AST_CAST:
+            return is_worth_hoisting(ast->lhs);
+    }
+
+    return count_ast_nodes(ast) >= 3;
+}
+
+static AST *licm_hoist(AST *ast, LoopInfo *info, Vector *preheader,
+                       int can_load)
+{
+    if (ast == NULL) return NULL;
+
+    if (is_worth_hoisting(ast) && is_invariant(ast, info, can_load)) {
+        AST *var = new_lgvar_ast(AST_LVAR, ast->type, "", -1);
+        vector_push_back(ctx->licm_func->env->scoped_vars, var);
+
+        AST *assign = new_binop_ast(AST_ASSIGN, var, ast);
+        assign->type = ast->type;
+        vector_push_back(preheader, new_unary_ast(AST_EXPR_STMT, assign));
+
+        AST *load = new_lvalue2rvalue_ast(var);
+        return load;
+    }
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++) {
+        // The right-hand side of && and || and the branches of ?: may not be
+        // evaluated.
+        int child_can_load =
+            can_load && !(i >= 1 && (ast->kind == AST_LAND ||
+                                     ast->kind == AST_LOR ||
+                                     ast->kind == AST_COND));
+        vector_set(children, i,
+                   licm_hoist((AST *)vector_get(children, i), info, preheader,
+                              child_can_load));
+    }
+    replace_children(ast, children);
+
+    return ast;
+}
+
+static int is_stmt(AST *ast)
+{
+    switch (ast->kind) {
+        case AST_DECL_LIST:
+        case AST_LVAR_DECL:
+        case AST_LVAR_DECL_INIT:
+        case AST_NOP:
+            return 1;
+    }
+    return 0;
+}
+
+static AST *licm_loop(AST *loop)
+{
+    LoopInfo info;
+    info.written = new_vector();
+    info.has_call = info.has_indirect_store = info.has_label = 0;
+    collect_loop_info(loop, &info);
+    if (info.has_label) return loop;
+
+    Vector *preheader = new_vector();
+    if (loop->kind == AST_FOR) {
+        loop->midcond = licm_hoist(loop->midcond, &info, preheader, 1);
+        loop->iterer = licm_hoist(loop->iterer, &info, preheader, 0);
+        loop->for_body = licm_hoist(loop->for_body, &info, preheader, 0);
+    }
+    else {
+        loop->cond = licm_hoist(loop->cond, &info, preheader, 0);
+        loop->then = licm_hoist(loop->then, &info, preheader, 0);
+    }
+    if (vector_size(preheader) == 0) return loop;
+
+    // The preheader is placed after the initializer of AST_FOR, which may
+    // set variables that hoisted expressions use.
+    AST *ast = new_ast(AST_COMPOUND);
+    ast->stmts = new_vector();
+    if (loop->kind == AST_FOR && loop->initer) {
+        AST *initer = loop->initer;
+        if (!is_stmt(initer)) initer = new_unary_ast(AST_EXPR_STMT, initer);
+        vector_push_back(ast->stmts, initer);
+        loop->initer = NULL;
+    }
+    vector_push_back_vector(ast->stmts, preheader);
+    vector_push_back(ast->stmts, loop);
+    return ast;
+}
+
+// Inner loops are processed first so that expressions hoisted out of them
+// can be hoisted further.
+static AST *licm_stmt(AST *ast)
+{
+    if (ast == NULL) return NULL;
+
+    Vector *children = new_vector();
+    collect_children(ast, children);
+    for (int i = 0; i < vector_size(children); i++)
+        vector_set(children, i, licm_stmt((AST *)vector_get(children, i)));
+    replace_children(ast, children);
+
+    if (ast->kind == AST_FOR || ast->kind == AST_DOWHILE)
+        return licm_loop(ast);
+    return ast;
+}
+
+void optimize_asts_licm(Vector *asts)
+{
+    for (int i = 0; i < vector_size(asts); i++) {
+        AST *ast = (AST *)vector_get(asts, i);
+        if (ast->kind != AST_FUNCDEF) continue;
+
+        ctx->licm_func = ast;
+        ctx->licm_addr_taken = new_vector();
+        collect_addr_taken(ast->body);
+        ast->body = licm_stmt(ast->body);
+    }
+}
@@ -17,19 +17,17 @@ AST *parse_constant_expr(void);
 
 // typedef data for parser.
 // analyzer won't use this data.
-Map *typedef_table;
-
-void init_typedef_table() { typedef_table = new_map(); }
+void init_typedef_table() { ctx->typedef_table = new_map(); }
 
 void add_typedef_name(char *name)
 {
-    map_insert(typedef_table, name, (void *)1);
+    map_insert(ctx->typedef_table, name, (void *)1);
 }
 
 int match_typedef_name()
 {
     if (!match_token(tIDENT)) return 0;
-    return map_lookup(typedef_table, peek_token()->sval) != NULL;
+    return map_lookup(ctx->typedef_table, peek_token()->sval) != NULL;
 }
 
 Type *parse_typedef_name()
@@ -947,12 +945,14 @@ end:
 
 AST *parse_function_definition()
 {
+    Source *source = peek_token()->source;
     Type *type = type_int();
     if (match_declaration_specifiers()) type = parse_declaration_specifiers();
     AST *ast = parse_declarator(type);
     // TODO: K&R style params
     ast->body = parse_compound_stmt();
     ast->kind = AST_FUNCDEF;
+    ast->source = source;
     return ast;
 }
 
@@ -970,8 +970,11 @@ AST *parse_compound_stmt()
     expect_token(tLBRACE);
     while (!match_token(tRBRACE)) {
         AST *ast;
-        if (match_declaration())
+        if (match_declaration()) {
+            Source *source = peek_token()->source;
             ast = parse_declaration(AST_LVAR_DECL);
+            ast->source = source;
+        }
         else
             ast = parse_stmt();
         vector_push_back(stmts, ast);
@@ -1045,7 +1048,7 @@ AST *parse_labeled_stmt()
     return new_label_ast(label_name, stmt);
 }
 
-AST *parse_stmt()
+AST *parse_stmt_detail()
 {
     Token *token = peek_token();
 
@@ -1078,6 +1081,15 @@ AST *parse_stmt()
     return parse_expression_stmt();
 }
 
+// a statement, which remembers where it starts for -g.
+AST *parse_stmt()
+{
+    Source *source = peek_token()->source;
+    AST *ast = parse_stmt_detail();
+    ast->source = source;
+    return ast;
+}
+
 Vector *parse_prog(Vector *tokens)
 {
     Vector *asts;
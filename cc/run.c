@@ -0,0 +1,24 @@
+#include "cc.h"
+
+// Run the code in memory. It is assembled and loaded with the objects by
+// the same relocation as ld does, and its main is called directly instead of
+// through _start.
+int run_code(Vector *code, Vector *objfiles, Vector *args, char **envp)
+{
+    int size = 0;
+    char *data = assemble_code_to_bytes(code, &size);
+
+    Vector *objs = new_vector_from_scalar(new_object_data(data, size));
+    read_input_files(objs, objfiles);
+    int main_addr = load_objs(objs, "main");
+
+    // envp follows argv as _start leaves them on the stack.
+    int argc = vector_size(args), nenv = 0;
+    while (envp[nenv] != NULL) nenv++;
+    char **argv = safe_malloc(sizeof(char *) * (argc + nenv + 2));
+    for (int i = 0; i < argc; i++) argv[i] = vector_get(args, i);
+    argv[argc] = NULL;
+    for (int i = 0; i <= nenv; i++) argv[argc + 1 + i] = envp[i];
+
+    return call_main(main_addr, argc, argv);
+}
@@ -20,12 +20,33 @@ int isspace(int c)
     return 0;
 }
 
+int atoi(const char *str)
+{
+    int sign = 1, ret = 0;
+    while (isspace(*str)) str++;
+    if (*str == '-' || *str == '+') {
+        if (*str == '-') sign = -1;
+        str++;
+    }
+    while (isdigit(*str)) ret = ret * 10 + *str++ - '0';
+    return sign * ret;
+}
+
 void *memcpy(void *dst, const void *src, int n)
 {
     for (int i = 0; i < n; i++) *((char *)dst + i) = *((char *)src + i);
     return dst;
 }
 
+int memcmp(const void *s1, const void *s2, int n)
+{
+    for (int i = 0; i < n; i++) {
+        int c1 = *((char *)s1 + i) & 0xff, c2 = *((char *)s2 + i) & 0xff;
+        if (c1 != c2) return c1 - c2;
+    }
+    return 0;
+}
+
 char *strcpy(char *dst, const char *src)
 {
     char *ret = dst;
@@ -49,7 +70,11 @@ int strlen(const char *s)
 
 void *memset(void *s, int c, int n)
 {
-    for (int i = 0; i < n; i++) *((char *)s + i) = c;
+    int i = 0;
+    // clear 8 bytes at a time, which matters for large buffers like arenas.
+    if (c == 0)
+        for (; i + 8 <= n; i += 8) *(char **)((char *)s + i) = NULL;
+    for (; i < n; i++) *((char *)s + i) = c;
     return s;
 }
 
@@ -84,13 +109,15 @@ int vsprintf(char *str, const char *format, va_list ap)
                     break;
                 }
 
+                // keep ival negative so that INT_MIN can be printed.
+                int sign = 1;
                 if (ival < 0) {
                     *str++ = '-';
-                    ival *= -1;
+                    sign = -1;
                 }
 
                 int i = 0, buf[256];  // TODO: enough length?
-                for (; ival != 0; ival /= 10) buf[i++] = ival % 10;
+                for (; ival != 0; ival /= 10) buf[i++] = ival % 10 * sign;
                 while (--i >= 0) *str++ = '0' + buf[i];
             } break;
 
@@ -109,8 +136,8 @@ void *syscall(int number, ...);
 
 _Noreturn void exit(int status)
 {
-    // __NR_exit
-    syscall(60, status);
+    // __NR_exit_group, which ends the other threads too.
+    syscall(231, status);
 }
 
 void *brk(void *addr)
@@ -211,6 +238,13 @@ int fgetc(FILE *stream)
     return buf[0] & 0xff;
 }
 
+int fwrite(const void *ptr, int size, int nmemb, FILE *stream)
+{
+    int res = write(stream->fd, ptr, size * nmemb);
+    if (res < 0) return 0;
+    return res / size;
+}
+
 int fprintf(FILE *stream, const char *format, ...)
 {
     char buf[512];  // TODO: enough length?
@@ -244,3 +278,38 @@ void assert(int cond)
     printf("[ASSERT] %d\n", cond);
     exit(EXIT_FAILURE);
 }
+
+int clone_thread(int flags, void *stack, int *tid);
+
+#define THREAD_STACK_SIZE (1 << 20)
+
+// start a thread which calls thread_main(arg), which the program defines like
+// main. The thread runs until the process exits. Return -1 on errors.
+int thread_create(void *arg)
+{
+    char *stack = malloc(THREAD_STACK_SIZE);
+    // clone_thread() in system.s pops arg from the top of the stack, which is
+    // then aligned to 16 bytes.
+    int top = ((int)stack + THREAD_STACK_SIZE) & ~15;
+    void **sp = (void **)(top - 8);
+    *sp = arg;
+
+    // CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |
+    // CLONE_SYSVSEM
+    if (clone_thread(0x50f00, sp, NULL) < 0) return -1;
+    return 0;
+}
+
+// sleep while *addr is val. It may return for other reasons, so the caller
+// checks *addr again.
+void futex_wait(int *addr, int val)
+{
+    syscall(202, addr, 128, val, NULL);  // __NR_futex, FUTEX_WAIT_PRIVATE
+}
+
+// wake the threads sleeping on addr.
+void futex_wake(int *addr)
+{
+    // __NR_futex, FUTEX_WAKE_PRIVATE
+    syscall(202, addr, 129, 2147483647, NULL);
+}
@@ -4,7 +4,7 @@ syscall:
 	mov %rsi, %rdi
 	mov %rdx, %rsi
 	mov %rcx, %rdx
-	mov %r8, %rcx
+	mov %r8, %r10
 	mov %r9, %r8
 	mov 8(%rsp), %r9
 	syscall
@@ -16,5 +16,59 @@ _start:
 	lea 8(%rsp), %rsi
 	call main
 	mov %rax, %rdi
+	mov $231, %eax
+	syscall
+
+.global call_main
+call_main:
+	mov %edi, %eax
+	mov %esi, %edi
+	mov %rdx, %rsi
+	sub $8, %rsp
+	call *%rax
+	add $8, %rsp
+	ret
+
+.global setjmp
+setjmp:
+	mov %rbx, (%rdi)
+	mov %rbp, 8(%rdi)
+	mov %r12, 16(%rdi)
+	mov %r13, 24(%rdi)
+	mov %r14, 32(%rdi)
+	mov %r15, 40(%rdi)
+	lea 8(%rsp), %rdx
+	mov %rdx, 48(%rdi)
+	mov (%rsp), %rdx
+	mov %rdx, 56(%rdi)
+	mov $0, %eax
+	ret
+
+.global longjmp
+longjmp:
+	mov (%rdi), %rbx
+	mov 8(%rdi), %rbp
+	mov 16(%rdi), %r12
+	mov 24(%rdi), %r13
+	mov 32(%rdi), %r14
+	mov 40(%rdi), %r15
+	mov 48(%rdi), %rsp
+	mov 56(%rdi), %rdx
+	mov %esi, %eax
+	push %rdx
+	ret
+
+.global clone_thread
+clone_thread:
+	mov %rdx, %r10
+	mov $56, %eax
+	syscall
+	cmp $0, %rax
+	jne .clone_thread_parent
+	pop %rdi
+	call thread_main
+	mov $0, %rdi
 	mov $60, %eax
 	syscall
+.clone_thread_parent:
+	ret
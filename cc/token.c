@@ -23,49 +23,48 @@ TokenSeq *new_token_seq(Vector *tokens)
     return tokseq;
 }
 
-TokenSeq *tokenseq;
-
-void init_tokenseq(Vector *tokens) { tokenseq = new_token_seq(tokens); }
+void init_tokenseq(Vector *tokens) { ctx->tokenseq = new_token_seq(tokens); }
 
 void insert_tokens(Vector *tokens)
 {
     Vector *tmp = new_vector();
-    for (int i = 0; i < tokenseq->idx; i++)
-        vector_push_back(tmp, vector_get(tokenseq->tokens, i));
+    for (int i = 0; i < ctx->tokenseq->idx; i++)
+        vector_push_back(tmp, vector_get(ctx->tokenseq->tokens, i));
     for (int i = 0; i < vector_size(tokens); i++) {
         Token *token = vector_get(tokens, i);
         if (token->kind == tEOF) break;
         vector_push_back(tmp, token);
     }
-    for (int i = tokenseq->idx; i < vector_size(tokenseq->tokens); i++)
-        vector_push_back(tmp, vector_get(tokenseq->tokens, i));
-    tokenseq->tokens = tmp;
+    int size = vector_size(ctx->tokenseq->tokens);
+    for (int i = ctx->tokenseq->idx; i < size; i++)
+        vector_push_back(tmp, vector_get(ctx->tokenseq->tokens, i));
+    ctx->tokenseq->tokens = tmp;
 }
 
 Token *peek_token()
 {
-    Token *token = vector_get(tokenseq->tokens, tokenseq->idx);
+    Token *token = vector_get(ctx->tokenseq->tokens, ctx->tokenseq->idx);
     if (token == NULL) error("no next token.");
     return token;
 }
 
 Token *pop_token()
 {
-    Token *token = vector_get(tokenseq->tokens, tokenseq->idx++);
+    Token *token = vector_get(ctx->tokenseq->tokens, ctx->tokenseq->idx++);
     if (token == NULL) error("no next token.");
     return token;
 }
 
 Token *expect_token(int kind)
 {
-    Token *token = pop_token(tokenseq);
+    Token *token = pop_token(ctx->tokenseq);
     if (token->kind != kind) error_unexpected_token_kind(kind, token);
     return token;
 }
 
 int match_token(int kind)
 {
-    Token *token = peek_token(tokenseq);
+    Token *token = peek_token(ctx->tokenseq);
     return token->kind == kind;
 }
 
@@ -77,11 +76,11 @@ Token *pop_token_if(int kind)
 
 int match_token2(int kind0, int kind1)
 {
-    Token *token = peek_token(tokenseq);
+    Token *token = peek_token(ctx->tokenseq);
     if (token->kind != kind0) return 0;
-    tokenseq->idx++;
-    token = peek_token(tokenseq);
-    tokenseq->idx--;
+    ctx->tokenseq->idx++;
+    token = peek_token(ctx->tokenseq);
+    ctx->tokenseq->idx--;
     if (token->kind != kind1) return 0;
     return 1;
 }
@@ -90,11 +89,63 @@ TokenSeqSaved *new_token_seq_saved()
 {
     TokenSeqSaved *tokseqsav;
     tokseqsav = (TokenSeqSaved *)safe_malloc(sizeof(TokenSeqSaved));
-    tokseqsav->idx = tokenseq->idx;
+    tokseqsav->idx = ctx->tokenseq->idx;
     return tokseqsav;
 }
 
 void restore_token_seq_saved(TokenSeqSaved *saved)
 {
-    tokenseq->idx = saved->idx;
+    ctx->tokenseq->idx = saved->idx;
+}
+
+static void append_bytes(StringBuilder *sb, char *src, int size)
+{
+    for (int i = 0; i < size; i++) string_builder_append(sb, src[i]);
+}
+
+static void append_str(StringBuilder *sb, char *src)
+{
+    append_bytes(sb, src, strlen(src));
+}
+
+// write tokens one per line as its kind and value. The output is not C, but
+// two token streams compile to the same code iff their dumps are the same.
+// With -g the objects have the lines of the tokens, so the line follows each
+// token, and the file does too where it changes.
+void dump_tokens(Vector *tokens, FILE *fh)
+{
+    StringBuilder *sb = new_string_builder();
+    char *filepath = NULL;
+    for (int i = 0; i < vector_size(tokens); i++) {
+        Token *token = (Token *)vector_get(tokens, i);
+        append_str(sb, format("%d", token->kind));
+        if (ctx->debug_info && token->source != NULL) {
+            Source *source = token->source;
+            append_str(sb, format(" @%d", source->line));
+            if (filepath == NULL || strcmp(filepath, source->filepath) != 0) {
+                filepath = source->filepath;
+                string_builder_append(sb, ' ');
+                append_str(sb, filepath);
+            }
+        }
+        switch (token->kind) {
+            case tINT:
+                append_str(sb, format(" %d", token->ival));
+                break;
+
+            case tSTRING_LITERAL:
+                // may contain new-line and null characters.
+                append_str(sb, format(" %d:", token->ssize));
+                append_bytes(sb, token->sval, token->ssize);
+                break;
+
+            case tIDENT:
+                string_builder_append(sb, ' ');
+                append_str(sb, token->sval);
+                break;
+        }
+        string_builder_append(sb, '\n');
+    }
+    // string_builder_size() counts the terminating null character.
+    fwrite(string_builder_get(sb), 1, string_builder_size(sb) - 1, fh);
 }
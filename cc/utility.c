@@ -7,6 +7,13 @@ _Noreturn void error(const char *msg, ...)
     char *str = vformat(msg, args);
     va_end(args);
 
+    // an embedder of aqcc_compile() gets the message instead of exit.
+    if (ctx != NULL && ctx->catch_errors) {
+        ctx->catch_errors = 0;
+        ctx->error_message = str;
+        longjmp(ctx->error_jmp, 1);
+    }
+
     // fprintf(stderr, "[ERROR] %s\n", str);
     printf("[ERROR] %s\n", str);
     // fprintf(stderr, "[DEBUG] %s, %d\n", __FILE__, __LINE__);
@@ -43,6 +50,7 @@ void *safe_malloc(int size)
 {
     void *ptr;
 
+    if (ctx != NULL) return arena_alloc(ctx->arena, size);
     ptr = malloc(size);
     if (ptr == NULL) error("malloc failed.");
     return ptr;
@@ -115,7 +123,7 @@ char *escape_string(char *str, int size)
 
             case '\r':
                 string_builder_append(sb, '\\');
-                string_builder_append(sb, 'n');
+                string_builder_append(sb, 'r');
                 break;
 
             case '\t':
@@ -153,6 +161,11 @@ char *escape_string(char *str, int size)
                 string_builder_append(sb, '"');
                 break;
 
+            case '\\':
+                string_builder_append(sb, '\\');
+                string_builder_append(sb, '\\');
+                break;
+
             default:
                 string_builder_append(sb, ch);
                 break;
@@ -164,8 +177,7 @@ char *escape_string(char *str, int size)
 
 char *make_label_string()
 {
-    static int count;
-    return format(".L%d", count++);
+    return format(".L%d", ctx->label_count++);
 }
 
 int min(int a, int b) { return a < b ? a : b; }
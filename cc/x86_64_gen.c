@@ -1,5 +1,7 @@
 #include "cc.h"
 
+// Code is passed to the assembler in ../as as it is for cc -c,
+// so these definitions must be the same as ../as/as.h.
 enum {
     REG_8 = 1 << 5,
     REG_AL = 0 | REG_8,
@@ -68,6 +70,7 @@ enum {
     REG_R15,
     REG_RBP,
     REG_RSP,
+    REG_RBX,  // only saved and restored by setjmp/longjmp in cc
 
     REG_RIP,
 
@@ -77,22 +80,48 @@ enum {
     INST_MOVSBL,
     INST_MOVSLQ,
     INST_MOVZB,
+    INST_MOVZW,
+    INST_MOVSBQ,
+    INST_MOVSW,
     INST_LEA,
     INST_PUSH,
     INST_POP,
     INST_ADD,
     INST_ADDQ,
     INST_SUB,
+    INST_ADC,
+    INST_SBB,
+    INST_MUL,
     INST_IMUL,
+    INST_DIV,
     INST_IDIV,
     INST_SAR,
     INST_SAL,
+    INST_SHR,
     INST_NEG,
     INST_NOT,
     INST_CMP,
+    INST_TEST,
     INST_SETL,
     INST_SETLE,
     INST_SETE,
+    INST_SETNE,
+    INST_SETG,
+    INST_SETGE,
+    INST_SETB,
+    INST_SETBE,
+    INST_SETA,
+    INST_SETAE,
+    INST_CMOVE,
+    INST_CMOVNE,
+    INST_CMOVL,
+    INST_CMOVLE,
+    INST_CMOVG,
+    INST_CMOVGE,
+    INST_CMOVB,
+    INST_CMOVBE,
+    INST_CMOVA,
+    INST_CMOVAE,
     INST_AND,
     INST_XOR,
     INST_OR,
@@ -103,7 +132,16 @@ enum {
     INST_JE,
     INST_JNE,
     INST_JAE,
+    INST_JGE,
+    INST_JB,
+    INST_JL,
+    INST_JLE,
+    INST_JG,
+    INST_JBE,
+    INST_JA,
     INST_LABEL,
+    INST_INC,
+    INST_DEC,
     INST_INCL,
     INST_INCQ,
     INST_DECL,
@@ -124,6 +162,8 @@ enum {
     CD_BYTE,
     CD_QUAD,
     CD_ASCII,
+    CD_FILE,  // .file ival "sval"
+    CD_LOC,   // .loc lhs rhs, whose values are the file and the line
 
     CD_COMMENT,
 
@@ -139,6 +179,8 @@ struct Code {
 
     Code *lhs, *rhs;
     int ival;
+    // CD_ADDR_OF: ival(lhs, rhs, scale) where rhs is the index register.
+    int scale;
     char *sval;  // size is ival
     char *label;
     Vector *read_dep;
@@ -151,6 +193,7 @@ static Code *new_code(int kind)
     code->kind = kind;
     code->lhs = code->rhs = NULL;
     code->ival = 0;
+    code->scale = 1;
     code->sval = NULL;
     code->label = NULL;
     code->read_dep = new_vector();
@@ -200,14 +243,23 @@ static Code *new_addrof_code(Code *reg, int offset)
     return code;
 }
 
-static int is_register_code(Code *code)
+static Code *new_addrof_index_code(Code *reg, Code *index, int scale,
+                                   int offset)
+{
+    Code *code = new_addrof_code(reg, offset);
+    code->rhs = index;
+    code->scale = scale;
+    return code;
+}
+
+int is_register_code(Code *code)
 {
     if (code == NULL) return 0;
     return !(code->kind & INST_) &&
            code->kind & (REG_8 | REG_16 | REG_32 | REG_64);
 }
 
-static int reg_of_nbyte(int nbyte, int reg)
+int reg_of_nbyte(int nbyte, int reg)
 {
     switch (nbyte) {
         case 1:
@@ -336,6 +388,9 @@ static Code *IMUL(Code *lhs, Code *rhs)
     return new_binop_code(INST_IMUL, lhs, rhs);
 }
 
+// one-operand imul: edx:eax = eax * lhs
+static Code *IMUL1(Code *lhs) { return new_unary_code(INST_IMUL, lhs); }
+
 static Code *IDIV(Code *lhs) { return new_unary_code(INST_IDIV, lhs); }
 
 static Code *SAR(Code *lhs, Code *rhs)
@@ -348,6 +403,11 @@ static Code *SAL(Code *lhs, Code *rhs)
     return new_binop_code(INST_SAL, lhs, rhs);
 }
 
+static Code *SHR(Code *lhs, Code *rhs)
+{
+    return new_binop_code(INST_SHR, lhs, rhs);
+}
+
 static Code *NEG(Code *lhs) { return new_unary_code(INST_NEG, lhs); }
 
 static Code *NOT(Code *lhs) { return new_unary_code(INST_NOT, lhs); }
@@ -405,6 +465,13 @@ static Code *JNE(char *label)
     return code;
 }
 
+static Code *JMP_INDIRECT(Code *mem)
+{
+    Code *code = new_code(INST_JMP);
+    code->lhs = mem;
+    return code;
+}
+
 static Code *JAE(char *label)
 {
     Code *code = new_code(INST_JAE);
@@ -412,6 +479,13 @@ static Code *JAE(char *label)
     return code;
 }
 
+static Code *JL(char *label)
+{
+    Code *code = new_code(INST_JL);
+    code->label = label;
+    return code;
+}
+
 static Code *LABEL(char *label)
 {
     Code *code = new_code(INST_LABEL);
@@ -582,6 +656,8 @@ static char *code2str(Code *code)
             return "%rbp";
         case REG_RSP:
             return "%rsp";
+        case REG_RBX:
+            return "%rbx";
 
         case REG_RIP:
             return "%rip";
@@ -629,6 +705,8 @@ static char *code2str(Code *code)
                           code2str(code->rhs));
 
         case INST_IMUL:
+            if (code->rhs == NULL)
+                return format("imul %s", code2str(code->lhs));
             return format("imul %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
@@ -643,6 +721,10 @@ static char *code2str(Code *code)
             return format("sal %s, %s", code2str(code->lhs),
                           code2str(code->rhs));
 
+        case INST_SHR:
+            return format("shr %s, %s", code2str(code->lhs),
+                          code2str(code->rhs));
+
         case INST_NEG:
             return format("neg %s", code2str(code->lhs));
 
@@ -684,6 +766,8 @@ static char *code2str(Code *code)
             return "cltq";
 
         case INST_JMP:
+            if (code->lhs != NULL)
+                return format("jmp *%s", code2str(code->lhs));
             return format("jmp %s", code->label);
 
         case INST_JE:
@@ -695,6 +779,27 @@ static char *code2str(Code *code)
         case INST_JAE:
             return format("jae %s", code->label);
 
+        case INST_JGE:
+            return format("jge %s", code->label);
+
+        case INST_JB:
+            return format("jb %s", code->label);
+
+        case INST_JL:
+            return format("jl %s", code->label);
+
+        case INST_JLE:
+            return format("jle %s", code->label);
+
+        case INST_JG:
+            return format("jg %s", code->label);
+
+        case INST_JBE:
+            return format("jbe %s", code->label);
+
+        case INST_JA:
+            return format("ja %s", code->label);
+
         case INST_LABEL:
             return format("%s:", code->label);
 
@@ -726,6 +831,12 @@ static char *code2str(Code *code)
             return format("$%d", code->ival);
 
         case CD_ADDR_OF:
+            if (code->rhs != NULL) {
+                char *mem = format("(%s,%s,%d)", code2str(code->lhs),
+                                   code2str(code->rhs), code->scale);
+                if (code->ival == 0) return mem;
+                return format("%d%s", code->ival, mem);
+            }
             if (code->ival == 0) return format("(%s)", code2str(code->lhs));
             return format("%d(%s)", code->ival, code2str(code->lhs));
 
@@ -751,11 +862,19 @@ static char *code2str(Code *code)
             return format(".byte %d", code->ival);
 
         case CD_QUAD:
+            if (code->label != NULL) return format(".quad %s", code->label);
             return format(".quad %d", code->ival);
 
         case CD_ASCII:
             return format(".ascii \"%s\"",
                           escape_string(code->sval, code->ival));
+
+        case CD_FILE:
+            return format(".file %d \"%s\"", code->ival,
+                          escape_string(code->sval, strlen(code->sval)));
+
+        case CD_LOC:
+            return format(".loc %d %d", code->lhs->ival, code->rhs->ival);
     }
     warn(format("code.c %d", code->kind));
     assert(0);
@@ -779,22 +898,25 @@ static Code *addrof(Code *reg, int offset)
     return new_addrof_code(reg, offset);
 }
 
-static int temp_reg_table;
+static Code *addrof_index(Code *reg, Code *index, int scale, int offset)
+{
+    return new_addrof_index_code(reg, index, scale, offset);
+}
 
-static void init_temp_reg() { temp_reg_table = 0; }
+static void init_temp_reg() { ctx->temp_reg_table = 0; }
 
 static int get_temp_reg()
 {
     for (int i = 0; i < 6; i++) {
-        if (temp_reg_table & (1 << i)) continue;
-        temp_reg_table |= (1 << i);
+        if (ctx->temp_reg_table & (1 << i)) continue;
+        ctx->temp_reg_table |= (1 << i);
         return i + 7;  // corresponding to reg_name's index
     }
 
     error("no more register");
 }
 
-static void restore_temp_reg(int i) { temp_reg_table &= ~(1 << (i - 7)); }
+static void restore_temp_reg(int i) { ctx->temp_reg_table &= ~(1 << (i - 7)); }
 
 static const char *reg_name(int byte, int i)
 {
@@ -891,40 +1013,41 @@ static int lookup_member_offset(Vector *members, char *member)
     return -1;
 }
 
-typedef struct {
+struct CodeEnv {
     char *continue_label, *break_label;
     int reg_save_area_stack_idx, overflow_arg_area_stack_idx;
     Vector *code;
-} CodeEnv;
-CodeEnv *codeenv;
+};
 
-#define SAVE_BREAK_CXT char *break_cxt__org_break_label = codeenv->break_label;
-#define RESTORE_BREAK_CXT codeenv->break_label = break_cxt__org_break_label;
+#define SAVE_BREAK_CXT \
+    char *break_cxt__org_break_label = ctx->codeenv->break_label;
+#define RESTORE_BREAK_CXT \
+    ctx->codeenv->break_label = break_cxt__org_break_label;
 #define SAVE_CONTINUE_CXT \
-    char *continue_cxt__org_continue_label = codeenv->continue_label;
+    char *continue_cxt__org_continue_label = ctx->codeenv->continue_label;
 #define RESTORE_CONTINUE_CXT \
-    codeenv->continue_label = continue_cxt__org_continue_label;
+    ctx->codeenv->continue_label = continue_cxt__org_continue_label;
 #define SAVE_VARIADIC_CXT                                \
     int save_variadic_cxt__reg_save_area_stack_idx =     \
-            codeenv->reg_save_area_stack_idx,            \
+            ctx->codeenv->reg_save_area_stack_idx,       \
         save_variadic_cxt__overflow_arg_area_stack_idx = \
-            codeenv->overflow_arg_area_stack_idx;
+            ctx->codeenv->overflow_arg_area_stack_idx;
 
-#define RESTORE_VARIADIC_CXT                        \
-    codeenv->reg_save_area_stack_idx =              \
-        save_variadic_cxt__reg_save_area_stack_idx; \
-    codeenv->overflow_arg_area_stack_idx =          \
+#define RESTORE_VARIADIC_CXT                           \
+    ctx->codeenv->reg_save_area_stack_idx =            \
+        save_variadic_cxt__reg_save_area_stack_idx;    \
+    ctx->codeenv->overflow_arg_area_stack_idx =        \
         save_variadic_cxt__overflow_arg_area_stack_idx;
 
 static void init_code_env()
 {
-    codeenv = (CodeEnv *)safe_malloc(sizeof(CodeEnv));
-    codeenv->continue_label = codeenv->break_label = NULL;
-    codeenv->reg_save_area_stack_idx = 0;
-    codeenv->code = new_vector();
+    ctx->codeenv = (CodeEnv *)safe_malloc(sizeof(CodeEnv));
+    ctx->codeenv->continue_label = ctx->codeenv->break_label = NULL;
+    ctx->codeenv->reg_save_area_stack_idx = 0;
+    ctx->codeenv->code = new_vector();
 }
 
-static void appcode(Code *code) { vector_push_back(codeenv->code, code); }
+static void appcode(Code *code) { vector_push_back(ctx->codeenv->code, code); }
 
 static void appcomment(char *str)
 {
@@ -935,8 +1058,8 @@ static void appcomment(char *str)
 
 static Code *last_appended_code()
 {
-    for (int i = vector_size(codeenv->code) - 1; i >= 0; i--) {
-        Code *str = vector_get(codeenv->code, i);
+    for (int i = vector_size(ctx->codeenv->code) - 1; i >= 0; i--) {
+        Code *str = vector_get(ctx->codeenv->code, i);
         if (str) return str;
     }
 
@@ -1374,6 +1497,31 @@ static void generate_funcdef_return_marker()
     appcode(new_code(MRK_FUNCDEF_RETURN));
 }
 
+// .loc of source for -g unless the last one in the function is of the same
+// line, preceded by .file when its file appears first.
+static void generate_loc(Source *source)
+{
+    if (!ctx->debug_info || source == NULL) return;
+    Source *last = ctx->last_loc;
+    if (last != NULL && last->line == source->line &&
+        strcmp(last->filepath, source->filepath) == 0)
+        return;
+    ctx->last_loc = source;
+
+    if (ctx->loc_files == NULL) ctx->loc_files = new_map();
+    KeyValue *kv = map_lookup(ctx->loc_files, source->filepath);
+    int file = kv == NULL ? 0 : (int)kv_value(kv);
+    if (file == 0) {
+        file = map_size(ctx->loc_files) + 1;
+        map_insert(ctx->loc_files, source->filepath, (void *)file);
+        Code *code = new_code(CD_FILE);
+        code->ival = file;
+        code->sval = source->filepath;
+        appcode(code);
+    }
+    appcode(new_binop_code(CD_LOC, value(file), value(source->line)));
+}
+
 static void generate_mov_mem_reg(int nbyte, int src_reg, int dst_reg)
 {
     switch (nbyte) {
@@ -1391,8 +1539,364 @@ static void generate_mov_mem_reg(int nbyte, int src_reg, int dst_reg)
     }
 }
 
+static int is_unsigned_less_than(int lhs, int rhs)
+{
+    // compare lhs and rhs as if they were unsigned int.
+    int sign_bit = -2147483647 - 1;
+    return (lhs ^ sign_bit) < (rhs ^ sign_bit);
+}
+
+// calculate the magic number M and the shift amount for signed division by
+// d (d >= 3 and not a power of 2) i.e. x / d == hi32(M * x) >> shift
+// (plus corrections). See Hacker's Delight, 10-4.
+// Values regarded as unsigned are held in int.
+static int calc_div_magic(int d, int *shift)
+{
+    // 2^31 = INT_MAX + 1
+    int int_max = 2147483647;
+    int two31_rem_d = (int_max % d + 1) % d;
+    int anc = int_max - two31_rem_d;
+
+    // q1 = 2^31 / anc, r1 = 2^31 % anc
+    int q1 = int_max / anc, r1 = int_max - q1 * anc + 1;
+    if (r1 == anc) {
+        q1++;
+        r1 = 0;
+    }
+    // q2 = 2^31 / d, r2 = 2^31 % d
+    int q2 = int_max / d, r2 = two31_rem_d;
+
+    int p = 31, delta;
+    do {
+        p++;
+        q1 = 2 * q1;
+        r1 = 2 * r1;
+        if (!is_unsigned_less_than(r1, anc)) {
+            q1++;
+            r1 = r1 - anc;
+        }
+        q2 = 2 * q2;
+        r2 = 2 * r2;
+        if (!is_unsigned_less_than(r2, d)) {
+            q2++;
+            r2 = r2 - d;
+        }
+        delta = d - r2;
+    } while (is_unsigned_less_than(q1, delta) || (q1 == delta && r1 == 0));
+
+    *shift = p - 32;
+    return q2 + 1;
+}
+
+static int log2_if_power_of_two(int n)
+{
+    if (n <= 0 || (n & (n - 1))) return -1;
+    int k = 0;
+    while ((1 << k) != n) k++;
+    return k;
+}
+
+static int can_divide_by_constant(AST *ast)
+{
+    if (ast->type->nbytes != 4 || ast->rhs->kind != AST_INT) return 0;
+    int d = ast->rhs->ival;
+    return d != 0 && d != -2147483647 - 1;
+}
+
+// replace reg with reg / d (or reg % d if is_rem) without idiv.
+static void generate_div_by_constant(int reg, int d, int is_rem)
+{
+    int ad = d < 0 ? -d : d;
+    Code *x = nbyte_reg(4, reg);
+
+    if (ad == 1) {
+        if (is_rem)
+            appcode(MOV(value(0), x));
+        else if (d < 0)
+            appcode(NEG(x));
+        return;
+    }
+
+    int k = log2_if_power_of_two(ad);
+    if (k != -1) {
+        // bias = x < 0 ? ad - 1 : 0
+        appcode(MOV(x, EAX()));
+        if (k != 1) appcode(SAR(value(31), EAX()));
+        appcode(SHR(value(32 - k), EAX()));
+        if (is_rem) {
+            // x - ((x + bias) & -ad)
+            appcode(ADD(x, EAX()));
+            appcode(AND(value(-ad), EAX()));
+            appcode(SUB(EAX(), x));
+        }
+        else {
+            // (x + bias) >> k
+            appcode(ADD(EAX(), x));
+            appcode(SAR(value(k), x));
+            if (d < 0) appcode(NEG(x));
+        }
+        return;
+    }
+
+    int shift, magic = calc_div_magic(ad, &shift);
+    appcode(MOV(value(magic), EAX()));
+    appcode(IMUL1(x));
+    add_read_dep(EAX());
+    // magic is regarded as unsigned, so correct the signed product.
+    if (magic < 0) appcode(ADD(x, EDX()));
+    if (shift > 0) appcode(SAR(value(shift), EDX()));
+    // add 1 if negative
+    appcode(MOV(EDX(), EAX()));
+    appcode(SHR(value(31), EAX()));
+    appcode(ADD(EAX(), EDX()));
+    if (is_rem) {
+        appcode(IMUL(value(ad), EDX()));
+        appcode(SUB(EDX(), x));
+    }
+    else {
+        if (d < 0) appcode(NEG(EDX()));
+        appcode(MOV(EDX(), x));
+    }
+}
+
+static int is_sib_scale(int scale)
+{
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+static int switch_case_value(Vector *cases, int i)
+{
+    SwitchCase *cas = (SwitchCase *)vector_get(cases, i);
+    assert(cas->cond->kind == AST_INT);
+    return cas->cond->ival;
+}
+
+static char *switch_case_label(Vector *cases, int i)
+{
+    return ((SwitchCase *)vector_get(cases, i))->label_name;
+}
+
+// return a copy of cases sorted by their values.
+static Vector *sort_switch_cases(Vector *cases)
+{
+    Vector *sorted = clone_vector(cases);
+    for (int i = 1; i < vector_size(sorted); i++) {
+        SwitchCase *cas = (SwitchCase *)vector_get(sorted, i);
+        int j = i;
+        for (; j > 0 && switch_case_value(sorted, j - 1) > cas->cond->ival;
+             j--)
+            vector_set(sorted, j, vector_get(sorted, j - 1));
+        vector_set(sorted, j, cas);
+    }
+    return sorted;
+}
+
+static void generate_switch_linear(int nbytes, int reg, Vector *cases, int lo,
+                                   int hi, char *default_label)
+{
+    for (int i = lo; i < hi; i++) {
+        appcode(CMP(value(switch_case_value(cases, i)),
+                    nbyte_reg(nbytes, reg)));
+        appcode(JE(switch_case_label(cases, i)));
+    }
+    appcode(JMP(default_label));
+}
+
+// jump through a table indexed by reg - vmin.
+static void generate_switch_table(int reg, Vector *cases, int lo, int hi,
+                                  char *default_label)
+{
+    int vmin = switch_case_value(cases, lo),
+        range = switch_case_value(cases, hi - 1) - vmin + 1;
+
+    // unsigned comparison checks both bounds at once.
+    appcode(MOV(nbyte_reg(4, reg), EAX()));
+    if (vmin != 0) appcode(SUB(value(vmin), EAX()));
+    appcode(CMP(value(range), EAX()));
+    appcode(JAE(default_label));
+
+    // upper half of rax has been cleared by the 32-bit operations.
+    char *table_label = make_label_string();
+    int table_reg = get_temp_reg();
+    appcode(LEA(addrof_label(RIP(), table_label), nbyte_reg(8, table_reg)));
+    appcode(JMP_INDIRECT(addrof_index(nbyte_reg(8, table_reg), RAX(), 8, 0)));
+    restore_temp_reg(table_reg);
+
+    appcode(new_code(CD_DATA));
+    appcode(LABEL(table_label));
+    for (int v = vmin, i = lo; i < hi; v++) {
+        Code *code = new_code(CD_QUAD);
+        if (switch_case_value(cases, i) == v)
+            code->label = switch_case_label(cases, i++);
+        else
+            code->label = default_label;
+        appcode(code);
+    }
+    appcode(new_code(CD_TEXT));
+}
+
+// dispatch on the sorted cases[lo, hi). Dense case sets are lowered to
+// a jump table, and sparse ones to a balanced compare tree.
+static void generate_switch_dispatch(int reg, Vector *cases, int lo, int hi,
+                                     char *default_label)
+{
+    int n = hi - lo;
+    if (n <= 3) {
+        generate_switch_linear(4, reg, cases, lo, hi, default_label);
+        return;
+    }
+
+    // diff may overflow when the values are far apart.
+    int diff = switch_case_value(cases, hi - 1) - switch_case_value(cases, lo);
+    if (0 <= diff && diff < 3 * n) {
+        generate_switch_table(reg, cases, lo, hi, default_label);
+        return;
+    }
+
+    int mid = lo + n / 2;
+    char *left_label = make_label_string();
+    appcode(CMP(value(switch_case_value(cases, mid)), nbyte_reg(4, reg)));
+    appcode(JL(left_label));
+    generate_switch_dispatch(reg, cases, mid, hi, default_label);
+    appcode(LABEL(left_label));
+    generate_switch_dispatch(reg, cases, lo, mid, default_label);
+}
+
+static int x86_64_generate_code_detail(AST *ast);
+
+static Code *new_jcc_code(int kind, char *label)
+{
+    Code *code = new_code(kind);
+    code->label = label;
+    return code;
+}
+
+// jcc taken when the condition of kind is false.
+static int negate_jcc(int kind)
+{
+    switch (kind) {
+        case INST_JE:
+            return INST_JNE;
+        case INST_JNE:
+            return INST_JE;
+        case INST_JL:
+            return INST_JGE;
+        case INST_JGE:
+            return INST_JL;
+        case INST_JLE:
+            return INST_JG;
+        case INST_JG:
+            return INST_JLE;
+    }
+    assert(0);
+}
+
+// jcc for the same condition with lhs and rhs swapped.
+static int swap_jcc_operands(int kind)
+{
+    switch (kind) {
+        case INST_JE:
+        case INST_JNE:
+            return kind;
+        case INST_JL:
+            return INST_JG;
+        case INST_JG:
+            return INST_JL;
+        case INST_JLE:
+            return INST_JGE;
+        case INST_JGE:
+            return INST_JLE;
+    }
+    assert(0);
+}
+
+static int is_int_ast(AST *ast, int ival)
+{
+    return ast->kind == AST_INT && ast->ival == ival;
+}
+
+// jump to label if the truth value of cond equals jump_if_true. Otherwise
+// fall through. Comparisons branch on their own flags and && and || are
+// lowered to control flow, so no 0/1 value is materialized.
+static void generate_cond_jump(AST *cond, int jump_if_true, char *label)
+{
+    switch (cond->kind) {
+        case AST_INT:
+            if ((cond->ival != 0) == jump_if_true) appcode(JMP(label));
+            return;
+
+        case AST_LAND:
+        case AST_LOR: {
+            // a && b jumps if true only when both are true, and
+            // a || b jumps if false only when both are false.
+            int is_and = cond->kind == AST_LAND;
+            if (is_and != jump_if_true) {
+                generate_cond_jump(cond->lhs, jump_if_true, label);
+                generate_cond_jump(cond->rhs, jump_if_true, label);
+                return;
+            }
+            char *skip_label = make_label_string();
+            generate_cond_jump(cond->lhs, !jump_if_true, skip_label);
+            generate_cond_jump(cond->rhs, jump_if_true, label);
+            appcode(LABEL(skip_label));
+            return;
+        }
+
+        case AST_LT:
+        case AST_LTE:
+        case AST_EQ: {
+            // !x and x != y are analyzed as 0 == x and 0 == (x == y).
+            if (cond->kind == AST_EQ && is_int_ast(cond->lhs, 0)) {
+                generate_cond_jump(cond->rhs, !jump_if_true, label);
+                return;
+            }
+            if (cond->kind == AST_EQ && is_int_ast(cond->rhs, 0)) {
+                generate_cond_jump(cond->lhs, !jump_if_true, label);
+                return;
+            }
+
+            int kind = cond->kind == AST_LT
+                           ? INST_JL
+                           : cond->kind == AST_LTE ? INST_JLE : INST_JE;
+            AST *lhs = cond->lhs;
+            AST *rhs = cond->rhs;
+            if (lhs->kind == AST_INT && rhs->kind != AST_INT) {
+                lhs = cond->rhs;
+                rhs = cond->lhs;
+                kind = swap_jcc_operands(kind);
+            }
+
+            int nbytes = cond->type->nbytes;
+            int lreg = x86_64_generate_code_detail(lhs);
+            if (rhs->kind == AST_INT) {
+                appcode(CMP(value(rhs->ival), nbyte_reg(nbytes, lreg)));
+            }
+            else {
+                int rreg = x86_64_generate_code_detail(rhs);
+                appcode(
+                    CMP(nbyte_reg(nbytes, rreg), nbyte_reg(nbytes, lreg)));
+                restore_temp_reg(rreg);
+            }
+            restore_temp_reg(lreg);
+
+            if (!jump_if_true) kind = negate_jcc(kind);
+            appcode(new_jcc_code(kind, label));
+            return;
+        }
+    }
+
+    int reg = x86_64_generate_code_detail(cond);
+    appcode(CMP(value(0), nbyte_reg(max(4, cond->type->nbytes), reg)));
+    restore_temp_reg(reg);
+    appcode(jump_if_true ? JNE(label) : JE(label));
+}
+
 static int x86_64_generate_code_detail(AST *ast)
 {
+    // a function has its .loc after its label.
+    if (ast->source != NULL && ast->kind != AST_FUNCDEF)
+        generate_loc(ast->source);
+
     switch (ast->kind) {
         case AST_INT: {
             int reg = get_temp_reg();
@@ -1401,7 +1905,7 @@ static int x86_64_generate_code_detail(AST *ast)
         }
 
         case AST_RETURN: {
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             if (ast->lhs) {
                 int reg = x86_64_generate_code_detail(ast->lhs);
                 restore_temp_reg(reg);
@@ -1410,7 +1914,7 @@ static int x86_64_generate_code_detail(AST *ast)
             else {
                 appcode(MOV(value(0), RAX()));
             }
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             generate_funcdef_return_marker();
             appcode(MOV(RBP(), RSP()));
             appcode(POP(RBP()));
@@ -1419,6 +1923,19 @@ static int x86_64_generate_code_detail(AST *ast)
         }
 
         case AST_ADD: {
+            // int + ptr where the size fits in the scale of SIB
+            if (match_type2(ast->lhs, ast->rhs, TY_INT, TY_PTR) &&
+                is_sib_scale(ast->rhs->type->ptr_of->nbytes)) {
+                int lreg = x86_64_generate_code_detail(ast->lhs);
+                appcode(MOVSLQ(nbyte_reg(4, lreg), nbyte_reg(8, lreg)));
+                int rreg = x86_64_generate_code_detail(ast->rhs);
+                appcode(LEA(addrof_index(nbyte_reg(8, rreg), nbyte_reg(8, lreg),
+                                         ast->rhs->type->ptr_of->nbytes, 0),
+                            nbyte_reg(8, rreg)));
+                restore_temp_reg(lreg);
+                return rreg;
+            }
+
             int lreg = x86_64_generate_code_detail(ast->lhs),
                 rreg = x86_64_generate_code_detail(ast->rhs);
 
@@ -1442,6 +1959,18 @@ static int x86_64_generate_code_detail(AST *ast)
             int lreg = x86_64_generate_code_detail(ast->lhs),
                 rreg = x86_64_generate_code_detail(ast->rhs);
 
+            // ptr - int where the size fits in the scale of SIB
+            if (match_type2(ast->lhs, ast->rhs, TY_PTR, TY_INT) &&
+                is_sib_scale(ast->lhs->type->ptr_of->nbytes)) {
+                appcode(MOVSLQ(nbyte_reg(4, rreg), nbyte_reg(8, rreg)));
+                appcode(NEG(nbyte_reg(8, rreg)));
+                appcode(LEA(addrof_index(nbyte_reg(8, lreg), nbyte_reg(8, rreg),
+                                         ast->lhs->type->ptr_of->nbytes, 0),
+                            nbyte_reg(8, lreg)));
+                restore_temp_reg(rreg);
+                return lreg;
+            }
+
             // ptr - int
             // TODO: shift
             // TODO: long
@@ -1488,6 +2017,12 @@ static int x86_64_generate_code_detail(AST *ast)
         }
 
         case AST_DIV: {
+            if (can_divide_by_constant(ast)) {
+                int reg = x86_64_generate_code_detail(ast->lhs);
+                generate_div_by_constant(reg, ast->rhs->ival, 0);
+                return reg;
+            }
+
             int lreg = x86_64_generate_code_detail(ast->lhs),
                 rreg = x86_64_generate_code_detail(ast->rhs);
             appcode(MOV(nbyte_reg(ast->type->nbytes, lreg),
@@ -1501,6 +2036,12 @@ static int x86_64_generate_code_detail(AST *ast)
         }
 
         case AST_REM: {
+            if (can_divide_by_constant(ast)) {
+                int reg = x86_64_generate_code_detail(ast->lhs);
+                generate_div_by_constant(reg, ast->rhs->ival, 1);
+                return reg;
+            }
+
             int lreg = x86_64_generate_code_detail(ast->lhs),
                 rreg = x86_64_generate_code_detail(ast->rhs);
             appcode(MOV(nbyte_reg(ast->type->nbytes, lreg),
@@ -1603,68 +2144,19 @@ static int x86_64_generate_code_detail(AST *ast)
             return rreg;
         }
 
-        case AST_LAND: {
+        case AST_LAND:
+        case AST_LOR: {
             char *false_label = make_label_string(),
-                 *exit_label = make_label_string(),
-                 *beyond_label0 = make_label_string(),
-                 *beyond_label1 = make_label_string();
-            int lreg = x86_64_generate_code_detail(ast->lhs);
-            restore_temp_reg(lreg);
-            appcode(CMP(value(0), nbyte_reg(ast->type->nbytes, lreg)));
-
-            // JE(false_label)
-            appcode(JNE(beyond_label0));
-            appcode(JMP(false_label));
-            appcode(LABEL(beyond_label0));
-
-            // don't execute rhs expression if lhs is false.
-            int rreg = x86_64_generate_code_detail(ast->rhs);
-            Code *rreg_code = nbyte_reg(ast->type->nbytes, rreg);
-            appcode(CMP(value(0), rreg_code));
-
-            // JE(false_label)
-            appcode(JNE(beyond_label1));
-            appcode(JMP(false_label));
-            appcode(LABEL(beyond_label1));
-
-            appcode(MOV(value(1), rreg_code));
+                 *exit_label = make_label_string();
+            generate_cond_jump(ast, 0, false_label);
+            int reg = get_temp_reg();
+            Code *reg_code = nbyte_reg(ast->type->nbytes, reg);
+            appcode(MOV(value(1), reg_code));
             appcode(JMP(exit_label));
             appcode(LABEL(false_label));
-            appcode(MOV(value(0), rreg_code));
+            appcode(MOV(value(0), reg_code));
             appcode(LABEL(exit_label));
-            return rreg;
-        }
-
-        case AST_LOR: {
-            char *true_label = make_label_string(),
-                 *exit_label = make_label_string(),
-                 *beyond_label0 = make_label_string(),
-                 *beyond_label1 = make_label_string();
-            int lreg = x86_64_generate_code_detail(ast->lhs);
-            restore_temp_reg(lreg);
-            appcode(CMP(value(0), nbyte_reg(ast->type->nbytes, lreg)));
-
-            // JNE(true_label);
-            appcode(JE(beyond_label0));
-            appcode(JMP(true_label));
-            appcode(LABEL(beyond_label0));
-
-            // don't execute rhs expression if lhs is true.
-            int rreg = x86_64_generate_code_detail(ast->rhs);
-            Code *rreg_code = nbyte_reg(ast->type->nbytes, rreg);
-            appcode(CMP(value(0), rreg_code));
-
-            // JNE(true_label);
-            appcode(JE(beyond_label1));
-            appcode(JMP(true_label));
-            appcode(LABEL(beyond_label1));
-
-            appcode(CMP(value(0), rreg_code));
-            appcode(JMP(exit_label));
-            appcode(LABEL(true_label));
-            appcode(MOV(value(1), rreg_code));
-            appcode(LABEL(exit_label));
-            return rreg;
+            return reg;
         }
 
         case AST_FUNCDEF: {
@@ -1683,6 +2175,8 @@ static int x86_64_generate_code_detail(AST *ast)
             // generate code
             if (!ast->type->is_static) appcode(GLOBAL(ast->fname));
             appcode(LABEL(ast->fname));
+            ctx->last_loc = NULL;
+            generate_loc(ast->source);
             appcode(PUSH(RBP()));
             appcode(MOV(RSP(), RBP()));
             int needed_stack_size = roundup(-stack_idx, 16);
@@ -1712,13 +2206,13 @@ static int x86_64_generate_code_detail(AST *ast)
 
             // generate body
             SAVE_VARIADIC_CXT;
-            codeenv->reg_save_area_stack_idx = stack_idx;
-            codeenv->overflow_arg_area_stack_idx =
+            ctx->codeenv->reg_save_area_stack_idx = stack_idx;
+            ctx->codeenv->overflow_arg_area_stack_idx =
                 ast->params ? max(0, vector_size(ast->params) - 6) * 8 + 16
                             : -1;
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             x86_64_generate_code_detail(ast->body);
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             RESTORE_VARIADIC_CXT;
 
             if (ast->type->kind != TY_VOID) appcode(MOV(value(0), RAX()));
@@ -1785,7 +2279,8 @@ static int x86_64_generate_code_detail(AST *ast)
                 code->label = ast->fname;
                 appcode(code);
             }
-            appcode(ADD(value(8 * max(0, vector_size(ast->args) - 6)), RSP()));
+            if (vector_size(ast->args) > 6)
+                appcode(ADD(value(8 * (vector_size(ast->args) - 6)), RSP()));
             appcode(POP(R11()));
             appcode(POP(R10()));
             int reg = get_temp_reg();
@@ -1910,18 +2405,9 @@ static int x86_64_generate_code_detail(AST *ast)
 
         case AST_COND: {
             char *false_label = make_label_string(),
-                 *exit_label = make_label_string(),
-                 *beyond_label = make_label_string();
+                 *exit_label = make_label_string();
 
-            int cond_reg = x86_64_generate_code_detail(ast->cond);
-            restore_temp_reg(cond_reg);
-            appcode(MOV(nbyte_reg(8, cond_reg), RAX()));
-            appcode(CMP(value(0), EAX()));
-
-            // JE(false_label);
-            appcode(JNE(beyond_label));
-            appcode(JMP(false_label));
-            appcode(LABEL(beyond_label));
+            generate_cond_jump(ast->cond, 0, false_label);
 
             int then_reg = x86_64_generate_code_detail(ast->then);
             restore_temp_reg(then_reg);
@@ -1941,18 +2427,9 @@ static int x86_64_generate_code_detail(AST *ast)
 
         case AST_IF: {
             char *false_label = make_label_string(),
-                 *exit_label = make_label_string(),
-                 *beyond_label = make_label_string();
-
-            int cond_reg = x86_64_generate_code_detail(ast->cond);
-            restore_temp_reg(cond_reg);
-            appcode(MOV(nbyte_reg(8, cond_reg), RAX()));
-            appcode(CMP(value(0), EAX()));
+                 *exit_label = make_label_string();
 
-            // JE(false_label)
-            appcode(JNE(beyond_label));
-            appcode(JMP(false_label));
-            appcode(LABEL(beyond_label));
+            generate_cond_jump(ast->cond, 0, false_label);
 
             x86_64_generate_code_detail(ast->then);
             appcode(JMP(exit_label));
@@ -1964,28 +2441,24 @@ static int x86_64_generate_code_detail(AST *ast)
 
         case AST_SWITCH: {
             int target_reg = x86_64_generate_code_detail(ast->target);
-            restore_temp_reg(target_reg);
-
-            for (int i = 0; i < vector_size(ast->cases); i++) {
-                SwitchCase *cas = (SwitchCase *)vector_get(ast->cases, i);
-                assert(cas->cond->kind == AST_INT);
-                appcode(CMP(value(cas->cond->ival),
-                            nbyte_reg(ast->target->type->nbytes, target_reg)));
-                // case has been already labeled when analyzing.
-                // JE(cas->label_name)
-                char *beyond_label = make_label_string();
-                appcode(JNE(beyond_label));
-                appcode(JMP(cas->label_name));
-                appcode(LABEL(beyond_label));
-            }
             char *exit_label = make_label_string();
-            if (ast->default_label)
-                appcode(JMP(ast->default_label));
+            char *default_label =
+                ast->default_label ? ast->default_label : exit_label;
+
+            // case has been already labeled when analyzing.
+            if (ast->target->type->nbytes == 4)
+                generate_switch_dispatch(target_reg,
+                                         sort_switch_cases(ast->cases), 0,
+                                         vector_size(ast->cases),
+                                         default_label);
             else
-                appcode(JMP(exit_label));
+                generate_switch_linear(ast->target->type->nbytes, target_reg,
+                                       ast->cases, 0, vector_size(ast->cases),
+                                       default_label);
+            restore_temp_reg(target_reg);
 
             SAVE_BREAK_CXT;
-            codeenv->break_label = exit_label;
+            ctx->codeenv->break_label = exit_label;
             x86_64_generate_code_detail(ast->switch_body);
             appcode(LABEL(exit_label));
             RESTORE_BREAK_CXT;
@@ -1996,25 +2469,17 @@ static int x86_64_generate_code_detail(AST *ast)
         case AST_DOWHILE: {
             SAVE_BREAK_CXT;
             SAVE_CONTINUE_CXT;
-            codeenv->break_label = make_label_string();
-            codeenv->continue_label = make_label_string();
+            ctx->codeenv->break_label = make_label_string();
+            ctx->codeenv->continue_label = make_label_string();
             char *start_label = make_label_string();
 
             appcode(LABEL(start_label));
             x86_64_generate_code_detail(ast->then);
-            appcode(LABEL(codeenv->continue_label));
-            int cond_reg = x86_64_generate_code_detail(ast->cond);
-            appcode(
-                CMP(value(0), nbyte_reg(ast->cond->type->nbytes, cond_reg)));
-            // JNE(start_label)
-            char *beyond_label = make_label_string();
-            appcode(JE(beyond_label));
-            appcode(JMP(start_label));
-            appcode(LABEL(beyond_label));
-
-            appcode(LABEL(codeenv->break_label));
+            appcode(LABEL(ctx->codeenv->continue_label));
+            generate_loc(ast->source);
+            generate_cond_jump(ast->cond, 1, start_label);
+            appcode(LABEL(ctx->codeenv->break_label));
 
-            restore_temp_reg(cond_reg);
             RESTORE_BREAK_CXT;
             RESTORE_CONTINUE_CXT;
 
@@ -2024,8 +2489,8 @@ static int x86_64_generate_code_detail(AST *ast)
         case AST_FOR: {
             SAVE_BREAK_CXT;
             SAVE_CONTINUE_CXT;
-            codeenv->break_label = make_label_string();
-            codeenv->continue_label = make_label_string();
+            ctx->codeenv->break_label = make_label_string();
+            ctx->codeenv->continue_label = make_label_string();
             char *start_label = make_label_string();
 
             if (ast->initer != NULL) {
@@ -2033,25 +2498,17 @@ static int x86_64_generate_code_detail(AST *ast)
                 if (reg != -1) restore_temp_reg(reg);  // if expr
             }
             appcode(LABEL(start_label));
-            if (ast->midcond != NULL) {
-                int reg = x86_64_generate_code_detail(ast->midcond);
-                appcode(
-                    CMP(value(0), nbyte_reg(ast->midcond->type->nbytes, reg)));
-                // JE(codeenv->break_label)
-                char *beyond_label = make_label_string();
-                appcode(JNE(beyond_label));
-                appcode(JMP(codeenv->break_label));
-                appcode(LABEL(beyond_label));
-                restore_temp_reg(reg);
-            }
+            if (ast->midcond != NULL)
+                generate_cond_jump(ast->midcond, 0, ctx->codeenv->break_label);
             x86_64_generate_code_detail(ast->for_body);
-            appcode(LABEL(codeenv->continue_label));
+            appcode(LABEL(ctx->codeenv->continue_label));
+            generate_loc(ast->source);
             if (ast->iterer != NULL) {
                 int reg = x86_64_generate_code_detail(ast->iterer);
                 if (reg != -1) restore_temp_reg(reg);  // if nop
             }
             appcode(JMP(start_label));
-            appcode(LABEL(codeenv->break_label));
+            appcode(LABEL(ctx->codeenv->break_label));
 
             RESTORE_BREAK_CXT;
             RESTORE_CONTINUE_CXT;
@@ -2065,11 +2522,11 @@ static int x86_64_generate_code_detail(AST *ast)
             return -1;
 
         case AST_BREAK:
-            appcode(JMP(codeenv->break_label));
+            appcode(JMP(ctx->codeenv->break_label));
             return -1;
 
         case AST_CONTINUE:
-            appcode(JMP(codeenv->continue_label));
+            appcode(JMP(ctx->codeenv->continue_label));
             return -1;
 
         case AST_GOTO:
@@ -2083,7 +2540,7 @@ static int x86_64_generate_code_detail(AST *ast)
             assert(offset >= 0);
 
             int reg = x86_64_generate_code_detail(ast->stsrc);
-            appcode(ADD(value(offset), nbyte_reg(8, reg)));
+            appcode(LEA(addrof(nbyte_reg(8, reg), offset), nbyte_reg(8, reg)));
             return reg;
         }
 
@@ -2093,13 +2550,13 @@ static int x86_64_generate_code_detail(AST *ast)
             return -1;
 
         case AST_EXPR_STMT:
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             generate_basic_block_start_maker();
             if (ast->lhs != NULL) {
                 int reg = x86_64_generate_code_detail(ast->lhs);
                 if (reg != -1) restore_temp_reg(reg);
             }
-            assert(temp_reg_table == 0);
+            assert(ctx->temp_reg_table == 0);
             generate_basic_block_end_marker();
             return -1;
 
@@ -2147,11 +2604,11 @@ static int x86_64_generate_code_detail(AST *ast)
             assert(ast->rhs->kind == AST_INT);
             appcode(MOVL(value(ast->rhs->ival * 8), gp_offset));
             appcode(MOVL(value(48), fp_offset));
-            appcode(LEA(addrof(RBP(), codeenv->overflow_arg_area_stack_idx),
-                        RDI()));
-            appcode(MOV(RDI(), overflow_arg_area));
+            CodeEnv *env = ctx->codeenv;
             appcode(
-                LEA(addrof(RBP(), codeenv->reg_save_area_stack_idx), RDI()));
+                LEA(addrof(RBP(), env->overflow_arg_area_stack_idx), RDI()));
+            appcode(MOV(RDI(), overflow_arg_area));
+            appcode(LEA(addrof(RBP(), env->reg_save_area_stack_idx), RDI()));
             appcode(MOV(RDI(), reg_save_area));
             restore_temp_reg(reg);
             return -1;
@@ -2279,7 +2736,7 @@ Vector *x86_64_generate_code(Vector *asts)
         }
     }
 
-    return clone_vector(codeenv->code);
+    return clone_vector(ctx->codeenv->code);
 }
 
 static AST *x86_64_optimize_ast_constant_detail(AST *ast, Env *env)
@@ -2578,6 +3035,7 @@ static int get_using_register(Code *code)
         case REG_R15:
         case REG_RBP:
         case REG_RSP:
+        case REG_RBX:
         case REG_RIP:
             return code->kind;
         case CD_ADDR_OF:
@@ -2589,21 +3047,81 @@ static int get_using_register(Code *code)
     return -1;
 }
 
+static int get_index_register(Code *code)
+{
+    if (code == NULL || code->kind != CD_ADDR_OF) return -1;
+    return get_using_register(code->rhs);
+}
+
 static int is_addrof_code(Code *code)
 {
     if (code == NULL) return 0;
     return code->kind == CD_ADDR_OF || code->kind == CD_ADDR_OF_LABEL;
 }
 
-static int is_same_code(Code *lhs, Code *rhs)
+static int is_same_reg(Code *lhs, Code *rhs)
+{
+    if (!is_register_code(lhs) || !is_register_code(rhs)) return 0;
+    return reg_of_nbyte(8, lhs->kind) == reg_of_nbyte(8, rhs->kind);
+}
+
+static int is_reg_used_in_addrof(Code *mem, Code *reg)
+{
+    return is_same_reg(mem->lhs, reg) ||
+           (mem->kind == CD_ADDR_OF && is_same_reg(mem->rhs, reg));
+}
+
+// fold lea's address into the memory operand mem based on lea's register.
+// e.g. lea -8(%rbp,%r11,4), %r10 and 4(%r10) make -4(%rbp,%r11,4).
+// Returns NULL if it can't be folded.
+static Code *fold_lea_into_addrof(Code *lea, Code *mem)
+{
+    Code *reg = lea->rhs, *addr = lea->lhs;
+    if (mem->kind != CD_ADDR_OF || !is_same_reg(mem->lhs, reg)) return NULL;
+    if (mem->rhs != NULL && is_same_reg(mem->rhs, reg)) return NULL;
+
+    // %rip can't be used with index.
+    if (addr->kind == CD_ADDR_OF_LABEL) {
+        if (mem->rhs != NULL || mem->ival != 0) return NULL;
+        return addr;
+    }
+
+    if (mem->rhs == NULL)
+        return addrof_index(addr->lhs, addr->rhs, addr->scale,
+                            addr->ival + mem->ival);
+    if (addr->rhs != NULL) return NULL;
+    return addrof_index(addr->lhs, mem->rhs, mem->scale,
+                        addr->ival + mem->ival);
+}
+
+static int is_temp_reg_code(Code *code)
+{
+    if (!is_register_code(code)) return 0;
+    int reg = reg_of_nbyte(8, code->kind);
+    return REG_R10 <= reg && reg <= REG_R15;
+}
+
+static int is_reg_read_after(Vector *block, int index, Code *reg)
 {
-    if (lhs == NULL || rhs == NULL) return lhs == rhs;
-    if (lhs->kind != rhs->kind) return 0;
-    if (!is_same_code(lhs->lhs, rhs->lhs) || !is_same_code(lhs->rhs, rhs->rhs))
-        return 0;
-    if (lhs->ival != rhs->ival) return 0;
-    if (lhs->label != rhs->label) return 0;  // TODO: strcmp
-    return 1;
+    int reg64 = reg_of_nbyte(8, reg->kind);
+    for (int i = index; i < vector_size(block); i++) {
+        Code *code = (Code *)vector_get(block, i);
+        for (int j = 0; j < vector_size(code->read_dep); j++) {
+            Code *dep = vector_get(code->read_dep, j);
+            int dep_reg = get_using_register(dep);
+            if (dep_reg != -1 && reg_of_nbyte(8, dep_reg) == reg64) return 1;
+            dep_reg = get_index_register(dep);
+            if (dep_reg != -1 && reg_of_nbyte(8, dep_reg) == reg64) return 1;
+        }
+    }
+    return 0;
+}
+
+static void replace_read_dep(Code *code, Code *from, Code *to)
+{
+    for (int i = 0; i < vector_size(code->read_dep); i++)
+        if (vector_get(code->read_dep, i) == from)
+            vector_set(code->read_dep, i, to);
 }
 
 static Vector *x86_64_optimize_code_detail_propagation(Vector *block)
@@ -2615,17 +3133,49 @@ static Vector *x86_64_optimize_code_detail_propagation(Vector *block)
         switch (code->kind) {
             case INST_LEA:
                 // lea mem, reg
-                // mov val, (reg)
+                // mov (reg), val  or  mov val, (reg)
                 if (is_addrof_code(code->lhs) && is_register_code(code->rhs) &&
                     i != vector_size(block) - 1) {
                     Code *next_code = (Code *)vector_get(block, i + 1);
-                    if (next_code->kind == INST_MOV &&
+                    int is_load = 0, is_store = 0;
+                    if ((next_code->kind == INST_MOV ||
+                         next_code->kind == INST_MOVSBL ||
+                         next_code->kind == INST_LEA) &&
                         is_addrof_code(next_code->lhs) &&
-                        is_register_code(next_code->rhs)) {
-                        if (is_same_code(code->rhs, next_code->lhs->lhs)) {
-                            next_code->lhs = code->lhs;
-                            vector_set(next_code->read_dep, 0, code->lhs);
+                        is_register_code(next_code->rhs))
+                        is_load = 1;
+                    if (next_code->kind == INST_MOV &&
+                        is_register_code(next_code->lhs) &&
+                        is_addrof_code(next_code->rhs))
+                        is_store = 1;
+                    Code *folded = NULL;
+                    if (is_load)
+                        folded = fold_lea_into_addrof(code, next_code->lhs);
+                    if (is_store)
+                        folded = fold_lea_into_addrof(code, next_code->rhs);
+
+                    // If reg is overwritten by the next code or never read
+                    // later, lea is no longer needed after folding.
+                    // Otherwise lea should remain valid.
+                    // Temporary registers are dead at the end of the block.
+                    int is_dead =
+                        is_load && is_same_reg(code->rhs, next_code->rhs);
+                    if (is_temp_reg_code(code->rhs) &&
+                        !(is_store && is_same_reg(code->rhs, next_code->lhs)) &&
+                        !is_reg_read_after(block, i + 2, code->rhs))
+                        is_dead = 1;
+                    if (folded != NULL &&
+                        (is_dead ||
+                         !is_reg_used_in_addrof(code->lhs, code->rhs))) {
+                        if (is_load) {
+                            replace_read_dep(next_code, next_code->lhs, folded);
+                            next_code->lhs = folded;
                         }
+                        else {
+                            replace_read_dep(next_code, next_code->rhs, folded);
+                            next_code->rhs = folded;
+                        }
+                        if (is_dead) break;
                     }
                 }
                 vector_push_back(nblock, code);
@@ -2639,6 +3189,25 @@ static Vector *x86_64_optimize_code_detail_propagation(Vector *block)
     return nblock;
 }
 
+static int is_jump_code(Code *code)
+{
+    switch (code->kind) {
+        case INST_JMP:
+        case INST_JE:
+        case INST_JNE:
+        case INST_JAE:
+        case INST_JGE:
+        case INST_JB:
+        case INST_JL:
+        case INST_JLE:
+        case INST_JG:
+        case INST_JBE:
+        case INST_JA:
+            return 1;
+    }
+    return 0;
+}
+
 static Vector *x86_64_optimize_code_detail_eliminate(Vector *block)
 {
     Vector *nblock = new_vector();
@@ -2661,8 +3230,14 @@ static Vector *x86_64_optimize_code_detail_eliminate(Vector *block)
                 break;
         }
 
+        // any register may be read at the jump target.
+        if (is_jump_code(code)) used_reg_flag = -1;
+
         for (int i = 0; i < vector_size(code->read_dep); i++) {
-            int reg = get_using_register(vector_get(code->read_dep, i));
+            Code *dep = vector_get(code->read_dep, i);
+            int reg = get_using_register(dep);
+            if (reg != -1) used_reg_flag |= 1 << (reg & 31);
+            reg = get_index_register(dep);
             if (reg != -1) used_reg_flag |= 1 << (reg & 31);
         }
     }
@@ -2715,15 +3290,11 @@ static int x86_64_optimize_code_detail_funcdef(Vector *scode, int index,
         if (code->kind == MRK_FUNCDEF_RETURN) continue;
 
         // TODO: magic number
-        int reg = get_using_register(code->lhs);
-        if (reg != -1) {
-            if (reg_of_nbyte(8, reg) == REG_R12) used = max(used, 0);
-            if (reg_of_nbyte(8, reg) == REG_R13) used = max(used, 1);
-            if (reg_of_nbyte(8, reg) == REG_R14) used = max(used, 2);
-            if (reg_of_nbyte(8, reg) == REG_R15) used = max(used, 3);
-        }
-        reg = get_using_register(code->rhs);
-        if (reg != -1) {
+        for (int j = 0; j < 4; j++) {
+            Code *operand = j % 2 == 0 ? code->lhs : code->rhs;
+            int reg = j < 2 ? get_using_register(operand)
+                            : get_index_register(operand);
+            if (reg == -1) continue;
             if (reg_of_nbyte(8, reg) == REG_R12) used = max(used, 0);
             if (reg_of_nbyte(8, reg) == REG_R13) used = max(used, 1);
             if (reg_of_nbyte(8, reg) == REG_R14) used = max(used, 2);
@@ -2759,6 +3330,83 @@ static int x86_64_optimize_code_detail_funcdef(Vector *scode, int index,
     return end_index;
 }
 
+// Whether the flags set before scode[index] may be read by a later code.
+// Only the codes known to leave the flags unread are passed over, so any
+// other one e.g. jcc, setcc or one added later counts as a reader. cc never
+// reads the flags across labels, jumps or calls.
+static int are_flags_read(Vector *scode, int index)
+{
+    for (int i = index; i < vector_size(scode); i++) {
+        Code *code = vector_get(scode, i);
+        switch (code->kind) {
+            // set the flags without reading them, or end where cc reads them.
+            case INST_ADD:
+            case INST_ADDQ:
+            case INST_SUB:
+            case INST_IMUL:
+            case INST_NEG:
+            case INST_CMP:
+            case INST_AND:
+            case INST_XOR:
+            case INST_OR:
+            case INST_LABEL:
+            case INST_JMP:
+            case INST_CALL:
+            case INST_RET:
+                return 0;
+
+            // neither read nor set the flags. A shift by 0 and inc/dec keep
+            // some of them, so they don't end the search either.
+            case INST_MOV:
+            case INST_MOVL:
+            case INST_MOVSBL:
+            case INST_MOVSLQ:
+            case INST_MOVZB:
+            case INST_LEA:
+            case INST_PUSH:
+            case INST_POP:
+            case INST_IDIV:
+            case INST_SAR:
+            case INST_SAL:
+            case INST_SHR:
+            case INST_NOT:
+            case INST_CLTD:
+            case INST_CLTQ:
+            case INST_INCL:
+            case INST_INCQ:
+            case INST_DECL:
+            case INST_DECQ:
+            case INST_NOP:
+            case CD_COMMENT:
+            case MRK_BASIC_BLOCK_START:
+            case MRK_BASIC_BLOCK_END:
+            case MRK_FUNCDEF_START:
+            case MRK_FUNCDEF_END:
+            case MRK_FUNCDEF_RETURN:
+                break;
+
+            default:
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// mov $0, %reg -> xor %reg32, %reg32, which is shorter but clobbers the flags.
+static void x86_64_optimize_code_detail_zeroing(Vector *scode)
+{
+    for (int i = 0; i < vector_size(scode); i++) {
+        Code *code = vector_get(scode, i);
+        if (code->kind != INST_MOV || code->lhs->kind != CD_VALUE ||
+            code->lhs->ival != 0 || !is_register_code(code->rhs))
+            continue;
+        if (!(code->rhs->kind & (REG_32 | REG_64))) continue;
+        if (are_flags_read(scode, i + 1)) continue;
+        Code *reg = new_code(reg_of_nbyte(4, code->rhs->kind));
+        vector_set(scode, i, XOR(reg, reg));
+    }
+}
+
 Vector *x86_64_optimize_code(Vector *code)
 {
     Vector *ncode = new_vector();
@@ -2803,5 +3451,9 @@ Vector *x86_64_optimize_code(Vector *code)
                 break;
         }
     }
+
+    // after the elimination, because xor can't be eliminated.
+    x86_64_optimize_code_detail_zeroing(ncode);
+
     return ncode;
 }
@@ -0,0 +1,101 @@
+#ifndef AQCC_DRIVER_AQCC_H
+#define AQCC_DRIVER_AQCC_H
+
+//#include <assert.h>
+//#include <ctype.h>
+//#include <stdarg.h>
+//#include <stdio.h>
+//#include <stdlib.h>
+//#include <string.h>
+
+#ifdef __GNUC__
+typedef __builtin_va_list va_list;
+#else
+#endif
+#ifndef __GNUC__
+typedef struct {
+    int gp_offset;
+    int fp_offset;
+    void *overflow_arg_area;
+    void *reg_save_area;
+} va_list[1];
+#endif
+#define va_start __builtin_va_start
+#define va_end __builtin_va_end
+#define va_arg __builtin_va_arg
+
+typedef struct _IO_FILE FILE;
+// extern FILE *stdin;  /* Standard input stream.  */
+// extern FILE *stdout; /* Standard output stream.  */
+// extern FILE *stderr; /* Standard error output stream.  */
+#define NULL 0
+#define EOF (-1)
+FILE *fopen(const char *pathname, const char *mode);
+int fclose(FILE *stream);
+int fputc(int c, FILE *stream);
+int fgetc(FILE *stream);
+int fprintf(FILE *stream, const char *format, ...);
+int printf(const char *format, ...);
+int vsprintf(char *str, const char *format, va_list ap);
+#define EXIT_FAILURE 1 /* Failing exit status.  */
+#define EXIT_SUCCESS 0 /* Successful exit status.  */
+_Noreturn void exit(int status);
+void *malloc(int size);
+int strlen(const char *s);
+int strcmp(const char *s1, const char *s2);
+char *strcpy(char *dest, const char *src);
+int isalpha(int c);
+int isalnum(int c);
+int isdigit(int c);
+int isspace(int c);
+void *memcpy(void *dest, const void *src, int n);
+int memcmp(const void *s1, const void *s2, int n);
+void *memset(void *s, int c, int n);
+void assert(int cond);
+int open(const char *path, int oflag, int mode);
+int close(int fd);
+int read(int fd, const void *buf, int count);
+int write(int fd, const void *buf, int count);
+void *syscall(int number, ...);
+
+// vector.c
+typedef struct Vector Vector;
+Vector *new_vector();
+Vector *new_vector_from_scalar(void *scalar);
+void vector_push_back(Vector *vec, void *item);
+void *vector_get(Vector *vec, int i);
+int vector_size(Vector *vec);
+void *vector_set(Vector *vec, int i, void *item);
+void vector_push_back_vector(Vector *vec, Vector *src);
+Vector *clone_vector(Vector *src);
+
+// utility.c
+_Noreturn void error(const char *msg, ...);
+void *safe_malloc(int size);
+char *new_str(const char *src);
+char *format(const char *src, ...);
+char *vformat(const char *src, va_list ap);
+char *read_file(char *path, int *size);
+int write_file(char *path, char *buf, int size);
+
+// cache.c
+int init_cache();
+// The key of an object in the cache.
+typedef struct {
+    char *name;  // the hex string of the hash of material
+    // the hash of the tool, its flag and the input, which are stored with the
+    // object
+    char *material;
+    int material_size;
+} CacheKey;
+CacheKey *cache_key(char *tool, char *flag, char *infile);
+int cache_fetch(CacheKey *key, char *objfile);
+void cache_store(CacheKey *key, char *objfile);
+void flush_cache();
+void print_cache_stats();
+
+// main.c
+char *lookup_env(char *name);
+int has_suffix(char *str, char *suffix);
+
+#endif
@@ -0,0 +1,335 @@
+#include "aqcc.h"
+
+// The cache of object files. An object file is stored in the cache directory
+// as <key>.o, where key is the hash of the compiler binary, its flag and
+// the input, so a rebuilt compiler never reuses the objects of the old one.
+// The flag and the input are stored with the object and compared on lookup,
+// so a collision of the hash is a miss instead of a wrong object.
+// The least recently used objects are removed when the total size of the
+// cache exceeds AQCC_CACHE_SIZE MiB.
+
+char *cache_dir;     // NULL if the cache is disabled
+int cache_limit;     // in KiB
+int cache_hits, cache_misses, cache_stored;
+
+// AT_FDCWD
+#define CWD_FD (-100)
+
+int parse_size(char *str)
+{
+    if (str[0] == '\0') return -1;
+    int size = 0;
+    for (int i = 0; str[i] != '\0'; i++) {
+        if (!isdigit(str[i]) || size > 1000000) return -1;
+        size = size * 10 + str[i] - '0';
+    }
+    return size;
+}
+
+// mkdir -p
+void make_directory(char *path)
+{
+    char *dir = new_str(path);
+    for (int i = 1; dir[i] != '\0'; i++) {
+        if (dir[i] != '/') continue;
+        dir[i] = '\0';
+        syscall(83, dir, 0755);  // __NR_mkdir
+        dir[i] = '/';
+    }
+    syscall(83, dir, 0755);
+}
+
+// the cache is in AQCC_CACHE_DIR or ~/.cache/aqcc by default.
+// It is disabled if AQCC_CACHE_DIR is empty.
+int init_cache()
+{
+    char *dir = lookup_env("AQCC_CACHE_DIR");
+    if (dir == NULL) {
+        char *home = lookup_env("HOME");
+        if (home == NULL || home[0] == '\0') return 0;
+        dir = format("%s/.cache/aqcc", home);
+    }
+    if (dir[0] == '\0') return 0;
+
+    int limit = 256;
+    char *size = lookup_env("AQCC_CACHE_SIZE");
+    if (size != NULL) limit = parse_size(size);
+    if (limit < 0) error("invalid AQCC_CACHE_SIZE: %s", size);
+
+    make_directory(dir);
+    cache_dir = dir;
+    cache_limit = limit * 1024;
+    return 1;
+}
+
+void hash_bytes(int *hash, char *buf, int size)
+{
+    for (int i = 0; i < size; i++) {
+        int ch = buf[i] & 0xff;
+        hash[0] = (hash[0] ^ ch) * 16777619;  // FNV-1a
+        hash[1] = hash[1] * 33 + ch;          // djb2
+    }
+}
+
+void hash_file(int *hash, char *path)
+{
+    int size = 0;
+    char *buf = read_file(path, &size);
+    if (buf == NULL) error("can't read %s", path);
+    char *header = format("%d\n", size);
+    hash_bytes(hash, header, strlen(header));
+    hash_bytes(hash, buf, size);
+}
+
+char *hex_string(int *hash)
+{
+    char *digits = "0123456789abcdef";
+    char *str = safe_malloc(17);
+    for (int i = 0; i < 8; i++) {
+        str[i] = digits[(hash[0] >> (28 - i * 4)) & 15];
+        str[i + 8] = digits[(hash[1] >> (28 - i * 4)) & 15];
+    }
+    str[16] = '\0';
+    return str;
+}
+
+typedef struct {
+    char *path;
+    int hash[2];
+} ToolHash;
+
+Vector *tool_hashes;  // vector<ToolHash *>
+
+// the hash of the tool binary, computed once for each tool.
+ToolHash *hash_tool(char *path)
+{
+    if (tool_hashes == NULL) tool_hashes = new_vector();
+    for (int i = 0; i < vector_size(tool_hashes); i++) {
+        ToolHash *tool = (ToolHash *)vector_get(tool_hashes, i);
+        if (strcmp(tool->path, path) == 0) return tool;
+    }
+
+    ToolHash *tool = safe_malloc(sizeof(ToolHash));
+    tool->path = path;
+    tool->hash[0] = -2128831035;  // 2166136261
+    tool->hash[1] = 5381;
+    hash_file(tool->hash, path);
+    vector_push_back(tool_hashes, tool);
+    return tool;
+}
+
+// the key of the object which tool makes from infile with flag.
+CacheKey *cache_key(char *tool, char *flag, char *infile)
+{
+    int size = 0;
+    char *input = read_file(infile, &size);
+    if (input == NULL) error("can't read %s", infile);
+
+    // the tool is told by the hash of its binary, and the rest by itself.
+    ToolHash *tool_hash = hash_tool(tool);
+    char *header = format("%s %s\n", hex_string(tool_hash->hash), flag);
+    int header_size = strlen(header);
+    CacheKey *key = safe_malloc(sizeof(CacheKey));
+    key->material_size = header_size + size;
+    key->material = safe_malloc(key->material_size);
+    memcpy(key->material, header, header_size);
+    memcpy(key->material + header_size, input, size);
+
+    int hash[2];
+    hash[0] = tool_hash->hash[0];
+    hash[1] = tool_hash->hash[1];
+    hash_bytes(hash, key->material, key->material_size);
+    key->name = hex_string(hash);
+    return key;
+}
+
+char *cache_path(char *name) { return format("%s/%s.o", cache_dir, name); }
+
+// the header of the entry of key in the cache, which the object follows.
+char *entry_header(CacheKey *key)
+{
+    return format("%d\n", key->material_size);
+}
+
+// the offset of the object in buf of size bytes read from the entry of the
+// name of key, or -1 if it is of other key material.
+int cached_object_offset(char *buf, int size, CacheKey *key)
+{
+    char *header = entry_header(key);
+    int len = strlen(header);
+    if (size < len + key->material_size || memcmp(buf, header, len) != 0 ||
+        memcmp(buf + len, key->material, key->material_size) != 0)
+        return -1;
+    return len + key->material_size;
+}
+
+// copy the object of key to objfile and return 1 if it is in the cache.
+int cache_fetch(CacheKey *key, char *objfile)
+{
+    char *path = cache_path(key->name);
+    int size = 0, offset = -1;
+    char *buf = read_file(path, &size);
+    if (buf != NULL) offset = cached_object_offset(buf, size, key);
+    if (offset < 0 || !write_file(objfile, buf + offset, size - offset)) {
+        cache_misses++;
+        return 0;
+    }
+
+    // mark it as recently used.
+    syscall(280, CWD_FD, path, NULL, 0);  // __NR_utimensat
+    cache_hits++;
+    return 1;
+}
+
+void cache_store(CacheKey *key, char *objfile)
+{
+    int size = 0;
+    char *obj = read_file(objfile, &size);
+    if (obj == NULL) return;
+
+    // the object follows the key material.
+    char *header = entry_header(key);
+    int len = strlen(header), entry_size = len + key->material_size + size;
+    char *buf = safe_malloc(entry_size);
+    memcpy(buf, header, len);
+    memcpy(buf + len, key->material, key->material_size);
+    memcpy(buf + len + key->material_size, obj, size);
+
+    // write and rename it so that other aqcc never read a partial object.
+    int pid = (int)syscall(39);  // __NR_getpid
+    char *tmppath = format("%s/%s.tmp-%d", cache_dir, key->name, pid);
+    if (!write_file(tmppath, buf, entry_size)) return;
+    syscall(82, tmppath, cache_path(key->name));  // __NR_rename
+    cache_stored++;
+}
+
+typedef struct {
+    char *path;
+    int size;  // in KiB
+    int mtime;
+} CacheEntry;
+
+// the objects in the cache.
+Vector *cache_entries()
+{
+    Vector *entries = new_vector();
+    // O_RDONLY | O_DIRECTORY
+    int fd = open(cache_dir, 65536, 0);
+    if (fd < 0) return entries;
+
+    char buf[4096];
+    char st[144];
+    while (1) {
+        int size = (int)syscall(217, fd, buf, sizeof(buf));  // __NR_getdents64
+        if (size <= 0) break;
+
+        // struct linux_dirent64
+        int reclen = 0;
+        for (int offset = 0; offset < size; offset += reclen) {
+            reclen = (buf[offset + 16] & 0xff) | (buf[offset + 17] & 0xff) << 8;
+            char *name = buf + offset + 19;
+            if (!has_suffix(name, ".o")) continue;
+
+            char *path = format("%s/%s", cache_dir, name);
+            if ((int)syscall(4, path, st) < 0) continue;  // __NR_stat
+            CacheEntry *entry = safe_malloc(sizeof(CacheEntry));
+            entry->path = path;
+            // st_size and st_mtime of struct stat
+            entry->size = (*(int *)(st + 48) + 1023) / 1024;
+            entry->mtime = *(int *)(st + 88);
+            vector_push_back(entries, entry);
+        }
+    }
+    close(fd);
+    return entries;
+}
+
+int total_size(Vector *entries)
+{
+    int size = 0;
+    for (int i = 0; i < vector_size(entries); i++)
+        size += ((CacheEntry *)vector_get(entries, i))->size;
+    return size;
+}
+
+// remove the least recently used objects until the cache fits in the limit.
+void evict_cache()
+{
+    Vector *entries = cache_entries();
+    int size = total_size(entries);
+    while (size > cache_limit) {
+        CacheEntry *oldest = NULL;
+        for (int i = 0; i < vector_size(entries); i++) {
+            CacheEntry *entry = (CacheEntry *)vector_get(entries, i);
+            if (entry->path == NULL) continue;
+            if (oldest == NULL || entry->mtime < oldest->mtime) oldest = entry;
+        }
+        if (oldest == NULL) break;
+
+        syscall(87, oldest->path);  // __NR_unlink
+        oldest->path = NULL;
+        size -= oldest->size;
+    }
+}
+
+// sum the lines of "hits misses" in the stats file.
+void read_cache_stats(int *hits, int *misses)
+{
+    *hits = 0;
+    *misses = 0;
+    int size = 0;
+    char *buf = read_file(format("%s/stats", cache_dir), &size);
+    if (buf == NULL) return;
+
+    for (int i = 0; i < size;) {
+        int val = 0;
+        for (; i < size && isdigit(buf[i]); i++) val = val * 10 + buf[i] - '0';
+        *hits += val;
+        for (; i < size && !isdigit(buf[i]); i++)
+            ;
+        val = 0;
+        for (; i < size && isdigit(buf[i]); i++) val = val * 10 + buf[i] - '0';
+        *misses += val;
+        for (; i < size && !isdigit(buf[i]); i++)
+            ;
+    }
+}
+
+// append the hits and misses of this run to the stats file, and evict old
+// objects if new ones have been stored.
+void flush_cache()
+{
+    if (cache_dir == NULL || cache_hits + cache_misses == 0) return;
+
+    // a line is appended by a single write, so the counts of aqcc running
+    // at the same time are never lost as by rewriting the file.
+    char *stats = format("%d %d\n", cache_hits, cache_misses);
+    // O_CREAT | O_WRONLY | O_APPEND
+    int fd = open(format("%s/stats", cache_dir), 64 | 1 | 1024, 0644);
+    if (fd >= 0) {
+        write(fd, stats, strlen(stats));
+        close(fd);
+    }
+    cache_hits = 0;
+    cache_misses = 0;
+
+    if (cache_stored > 0) evict_cache();
+    cache_stored = 0;
+}
+
+void print_cache_stats()
+{
+    if (cache_dir == NULL) {
+        printf("cache disabled\n");
+        return;
+    }
+
+    int hits = 0, misses = 0;
+    read_cache_stats(&hits, &misses);
+    Vector *entries = cache_entries();
+    printf("cache directory: %s\n", cache_dir);
+    printf("hits: %d\n", hits);
+    printf("misses: %d\n", misses);
+    printf("objects: %d\n", vector_size(entries));
+    printf("size: %d KiB (max %d KiB)\n", total_size(entries), cache_limit);
+}
@@ -0,0 +1,427 @@
+#include "aqcc.h"
+
+// The driver of aqcc. It compiles C files by cc -c and assembly files by as,
+// running up to -j of them at once, and then links the objects by ld.
+
+char **envp;
+int verbose;
+
+_Noreturn void usage()
+{
+    error("Usage: aqcc [-c, -S] [-v] [-jN] [-g] [-ffunction-sections] "
+          "[-fdata-sections] [--gc-sections] [--icf=all, --icf=safe] "
+          "[--print-icf]\n"
+          "       [--threads=N] [--symbol-ordering-file=FILE] "
+          "[--call-graph-order]\n"
+          "       [--incremental] [--print-incremental]\n"
+          "       input-files... -o output-file\n"
+          "       aqcc -run [-v] [-jN] input-c-file input-files... "
+          "[-- args...]\n"
+          "       aqcc --cache-stats");
+}
+
+char *lookup_env(char *name)
+{
+    int len = strlen(name);
+    for (char **env = envp; *env != NULL; env++) {
+        char *var = *env;
+        int i = 0;
+        while (i < len && var[i] == name[i]) i++;
+        if (i == len && var[len] == '=') return var + len + 1;
+    }
+    return NULL;
+}
+
+char *dirname(char *path)
+{
+    char *dir = new_str(path);
+    int last = -1;
+    for (int i = 0; dir[i] != '\0'; i++)
+        if (dir[i] == '/') last = i;
+    if (last == -1) return ".";
+    if (last == 0) return "/";
+    dir[last] = '\0';
+    return dir;
+}
+
+// the tools are in the directory of aqcc e.g. ./cc/cc
+// unless the environment variable e.g. AQCC_CC tells where it is.
+char *tool_path(char *argv0, char *envname, char *tool)
+{
+    char *path = lookup_env(envname);
+    if (path != NULL && path[0] != '\0') return path;
+    return format("%s/%s/%s", dirname(argv0), tool, tool);
+}
+
+int has_suffix(char *str, char *suffix)
+{
+    int len = strlen(str), slen = strlen(suffix);
+    return len >= slen && strcmp(str + len - slen, suffix) == 0;
+}
+
+int has_prefix(char *str, char *prefix)
+{
+    int len = strlen(prefix);
+    for (int i = 0; i < len; i++)
+        if (str[i] != prefix[i]) return 0;
+    return 1;
+}
+
+int parse_jobs(char *str)
+{
+    if (str[0] == '\0') usage();
+    int njobs = 0;
+    for (int i = 0; str[i] != '\0'; i++) {
+        if (!isdigit(str[i])) usage();
+        njobs = njobs * 10 + str[i] - '0';
+    }
+    if (njobs == 0) usage();
+    return njobs;
+}
+
+// the number of CPUs this process can run on.
+int count_cpus()
+{
+    char mask[128];
+    // __NR_sched_getaffinity
+    int size = (int)syscall(204, 0, sizeof(mask), mask);
+    if (size <= 0) return 1;
+
+    int ncpus = 0;
+    for (int i = 0; i < size; i++)
+        for (int j = 0; j < 8; j++)
+            if (mask[i] & (1 << j)) ncpus++;
+    return ncpus > 0 ? ncpus : 1;
+}
+
+int spawn(Vector *cmd)
+{
+    int argc = vector_size(cmd);
+    char **argv = (char **)safe_malloc(sizeof(char *) * (argc + 1));
+    for (int i = 0; i < argc; i++) argv[i] = (char *)vector_get(cmd, i);
+    argv[argc] = NULL;
+
+    if (verbose) {
+        for (int i = 0; i < argc; i++) printf(i == 0 ? "%s" : " %s", argv[i]);
+        printf("\n");
+    }
+
+    int pid = (int)syscall(57);  // __NR_fork
+    if (pid < 0) error("fork failed");
+    if (pid == 0) {
+        syscall(59, argv[0], argv, envp);  // __NR_execve
+        error("can't execute %s", argv[0]);
+    }
+    return pid;
+}
+
+// wait for a child to exit and return its exit status, which is 128 plus
+// the signal number if it was killed as shells do.
+int wait_child()
+{
+    int status = 0;
+    // __NR_wait4
+    if ((int)syscall(61, -1, &status, 0, 0) < 0) error("wait4 failed");
+    if ((status & 0x7f) != 0) return 128 + (status & 0x7f);
+    return (status >> 8) & 0xff;
+}
+
+// run commands with at most njobs of them at once and return 1 if all of
+// them succeeded. No more command is started after one fails.
+int run_commands(Vector *cmds, int njobs)
+{
+    int running = 0, ok = 1;
+    for (int i = 0; i < vector_size(cmds); i++) {
+        if (running == njobs) {
+            if (wait_child() != 0) ok = 0;
+            running--;
+        }
+        if (!ok) break;
+        spawn((Vector *)vector_get(cmds, i));
+        running++;
+    }
+    for (; running > 0; running--)
+        if (wait_child() != 0) ok = 0;
+    return ok;
+}
+
+int run_command(Vector *cmd)
+{
+    return run_commands(new_vector_from_scalar(cmd), 1);
+}
+
+char *cc_path, *as_path, *ld_path;
+// the options of cc -c e.g. -ffunction-sections.
+Vector *cc_flags;
+
+// cc -c with cc_flags as one string, which is a part of the cache keys.
+char *cc_flags_string()
+{
+    char *str = "-c";
+    for (int i = 0; i < vector_size(cc_flags); i++)
+        str = format("%s %s", str, vector_get(cc_flags, i));
+    return str;
+}
+
+// the command which makes the object file outfile from infile,
+// or NULL if infile is neither C nor assembly.
+Vector *compile_command(char *infile, char *outfile)
+{
+    Vector *cmd = new_vector();
+    if (has_suffix(infile, ".c")) {
+        vector_push_back(cmd, cc_path);
+        vector_push_back_vector(cmd, cc_flags);
+        vector_push_back(cmd, "-c");
+    }
+    else if (has_suffix(infile, ".s"))
+        vector_push_back(cmd, as_path);
+    else
+        return NULL;
+    vector_push_back(cmd, infile);
+    vector_push_back(cmd, outfile);
+    return cmd;
+}
+
+char *temp_path(int i, char *suffix)
+{
+    int pid = (int)syscall(39);  // __NR_getpid
+    return format("/tmp/aqcc-%d-%d%s", pid, i, suffix);
+}
+
+// the cache key of each input file, or NULL if the cache is disabled.
+// C files are hashed after preprocessing by cc -E, so that edits in
+// comments or in the layout don't miss the cache.
+// Return NULL if cc -E fails.
+Vector *source_keys(Vector *infiles, int njobs)
+{
+    Vector *keys = new_vector();
+    int cache_enabled = init_cache();
+
+    Vector *cmds = new_vector();
+    Vector *tokfiles = new_vector();
+    for (int i = 0; i < vector_size(infiles); i++) {
+        char *infile = (char *)vector_get(infiles, i);
+        char *tokfile = NULL;
+        if (cache_enabled && has_suffix(infile, ".c")) {
+            tokfile = temp_path(i, ".tok");
+            // -g dumps the lines of the tokens too.
+            Vector *cmd = new_vector_from_scalar(cc_path);
+            vector_push_back_vector(cmd, cc_flags);
+            vector_push_back(cmd, "-E");
+            vector_push_back(cmd, infile);
+            vector_push_back(cmd, tokfile);
+            vector_push_back(cmds, cmd);
+        }
+        vector_push_back(tokfiles, tokfile);
+    }
+    int ok = run_commands(cmds, njobs);
+
+    for (int i = 0; i < vector_size(infiles); i++) {
+        char *infile = (char *)vector_get(infiles, i);
+        char *tokfile = (char *)vector_get(tokfiles, i);
+        CacheKey *key = NULL;
+        if (tokfile != NULL) {
+            if (ok) key = cache_key(cc_path, cc_flags_string(), tokfile);
+            syscall(87, tokfile);  // __NR_unlink
+        }
+        else if (cache_enabled)
+            key = cache_key(as_path, "", infile);
+        vector_push_back(keys, key);
+    }
+    if (!ok) return NULL;
+    return keys;
+}
+
+// make objfiles[i] from infiles[i] running at most njobs commands at once.
+// The objects found in the cache are copied instead.
+int make_objects(Vector *infiles, Vector *objfiles, int njobs)
+{
+    Vector *keys = source_keys(infiles, njobs);
+    if (keys == NULL) return 0;
+
+    Vector *cmds = new_vector();
+    Vector *missed_keys = new_vector();
+    Vector *missed_objs = new_vector();
+    for (int i = 0; i < vector_size(infiles); i++) {
+        char *infile = (char *)vector_get(infiles, i);
+        char *objfile = (char *)vector_get(objfiles, i);
+        CacheKey *key = (CacheKey *)vector_get(keys, i);
+        if (key != NULL && cache_fetch(key, objfile)) {
+            if (verbose) printf("cache hit: %s\n", infile);
+            continue;
+        }
+        vector_push_back(cmds, compile_command(infile, objfile));
+        vector_push_back(missed_keys, key);
+        vector_push_back(missed_objs, objfile);
+    }
+
+    int ok = run_commands(cmds, njobs);
+    for (int i = 0; ok && i < vector_size(missed_keys); i++) {
+        CacheKey *key = (CacheKey *)vector_get(missed_keys, i);
+        if (key != NULL) cache_store(key, vector_get(missed_objs, i));
+    }
+    flush_cache();
+    return ok;
+}
+
+// make the objects of infiles into objs in order. Sources are compiled into
+// temporary files, which are also added to tmpfiles.
+int collect_objects(Vector *infiles, Vector *objs, Vector *tmpfiles,
+                    int njobs)
+{
+    Vector *srcs = new_vector();
+    Vector *srcobjs = new_vector();
+    for (int i = 0; i < vector_size(infiles); i++) {
+        char *infile = (char *)vector_get(infiles, i);
+        if (has_suffix(infile, ".o") || has_suffix(infile, ".a")) {
+            vector_push_back(objs, infile);
+            continue;
+        }
+
+        char *tmpfile = temp_path(i, ".o");
+        if (compile_command(infile, tmpfile) == NULL)
+            error("unknown file type: %s", infile);
+        vector_push_back(srcs, infile);
+        vector_push_back(srcobjs, tmpfile);
+        vector_push_back(objs, tmpfile);
+        vector_push_back(tmpfiles, tmpfile);
+    }
+    return make_objects(srcs, srcobjs, njobs);
+}
+
+void remove_files(Vector *files)
+{
+    for (int i = 0; i < vector_size(files); i++)
+        syscall(87, vector_get(files, i));  // __NR_unlink
+}
+
+// compile the first input by cc -run and run it in memory with the objects of
+// the others, passing args to its main. Return the exit status of it.
+int run_program(Vector *infiles, Vector *args, int njobs)
+{
+    if (vector_size(infiles) == 0) usage();
+    char *mainfile = (char *)vector_get(infiles, 0);
+    if (!has_suffix(mainfile, ".c")) usage();
+
+    Vector *rest = new_vector();
+    for (int i = 1; i < vector_size(infiles); i++)
+        vector_push_back(rest, vector_get(infiles, i));
+    Vector *objs = new_vector();
+    Vector *tmpfiles = new_vector();
+    int status = 1;
+    if (collect_objects(rest, objs, tmpfiles, njobs)) {
+        Vector *cmd = new_vector_from_scalar(cc_path);
+        vector_push_back(cmd, "-run");
+        vector_push_back(cmd, mainfile);
+        vector_push_back_vector(cmd, objs);
+        vector_push_back(cmd, "--");
+        vector_push_back_vector(cmd, args);
+        spawn(cmd);
+        status = wait_child();
+    }
+    remove_files(tmpfiles);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    envp = argv + argc + 1;
+    cc_path = tool_path(argv[0], "AQCC_CC", "cc");
+    as_path = tool_path(argv[0], "AQCC_AS", "as");
+    ld_path = tool_path(argv[0], "AQCC_LD", "ld");
+
+    cc_flags = new_vector();
+
+    // the options of ld e.g. --gc-sections.
+    Vector *ld_flags = new_vector();
+
+    int outft = 'e', njobs = 0;
+    char *outfile = "a.out";
+    Vector *infiles = new_vector();
+    Vector *runargs = new_vector();
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (strcmp(arg, "--") == 0) {
+            for (i++; i < argc; i++) vector_push_back(runargs, argv[i]);
+            break;
+        }
+        else if (strcmp(arg, "-o") == 0) {
+            if (i + 1 == argc || argv[i + 1][0] == '-') usage();
+            outfile = argv[++i];
+        }
+        else if (strcmp(arg, "-c") == 0)
+            outft = 'o';
+        else if (strcmp(arg, "-S") == 0)
+            outft = 's';
+        else if (strcmp(arg, "-run") == 0)
+            outft = 'r';
+        else if (strcmp(arg, "-v") == 0)
+            verbose = 1;
+        else if (strcmp(arg, "-g") == 0 ||
+                 strcmp(arg, "-ffunction-sections") == 0 ||
+                 strcmp(arg, "-fdata-sections") == 0)
+            vector_push_back(cc_flags, arg);
+        else if (strcmp(arg, "--gc-sections") == 0 ||
+                 strcmp(arg, "--icf=all") == 0 ||
+                 strcmp(arg, "--icf=safe") == 0 ||
+                 strcmp(arg, "--print-icf") == 0 ||
+                 has_prefix(arg, "--threads=") ||
+                 has_prefix(arg, "--symbol-ordering-file=") ||
+                 strcmp(arg, "--call-graph-order") == 0 ||
+                 strcmp(arg, "--incremental") == 0 ||
+                 strcmp(arg, "--print-incremental") == 0)
+            vector_push_back(ld_flags, arg);
+        else if (strcmp(arg, "--cache-stats") == 0) {
+            init_cache();
+            print_cache_stats();
+            return 0;
+        }
+        else if (strcmp(arg, "-j") == 0) {
+            if (i + 1 == argc) usage();
+            njobs = parse_jobs(argv[++i]);
+        }
+        else if (arg[0] == '-' && arg[1] == 'j')
+            njobs = parse_jobs(arg + 2);
+        else if (arg[0] == '-')
+            usage();
+        else
+            vector_push_back(infiles, arg);
+    }
+    if (njobs == 0) njobs = count_cpus();
+    if (vector_size(runargs) > 0 && outft != 'r') usage();
+
+    if (outft == 'r') return run_program(infiles, runargs, njobs);
+
+    if (outft == 's') {
+        if (vector_size(infiles) != 1) usage();
+        Vector *cmd = new_vector_from_scalar(cc_path);
+        vector_push_back_vector(cmd, cc_flags);
+        vector_push_back(cmd, vector_get(infiles, 0));
+        vector_push_back(cmd, outfile);
+        return run_command(cmd) ? 0 : 1;
+    }
+
+    if (outft == 'o') {
+        if (vector_size(infiles) != 1) usage();
+        if (compile_command(vector_get(infiles, 0), outfile) == NULL) usage();
+        Vector *objs = new_vector_from_scalar(outfile);
+        return make_objects(infiles, objs, 1) ? 0 : 1;
+    }
+
+    // make objects in parallel into temporary files, then link them.
+    Vector *objs = new_vector();
+    Vector *tmpfiles = new_vector();
+    int ok = collect_objects(infiles, objs, tmpfiles, njobs);
+    if (ok) {
+        Vector *cmd = new_vector_from_scalar(ld_path);
+        vector_push_back_vector(cmd, ld_flags);
+        vector_push_back_vector(cmd, objs);
+        vector_push_back(cmd, outfile);
+        ok = run_command(cmd);
+    }
+    if (ok) syscall(90, outfile, 0755);  // __NR_chmod
+
+    remove_files(tmpfiles);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "aqcc.h"
+
+_Noreturn void error(const char *msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    char *str = vformat(msg, args);
+    va_end(args);
+
+    // fprintf(stderr, "[ERROR] %s\n", str);
+    printf("[ERROR] %s\n", str);
+    // fprintf(stderr, "[DEBUG] %s, %d\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+}
+
+void *safe_malloc(int size)
+{
+    void *ptr;
+
+    ptr = malloc(size);
+    if (ptr == NULL) error("malloc failed.");
+    return ptr;
+}
+
+char *new_str(const char *src)
+{
+    char *ret = safe_malloc(strlen(src) + 1);
+    strcpy(ret, src);
+    return ret;
+}
+
+char *vformat(const char *src, va_list ap)
+{
+    char buf[512];  // TODO: enough length?
+    vsprintf(buf, src, ap);
+
+    char *ret = safe_malloc(strlen(buf) + 1);
+    strcpy(ret, buf);
+    return ret;
+}
+
+char *format(const char *src, ...)
+{
+    va_list args;
+    va_start(args, src);
+    char *ret = vformat(src, args);
+    va_end(args);
+    return ret;
+}
+
+// read the whole file into a new buffer, or return NULL if it can't.
+char *read_file(char *path, int *size)
+{
+    int fd = open(path, 0, 0);  // O_RDONLY
+    if (fd < 0) return NULL;
+
+    // st_size of struct stat
+    char st[144];
+    if ((int)syscall(5, fd, st) < 0) {  // __NR_fstat
+        close(fd);
+        return NULL;
+    }
+    *size = *(int *)(st + 48);
+
+    char *buf = safe_malloc(*size + 1);
+    int nread = 0;
+    while (nread < *size) {
+        int res = read(fd, buf + nread, *size - nread);
+        if (res <= 0) break;
+        nread += res;
+    }
+    close(fd);
+    if (nread != *size) return NULL;
+    buf[*size] = '\0';
+    return buf;
+}
+
+// return 1 if the whole buffer is written.
+int write_file(char *path, char *buf, int size)
+{
+    // O_CREAT | O_WRONLY | O_TRUNC
+    int fd = open(path, 64 | 1 | 512, 0644);
+    if (fd < 0) return 0;
+
+    int nwritten = 0;
+    while (nwritten < size) {
+        int res = write(fd, buf + nwritten, size - nwritten);
+        if (res <= 0) break;
+        nwritten += res;
+    }
+    close(fd);
+    return nwritten == size;
+}
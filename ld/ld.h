@@ -34,6 +34,7 @@ FILE *fopen(const char *pathname, const char *mode);
 int fclose(FILE *stream);
 int fputc(int c, FILE *stream);
 int fgetc(FILE *stream);
+int fwrite(const void *ptr, int size, int nmemb, FILE *stream);
 int fprintf(FILE *stream, const char *format, ...);
 int printf(const char *format, ...);
 int vsprintf(char *str, const char *format, va_list ap);
@@ -48,9 +49,17 @@ int isalpha(int c);
 int isalnum(int c);
 int isdigit(int c);
 int isspace(int c);
+int atoi(const char *str);
 void *memcpy(void *dest, const void *src, int n);
 void *memset(void *s, int c, int n);
+int memcmp(const void *s1, const void *s2, int n);
 void assert(int cond);
+int thread_create(void *arg);
+void futex_wait(int *addr, int val);
+void futex_wake(int *addr);
+int open(const char *path, int oflag, int mode);
+int close(int fd);
+int read(int fd, const void *buf, int count);
 
 // vector.c
 typedef struct Vector Vector;
@@ -96,7 +105,29 @@ int roundup(int n, int b);
 
 // link.c
 typedef struct ExeImage ExeImage;
-ExeImage *link_objs(Vector *obj_paths);
+typedef struct SymbolTable SymbolTable;
+// the modes of --icf.
+enum { ICF_NONE, ICF_SAFE, ICF_ALL };
+// the options of ld.
+typedef struct {
+    int gc_sections;  // remove the sections not reachable from _start
+    int icf;          // fold identical code
+    int print_icf;    // print how much --icf folds
+    int threads;      // the number of threads, or 0 for 1
+    // the file listing the symbols whose sections are laid out first, or NULL
+    char *symbol_ordering_file;
+    int call_graph_order;  // put callers and callees close
+    // keep <output>.ldstate to patch only the changed objects next time
+    int incremental;
+    int print_incremental;  // print whether --incremental patched the output
+} LinkOptions;
+ExeImage *link_objs(Vector *obj_paths, LinkOptions *opts);
+int relink_exe(Vector *obj_paths, LinkOptions *opts, char *exe_path);
+void save_link_state(ExeImage *exe, Vector *obj_paths, LinkOptions *opts,
+                     char *exe_path);
+void remove_link_state(char *exe_path);
+int load_objs(Vector *objs, char *entry);
+void read_input_files(Vector *objs, Vector *paths);
 void dump_exe_image(ExeImage *exeimg, FILE *fh);
 
 // object.c
@@ -1,200 +1,1802 @@
 #include "ld.h"
 
+void *syscall(int number, ...);
+
+// The executable starts with the ELF header and two program headers.
+#define EXE_VADDR 0x400000
+#define EXE_HEADER_SIZE (64 + 56 * 2)
+
+typedef struct ObjectData ObjectData;
+
+// The layout of the output. It has two segments: code and read-only data
+// (R+X), and writable data (R+W). The sections of the same name in the
+// objects are merged into one section of a segment. The image is laid out
+// as in memory, so the R+W segment starts at a page boundary, but in the
+// file it directly follows the R+X one.
 struct ExeImage {
-    int vaddr_offset, header_size;
-    Vector *objs;  // vector<ObjectData *>
+    Vector *objs;      // vector<ObjectData *>
+    Vector *sections;  // vector<OutputSection *> in the order of the image
+    SymbolTable *symbols;
+    int header_size;  // at the start of the R+X segment
+    int text_size;    // of the R+X segment
+    // the R+W segment is at data_offset in the image and data_file_offset in
+    // the file.
+    int data_offset, data_file_offset;
+    int data_filesz, data_memsz;
+    char *image;  // data_offset + data_memsz bytes
+    int nthreads;  // which split the work over objs
+    // the sections not loaded into memory e.g. .debug_line, which are merged
+    // like the others into debug_image of debug_size bytes. They follow the
+    // R+W segment in the file.
+    Vector *debug_sections;  // vector<OutputSection *>
+    char *debug_image;
+    int debug_size;
 };
 
-typedef struct ObjectData ObjectData;
 struct ObjectData {
+    char *path;
     char *data;
-    int data_size, entire_size;
+    int data_size;
+    int input;  // the index of the input file which it is from
 
-    char *shdr, *symtab, *strtab, *rela_text;
-    int nshdr, nsymtab, nrela_text;
+    char *shdr, *symtab, *strtab;
+    int nshdr, nsymtab;
+    // where each section is in the image, or -1 if it isn't loaded.
+    int *section_offsets;
+    // whether each section is used with --gc-sections, or NULL without it.
+    char *live_sections;
+    // whether each section is folded into an identical one by --icf, or NULL
+    // without it.
+    char *folded_sections;
+    // the index of each section in the candidates of --icf, or -1.
+    int *icf_sections;
+    // the index of each section in the call graph of --call-graph-order, or
+    // -1.
+    int *call_graph_nodes;
+    // where each debug section is in its output section, or -1.
+    int *debug_offsets;
 };
 
+// A section of the output merged from the sections of the same name.
+typedef struct {
+    char *name;
+    int flags, type;  // sh_flags and sh_type
+    int offset, size;
+} OutputSection;
+
 int read_byte(char *data) { return data[0] & 0xff; }
 
 int read_word(char *data)
 {
-    return read_byte(data) | (read_byte(data + 1) << 8);
+    return read_byte(data) | (read_byte(data + 1) << 8);
+}
+
+int read_dword(char *data)
+{
+    return read_word(data) | (read_word(data + 2) << 16);
+}
+
+char *section_header(ObjectData *obj, int index)
+{
+    return obj->shdr + 0x40 * index;
+}
+
+char *section_name(ObjectData *obj, int index)
+{
+    char *section_strtab =
+        obj->data +
+        read_dword(section_header(obj, read_word(obj->data + 62)) + 24);
+    return section_strtab + read_dword(section_header(obj, index));
+}
+
+ObjectData *new_object_data(char *data, int data_size)
+{
+    ObjectData *obj = (ObjectData *)safe_malloc(sizeof(ObjectData));
+    obj->path = "<memory>";
+    obj->data = data;
+    obj->data_size = data_size;
+    obj->input = 0;
+    obj->shdr = obj->symtab = obj->strtab = NULL;
+    obj->live_sections = obj->folded_sections = NULL;
+    obj->icf_sections = obj->call_graph_nodes = obj->debug_offsets = NULL;
+
+    // parse data
+    obj->shdr = data + read_dword(data + 40);
+    obj->nshdr = read_word(data + 60);
+    obj->section_offsets = (int *)safe_malloc(sizeof(int) * obj->nshdr);
+
+    for (int i = 1; i < obj->nshdr; i++) {
+        char *entry = section_header(obj, i);
+        char *offset = data + read_dword(entry + 24);
+        int size = read_dword(entry + 32);
+        char *name = section_name(obj, i);
+        if (obj->symtab == NULL && strcmp(name, ".symtab") == 0) {
+            obj->symtab = offset;
+            obj->nsymtab = size / 24;
+        }
+        if (obj->strtab == NULL && strcmp(name, ".strtab") == 0)
+            obj->strtab = offset;
+    }
+    assert(obj->shdr != NULL && obj->symtab != NULL && obj->strtab != NULL);
+
+    return obj;
+}
+
+// read the file at filepath all at once, knowing its size by fstat.
+char *read_binary_file(char *filepath, int *size)
+{
+    int fd = open(filepath, 0, 0);  // O_RDONLY
+    if (fd < 0) error("no such binary file: '%s'", filepath);
+
+    char st[144];
+    if ((int)syscall(5, fd, st) < 0) error("can't stat '%s'", filepath);
+    *size = read_dword(st + 48);  // st_size
+    char *data = safe_malloc(*size);
+    for (int nread = 0; nread < *size;) {
+        int res = read(fd, data + nread, *size - nread);
+        if (res <= 0) error("can't read '%s'", filepath);
+        nread += res;
+    }
+    close(fd);
+    return data;
+}
+
+// the decimal number padded with spaces in a field of an archive header.
+int read_decimal(char *str, int len)
+{
+    int val = 0;
+    for (int i = 0; i < len && isdigit(str[i]); i++)
+        val = val * 10 + str[i] - '0';
+    return val;
+}
+
+// the name of an archive member, which ends with '/' in GNU ar.
+char *member_name(char *name, int maxlen)
+{
+    int len = 0;
+    while (len < maxlen && name[len] != '/' && name[len] != '\n' &&
+           name[len] != ' ')
+        len++;
+    char *ret = safe_malloc(len + 1);
+    memcpy(ret, name, len);
+    ret[len] = '\0';
+    return ret;
+}
+
+int is_archive(char *data, int size)
+{
+    return size >= 8 && memcmp(data, "!<arch>\n", 8) == 0;
+}
+
+// parse the objects in the ar archive data. Each member starts with a header
+// of 60 bytes, and is aligned to 2 bytes. The member "/" is the symbol index,
+// which isn't needed since the symbol tables of the members are read anyway,
+// and "//" has the names longer than 15 bytes.
+Vector *read_archive_members(char *path, char *data, int size)
+{
+    Vector *members = new_vector();
+    char *long_names = NULL;
+    int long_names_size = 0;
+    for (int offset = 8; offset + 60 <= size;) {
+        char *header = data + offset;
+        int member_size = read_decimal(header + 48, 10);
+        char *body = header + 60;
+        if (offset + 60 + member_size > size)
+            error("broken archive: %s", path);
+        offset = roundup(offset + 60 + member_size, 2);
+
+        char *name = NULL;
+        if (header[0] == '/' && header[1] == '/') {
+            long_names = body;
+            long_names_size = member_size;
+            continue;
+        }
+        if (header[0] == '/' && isdigit(header[1])) {
+            int index = read_decimal(header + 1, 15);
+            if (long_names == NULL || index >= long_names_size)
+                error("broken archive: %s", path);
+            name = member_name(long_names + index, long_names_size - index);
+        }
+        else if (header[0] == '/')
+            continue;  // the symbol index
+        else
+            name = member_name(header, 16);
+
+        if (member_size < 64 || body[0] != 0x7f ||
+            memcmp(body + 1, "ELF", 3) != 0)
+            error("not an object: %s(%s)", path, name);
+        ObjectData *obj = new_object_data(body, member_size);
+        obj->path = format("%s(%s)", path, name);
+        vector_push_back(members, obj);
+    }
+    return members;
+}
+
+// SHF_WRITE, SHF_ALLOC and SHF_EXECINSTR of sh_flags
+#define SHF_WRITE 1
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+// SHT_NOBITS and SHT_RELA of sh_type
+#define SHT_PROGBITS 1
+#define SHT_RELA 4
+#define SHT_NOBITS 8
+
+// the segment where the section goes: 0 for R+X, 1 and 2 for R+W with and
+// without the bytes in the file.
+int segment_rank(int flags, int type)
+{
+    if (!(flags & SHF_WRITE)) return 0;
+    if (type != SHT_NOBITS) return 1;
+    return 2;
+}
+
+int has_section_prefix(char *name, char *prefix)
+{
+    int len = strlen(prefix);
+    return memcmp(name, prefix, len) == 0 &&
+           (name[len] == '\0' || name[len] == '.');
+}
+
+// the name of the output section of the section of index in obj. As other
+// linkers do, e.g. .text.main made by -ffunction-sections goes to .text.
+char *output_section_name(ObjectData *obj, int index)
+{
+    char *name = section_name(obj, index);
+    if (has_section_prefix(name, ".text")) return ".text";
+    if (has_section_prefix(name, ".data")) return ".data";
+    if (has_section_prefix(name, ".rodata")) return ".rodata";
+    if (has_section_prefix(name, ".bss")) return ".bss";
+    return name;
+}
+
+OutputSection *find_output_section(Vector *sections, char *name, int flags,
+                                   int type)
+{
+    for (int i = 0; i < vector_size(sections); i++) {
+        OutputSection *sec = (OutputSection *)vector_get(sections, i);
+        if (strcmp(sec->name, name) != 0) continue;
+        if (segment_rank(sec->flags, sec->type) != segment_rank(flags, type))
+            error("section %s has conflicting flags", name);
+        return sec;
+    }
+
+    OutputSection *sec = (OutputSection *)safe_malloc(sizeof(OutputSection));
+    sec->name = name;
+    sec->flags = flags;
+    sec->type = type;
+    sec->offset = sec->size = 0;
+    vector_push_back(sections, sec);
+    return sec;
+}
+
+// whether the section of index is loaded, unless it isn't allocated in
+// memory. It may be removed by --gc-sections or --icf.
+int is_loaded_section(ObjectData *obj, int index)
+{
+    if (obj->live_sections != NULL && !obj->live_sections[index]) return 0;
+    if (obj->folded_sections != NULL && obj->folded_sections[index]) return 0;
+    return 1;
+}
+
+// the space for a section of size with --incremental, which leaves room for
+// it to grow when it is patched in place.
+int reserved_section_size(int size) { return size + size / 4 + 64; }
+
+// append the section of index in obj to its output section in sections
+// unless it is already placed or isn't loaded into memory. If padded, it
+// takes the space reserved for --incremental.
+void place_in_output_section(Vector *sections, ObjectData *obj, int index,
+                             int padded)
+{
+    if (index == 0 || index >= obj->nshdr) return;
+    char *entry = section_header(obj, index);
+    int flags = read_dword(entry + 8), type = read_dword(entry + 4);
+    if (obj->section_offsets[index] >= 0) return;
+    if (!(flags & SHF_ALLOC)) return;
+    if (!is_loaded_section(obj, index)) return;
+
+    OutputSection *sec = find_output_section(
+        sections, output_section_name(obj, index), flags, type);
+    // each piece is aligned to 16 bytes like the objects were.
+    sec->size = roundup(sec->size, max(16, read_dword(entry + 48)));
+    obj->section_offsets[index] = sec->size;
+    int size = read_dword(entry + 32);
+    sec->size += padded ? reserved_section_size(size) : size;
+}
+
+// merge the sections of objs that are loaded into memory, and place them in
+// segments. The sections in order_objs and order_indices come first in their
+// output sections in that order, and the others follow in the order of objs.
+// The section offsets of objects are at first relative to their output
+// sections.
+Vector *merge_sections(Vector *objs, Vector *order_objs, Vector *order_indices,
+                       int padded)
+{
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 0; j < obj->nshdr; j++) obj->section_offsets[j] = -1;
+    }
+
+    Vector *sections = new_vector();
+    for (int i = 0; i < vector_size(order_objs); i++)
+        place_in_output_section(sections,
+                                (ObjectData *)vector_get(order_objs, i),
+                                (int)vector_get(order_indices, i), padded);
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 1; j < obj->nshdr; j++)
+            place_in_output_section(sections, obj, j, padded);
+    }
+
+    // order the sections by segment, keeping the order of appearance.
+    Vector *sorted = new_vector();
+    for (int rank = 0; rank < 3; rank++) {
+        for (int i = 0; i < vector_size(sections); i++) {
+            OutputSection *sec = (OutputSection *)vector_get(sections, i);
+            if (segment_rank(sec->flags, sec->type) == rank)
+                vector_push_back(sorted, sec);
+        }
+    }
+    return sorted;
+}
+
+// place the sections of rank from the i-th one at *offset, and return the
+// index of the next section.
+int place_sections(Vector *sections, int i, int rank, int *offset)
+{
+    for (; i < vector_size(sections); i++) {
+        OutputSection *sec = (OutputSection *)vector_get(sections, i);
+        if (segment_rank(sec->flags, sec->type) != rank) break;
+        *offset = roundup(*offset, 16);
+        sec->offset = *offset;
+        *offset += sec->size;
+    }
+    return i;
+}
+
+// decide where the sections are in the image.
+void layout_sections(ExeImage *exe)
+{
+    int offset = exe->header_size;
+    int i = place_sections(exe->sections, 0, 0, &offset);
+    exe->text_size = offset;
+
+    // the R+W segment starts at a new page. In the file it follows the R+X
+    // one, keeping the offset in the page the same.
+    exe->data_file_offset = roundup(offset, 16);
+    exe->data_offset = roundup(offset, 4096) + exe->data_file_offset % 4096;
+    offset = exe->data_offset;
+    i = place_sections(exe->sections, i, 1, &offset);
+    exe->data_filesz = offset - exe->data_offset;
+    place_sections(exe->sections, i, 2, &offset);
+    exe->data_memsz = offset - exe->data_offset;
+}
+
+// A global symbol defined in an object.
+typedef struct {
+    char *name;
+    int hash;
+    ObjectData *obj;
+    char *entry;  // in the symtab of obj
+    // the index in the state of --incremental, and the offset in the image
+    // of the one kept by it, whose obj is NULL.
+    int index, offset;
+} Symbol;
+
+// Hash table with open addressing of global symbols. The one of all objects
+// is built once so that each relocation is resolved without scanning the
+// symbols of all objects.
+struct SymbolTable {
+    Symbol **slots;
+    int nslots;  // a power of 2
+};
+
+// The kinds of work which ld splits over threads by objects. aqcc has no
+// function pointers, so run_link_job() dispatches them by kind.
+enum { JOB_HASH_SYMBOLS, JOB_COPY_SECTIONS, JOB_RELOCATE };
+
+typedef struct {
+    int kind;
+    Vector *objs;
+    int begin, end;  // the range of objs to work on
+    // for JOB_HASH_SYMBOLS
+    Symbol *syms;
+    int *bases;
+    // for JOB_COPY_SECTIONS and JOB_RELOCATE
+    ExeImage *exe;
+    int vaddr;
+} LinkJob;
+
+LinkJob *new_link_job(int kind, Vector *objs)
+{
+    LinkJob *job = (LinkJob *)safe_malloc(sizeof(LinkJob));
+    memset(job, 0, sizeof(LinkJob));
+    job->kind = kind;
+    job->objs = objs;
+    job->begin = 0;
+    job->end = vector_size(objs);
+    return job;
+}
+
+void hash_global_symbols(Vector *objs, int begin, int end, Symbol *syms,
+                         int *bases);
+void copy_sections(ExeImage *exe, int begin, int end);
+void relocate_objs(ExeImage *exe, int begin, int end, int vaddr);
+
+void run_link_job(LinkJob *job)
+{
+    switch (job->kind) {
+        case JOB_HASH_SYMBOLS:
+            hash_global_symbols(job->objs, job->begin, job->end, job->syms,
+                                job->bases);
+            break;
+
+        case JOB_COPY_SECTIONS:
+            copy_sections(job->exe, job->begin, job->end);
+            break;
+
+        case JOB_RELOCATE:
+            relocate_objs(job->exe, job->begin, job->end, job->vaddr);
+            break;
+
+        default:
+            assert(0);
+    }
+}
+
+// A thread which runs the parts of jobs that run_link_job_in_parallel() hands
+// to it. There are no atomic instructions in aqcc, so each word has a single
+// writer: the caller sets job and then bumps start, and the worker runs job
+// and then sets done to start. Each of them sleeps on the other's word.
+typedef struct {
+    LinkJob *job;
+    int start;  // the number of jobs handed to the worker
+    int done;   // the number of jobs the worker has finished
+} LinkWorker;
+
+// The workers are started when a job first needs them and wait for the next
+// one until ld exits, so a link doesn't spawn threads for each step.
+Vector *link_workers;
+
+// the entry of the threads of thread_create().
+void thread_main(void *arg)
+{
+    LinkWorker *worker = (LinkWorker *)arg;
+    while (1) {
+        while (worker->start == worker->done)
+            futex_wait(&worker->start, worker->done);
+        run_link_job(worker->job);
+        worker->done = worker->start;
+        futex_wake(&worker->done);
+    }
+}
+
+LinkWorker *get_link_worker(int index)
+{
+    if (link_workers == NULL) link_workers = new_vector();
+    while (vector_size(link_workers) <= index) {
+        LinkWorker *worker = (LinkWorker *)safe_malloc(sizeof(LinkWorker));
+        memset(worker, 0, sizeof(LinkWorker));
+        if (thread_create(worker) < 0) error("can't create a thread");
+        vector_push_back(link_workers, worker);
+    }
+    return (LinkWorker *)vector_get(link_workers, index);
+}
+
+// run job over its objects split into nthreads parts of about the same
+// number of objects. Each part works on different objects and different
+// bytes of the output, so the output doesn't depend on nthreads. The calling
+// thread does the first part and the workers do the others.
+void run_link_job_in_parallel(LinkJob *job, int nthreads)
+{
+    int nobjs = job->end - job->begin;
+    nthreads = max(1, min(nthreads, nobjs));
+    for (int i = nthreads - 1; i >= 0; i--) {
+        LinkJob *part = (LinkJob *)safe_malloc(sizeof(LinkJob));
+        memcpy(part, job, sizeof(LinkJob));
+        part->begin = job->begin + nobjs * i / nthreads;
+        part->end = job->begin + nobjs * (i + 1) / nthreads;
+        if (i == 0) {
+            run_link_job(part);
+            break;
+        }
+        LinkWorker *worker = get_link_worker(i - 1);
+        worker->job = part;
+        worker->start++;
+        futex_wake(&worker->start);
+    }
+
+    // a worker with a job has done start - 1 of them until it finishes.
+    for (int i = 0; i < nthreads - 1; i++) {
+        LinkWorker *worker = get_link_worker(i);
+        while (worker->done != worker->start)
+            futex_wait(&worker->done, worker->start - 1);
+    }
+}
+
+int hash_symbol_name(char *name)
+{
+    int hash = 5381;
+    for (int i = 0; name[i] != '\0'; i++) hash = hash * 33 + name[i];
+    return hash;
+}
+
+// an empty table which can hold nsyms symbols.
+SymbolTable *new_symbol_table(int nsyms)
+{
+    // keep the load factor at most 1/2.
+    SymbolTable *table = (SymbolTable *)safe_malloc(sizeof(SymbolTable));
+    table->nslots = 16;
+    while (table->nslots < nsyms * 2) table->nslots *= 2;
+    table->slots = (Symbol **)safe_malloc(sizeof(Symbol *) * table->nslots);
+    memset(table->slots, 0, sizeof(Symbol *) * table->nslots);
+    return table;
+}
+
+int count_symbols(Vector *objs)
+{
+    int nsyms = 0;
+    for (int i = 0; i < vector_size(objs); i++)
+        nsyms += ((ObjectData *)vector_get(objs, i))->nsymtab;
+    return nsyms;
+}
+
+// the slot where the symbol of name is or should be.
+int find_symbol_slot(SymbolTable *table, char *name, int hash)
+{
+    int i = hash & (table->nslots - 1);
+    while (1) {
+        Symbol *sym = table->slots[i];
+        if (sym == NULL) return i;
+        if (sym->hash == hash && strcmp(sym->name, name) == 0) return i;
+        i = (i + 1) & (table->nslots - 1);
+    }
+}
+
+// the offset of the symbol of symtab_entry in the image.
+int symbol_offset(ObjectData *obj, char *symtab_entry)
+{
+    int offset = obj->section_offsets[read_word(symtab_entry + 6)];
+    assert(offset >= 0);
+    return offset + read_dword(symtab_entry + 8);
+}
+
+// add the global symbols defined in obj to table. If one is already in it,
+// it is an error unless allow_duplicate is set, and then the first one is
+// kept.
+void add_global_symbols(SymbolTable *table, ObjectData *obj,
+                        int allow_duplicate)
+{
+    for (int j = 0; j < obj->nsymtab; j++) {
+        char *entry = obj->symtab + 24 * j;
+        int st_info = read_byte(entry + 4), st_shndx = read_word(entry + 6);
+        if (st_shndx == 0 || !(st_info & 0x10)) continue;
+
+        char *name = obj->strtab + read_dword(entry);
+        int hash = hash_symbol_name(name);
+        int slot = find_symbol_slot(table, name, hash);
+        if (table->slots[slot] != NULL) {
+            if (allow_duplicate) continue;
+            error("duplicate symbol: %s in %s and %s", name,
+                  table->slots[slot]->obj->path, obj->path);
+        }
+
+        Symbol *sym = (Symbol *)safe_malloc(sizeof(Symbol));
+        sym->name = name;
+        sym->hash = hash;
+        sym->obj = obj;
+        sym->entry = entry;
+        table->slots[slot] = sym;
+    }
+}
+
+// fill syms[bases[i] + j] with the j-th symbol in the symtab of the i-th
+// object of objs in [begin, end) if it is a defined global one. This is the
+// part of collecting the global symbols which is done in parallel.
+void hash_global_symbols(Vector *objs, int begin, int end, Symbol *syms,
+                         int *bases)
+{
+    for (int i = begin; i < end; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 0; j < obj->nsymtab; j++) {
+            char *entry = obj->symtab + 24 * j;
+            int st_info = read_byte(entry + 4),
+                st_shndx = read_word(entry + 6);
+            if (st_shndx == 0 || !(st_info & 0x10)) continue;
+
+            Symbol *sym = syms + bases[i] + j;
+            sym->name = obj->strtab + read_dword(entry);
+            sym->hash = hash_symbol_name(sym->name);
+            sym->obj = obj;
+            sym->entry = entry;
+        }
+    }
+}
+
+// collect the global symbols of objs. They are hashed by nthreads threads
+// and then added to the table in order, so that the first one of duplicate
+// symbols is always the same.
+SymbolTable *collect_global_symbols(Vector *objs, int nthreads)
+{
+    int nobjs = vector_size(objs);
+    int *bases = (int *)safe_malloc(sizeof(int) * (nobjs + 1));
+    bases[0] = 0;
+    for (int i = 0; i < nobjs; i++)
+        bases[i + 1] =
+            bases[i] + ((ObjectData *)vector_get(objs, i))->nsymtab;
+    Symbol *syms = (Symbol *)safe_malloc(sizeof(Symbol) * bases[nobjs]);
+    memset(syms, 0, sizeof(Symbol) * bases[nobjs]);
+
+    LinkJob *job = new_link_job(JOB_HASH_SYMBOLS, objs);
+    job->syms = syms;
+    job->bases = bases;
+    run_link_job_in_parallel(job, nthreads);
+
+    SymbolTable *table = new_symbol_table(bases[nobjs]);
+    for (int i = 0; i < bases[nobjs]; i++) {
+        Symbol *sym = syms + i;
+        if (sym->obj == NULL) continue;
+        int slot = find_symbol_slot(table, sym->name, sym->hash);
+        if (table->slots[slot] != NULL)
+            error("duplicate symbol: %s in %s and %s", sym->name,
+                  table->slots[slot]->obj->path, sym->obj->path);
+        table->slots[slot] = sym;
+    }
+    return table;
+}
+
+Symbol *lookup_global_symbol(SymbolTable *table, char *name)
+{
+    return table->slots[find_symbol_slot(table, name, hash_symbol_name(name))];
+}
+
+// the offset of the global symbol sym in the image.
+int global_symbol_offset(Symbol *sym)
+{
+    if (sym->obj == NULL) return sym->offset;
+    return symbol_offset(sym->obj, sym->entry);
+}
+
+// the address of the symbol of name in the image loaded at vaddr.
+int search_symbol(SymbolTable *table, char *name, int vaddr)
+{
+    Symbol *sym = lookup_global_symbol(table, name);
+    if (sym == NULL) error("undefined symbol: %s", name);
+    return vaddr + global_symbol_offset(sym);
+}
+
+// add the objects and archives at paths to objs. Like ar archives are
+// usually linked, a member of an archive is added only if it defines a symbol
+// which is undefined in objs, and its undefined symbols may in turn need
+// other members until no more are needed.
+void read_input_files(Vector *objs, Vector *paths)
+{
+    Vector *members = new_vector();
+    for (int i = 0; i < vector_size(paths); i++) {
+        char *path = (char *)vector_get(paths, i);
+        int size = 0;
+        char *data = read_binary_file(path, &size);
+        if (is_archive(data, size)) {
+            Vector *objs_in_archive = read_archive_members(path, data, size);
+            for (int j = 0; j < vector_size(objs_in_archive); j++)
+                ((ObjectData *)vector_get(objs_in_archive, j))->input = i;
+            vector_push_back_vector(members, objs_in_archive);
+            continue;
+        }
+        ObjectData *obj = new_object_data(data, size);
+        obj->path = path;
+        obj->input = i;
+        vector_push_back(objs, obj);
+    }
+    if (vector_size(members) == 0) return;
+
+    // the first member defining a symbol is used for it.
+    SymbolTable *index = new_symbol_table(count_symbols(members));
+    for (int i = 0; i < vector_size(members); i++)
+        add_global_symbols(index, (ObjectData *)vector_get(members, i), 1);
+
+    // duplicate symbols are reported when the objects are laid out.
+    SymbolTable *defined =
+        new_symbol_table(count_symbols(objs) + count_symbols(members));
+    for (int i = 0; i < vector_size(objs); i++)
+        add_global_symbols(defined, (ObjectData *)vector_get(objs, i), 1);
+
+    // objs grows while it is scanned, so the added members are also scanned.
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 1; j < obj->nsymtab; j++) {
+            char *entry = obj->symtab + 24 * j;
+            char *name = obj->strtab + read_dword(entry);
+            if (read_word(entry + 6) != 0 || name[0] == '\0' ||
+                lookup_global_symbol(defined, name) != NULL)
+                continue;
+
+            // an undefined symbol not in the index is reported later.
+            Symbol *sym = lookup_global_symbol(index, name);
+            if (sym == NULL) continue;
+            vector_push_back(objs, sym->obj);
+            add_global_symbols(defined, sym->obj, 1);
+        }
+    }
+}
+
+// mark the section of index in obj live, and add it to the worklist of
+// live_objs and live_indices unless it is already marked.
+void mark_section(ObjectData *obj, int index, Vector *live_objs,
+                  Vector *live_indices)
+{
+    // SHN_UNDEF or the special ones e.g. SHN_ABS.
+    if (index == 0 || index >= obj->nshdr) return;
+    if (obj->live_sections[index]) return;
+    obj->live_sections[index] = 1;
+    vector_push_back(live_objs, obj);
+    vector_push_back(live_indices, (void *)index);
+}
+
+// mark the sections which may be used, i.e. the ones reachable from the
+// section of the symbol root through relocations, for --gc-sections.
+void mark_live_sections(Vector *objs, SymbolTable *symbols, char *root)
+{
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        obj->live_sections = safe_malloc(obj->nshdr);
+        memset(obj->live_sections, 0, obj->nshdr);
+    }
+
+    Vector *live_objs = new_vector(), *live_indices = new_vector();
+    Symbol *entry = lookup_global_symbol(symbols, root);
+    if (entry == NULL) error("undefined symbol: %s", root);
+    mark_section(entry->obj, read_word(entry->entry + 6), live_objs,
+                 live_indices);
+
+    // the worklist grows while it is scanned.
+    for (int i = 0; i < vector_size(live_objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(live_objs, i);
+        int index = (int)vector_get(live_indices, i);
+
+        for (int j = 1; j < obj->nshdr; j++) {
+            char *rela_shdr = section_header(obj, j);
+            if (read_dword(rela_shdr + 4) != SHT_RELA ||
+                read_dword(rela_shdr + 44) != index)
+                continue;
+
+            char *rela = obj->data + read_dword(rela_shdr + 24);
+            int nrela = read_dword(rela_shdr + 32) / 24;
+            for (int k = 0; k < nrela; k++) {
+                char *symtab_entry =
+                    obj->symtab + 24 * read_dword(rela + k * 24 + 12);
+                int st_info = read_byte(symtab_entry + 4),
+                    st_shndx = read_word(symtab_entry + 6);
+                if (st_shndx != 0 && !(st_info & 0x10)) {
+                    mark_section(obj, st_shndx, live_objs, live_indices);
+                    continue;
+                }
+
+                // an undefined one is reported if it is relocated.
+                Symbol *sym = lookup_global_symbol(
+                    symbols, obj->strtab + read_dword(symtab_entry));
+                if (sym == NULL) continue;
+                mark_section(sym->obj, read_word(sym->entry + 6), live_objs,
+                             live_indices);
+            }
+        }
+    }
+}
+
+// A section of code which may be folded into an identical one by --icf.
+typedef struct IcfSection IcfSection;
+struct IcfSection {
+    ObjectData *obj;
+    int index, size;
+    char *data;
+    Vector *relas;  // vector<IcfRela *>
+    int foldable;   // no undefined symbols, and the address isn't taken
+    // the index of the first candidate identical to this one so far.
+    int class, next_class;
+    IcfSection *leader;  // the section this one is folded into
+};
+
+// A relocation of an IcfSection, whose target is resolved.
+typedef struct {
+    int offset, type;
+    ObjectData *obj;  // where the target is
+    int index, target_offset;
+} IcfRela;
+
+// the target of the relocation against symtab_entry of obj. Return the object
+// and set the section index and the offset in it, or return NULL if it is
+// undefined.
+ObjectData *resolve_rela_target(ObjectData *obj, char *symtab_entry,
+                                SymbolTable *symbols, int *index, int *offset)
+{
+    int st_info = read_byte(symtab_entry + 4);
+    if (read_word(symtab_entry + 6) == 0 || st_info & 0x10) {
+        Symbol *sym = lookup_global_symbol(
+            symbols, obj->strtab + read_dword(symtab_entry));
+        if (sym == NULL) return NULL;
+        obj = sym->obj;
+        symtab_entry = sym->entry;
+    }
+    *index = read_word(symtab_entry + 6);
+    *offset = read_dword(symtab_entry + 8);
+    return obj;
+}
+
+// the loaded code sections of objs, the candidates of --icf, with their
+// relocations. With safe, the sections whose addresses are taken i.e. used
+// other than by call and jmp aren't foldable, since a program may compare
+// the addresses of functions.
+Vector *collect_icf_sections(Vector *objs, SymbolTable *symbols, int safe)
+{
+    Vector *secs = new_vector();
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        obj->icf_sections = (int *)safe_malloc(sizeof(int) * obj->nshdr);
+        obj->folded_sections = safe_malloc(obj->nshdr);
+        memset(obj->folded_sections, 0, obj->nshdr);
+        for (int j = 0; j < obj->nshdr; j++) {
+            char *entry = section_header(obj, j);
+            int flags = read_dword(entry + 8);
+            obj->icf_sections[j] = -1;
+            if (j == 0 || !(flags & SHF_ALLOC) || !(flags & SHF_EXECINSTR) ||
+                flags & SHF_WRITE || read_dword(entry + 32) == 0 ||
+                !is_loaded_section(obj, j))
+                continue;
+
+            IcfSection *sec = (IcfSection *)safe_malloc(sizeof(IcfSection));
+            sec->obj = obj;
+            sec->index = j;
+            sec->size = read_dword(entry + 32);
+            sec->data = obj->data + read_dword(entry + 24);
+            sec->relas = new_vector();
+            sec->foldable = 1;
+            sec->class = sec->next_class = vector_size(secs);
+            obj->icf_sections[j] = vector_size(secs);
+            vector_push_back(secs, sec);
+        }
+    }
+
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 1; j < obj->nshdr; j++) {
+            char *rela_shdr = section_header(obj, j);
+            int target = read_dword(rela_shdr + 44);
+            // debug sections point to code without taking its address.
+            if (read_dword(rela_shdr + 4) != SHT_RELA ||
+                !is_loaded_section(obj, target) ||
+                !(read_dword(section_header(obj, target) + 8) & SHF_ALLOC))
+                continue;
+            char *rela = obj->data + read_dword(rela_shdr + 24),
+                 *target_data =
+                     obj->data + read_dword(section_header(obj, target) + 24);
+            IcfSection *src = NULL;
+            if (obj->icf_sections[target] >= 0)
+                src = vector_get(secs, obj->icf_sections[target]);
+
+            for (int k = 0; k < read_dword(rela_shdr + 32) / 24; k++) {
+                char *entry = rela + k * 24;
+                IcfRela *ent = (IcfRela *)safe_malloc(sizeof(IcfRela));
+                ent->offset = read_dword(entry);
+                ent->type = read_dword(entry + 8);
+                ent->obj = resolve_rela_target(
+                    obj, obj->symtab + 24 * read_dword(entry + 12), symbols,
+                    &ent->index, &ent->target_offset);
+                ent->target_offset += read_dword(entry + 16);
+
+                if (src != NULL) {
+                    vector_push_back(src->relas, ent);
+                    if (ent->obj == NULL) src->foldable = 0;
+                }
+                if (!safe || ent->obj == NULL || ent->index >= ent->obj->nshdr)
+                    continue;
+                int dst = ent->obj->icf_sections[ent->index];
+                if (dst < 0) continue;
+                // call rel32 is E8 and jmp rel32 is E9.
+                int opcode = 0;
+                if (ent->offset > 0)
+                    opcode = read_byte(target_data + ent->offset - 1);
+                if (ent->type != 2 || (opcode != 0xe8 && opcode != 0xe9))
+                    ((IcfSection *)vector_get(secs, dst))->foldable = 0;
+            }
+        }
+    }
+    return secs;
+}
+
+int hash_icf_section(IcfSection *sec)
+{
+    int hash = 5381;
+    for (int i = 0; i < sec->size; i++) hash = hash * 33 + sec->data[i];
+    for (int i = 0; i < vector_size(sec->relas); i++) {
+        IcfRela *ent = (IcfRela *)vector_get(sec->relas, i);
+        hash = (hash * 33 + ent->offset) * 33 + ent->type;
+    }
+    return hash;
+}
+
+// whether a and b are identical except for the sections of the targets of
+// their relocations.
+int same_icf_contents(IcfSection *a, IcfSection *b)
+{
+    if (a->size != b->size || memcmp(a->data, b->data, a->size) != 0 ||
+        vector_size(a->relas) != vector_size(b->relas))
+        return 0;
+    for (int i = 0; i < vector_size(a->relas); i++) {
+        IcfRela *ra = (IcfRela *)vector_get(a->relas, i),
+                *rb = (IcfRela *)vector_get(b->relas, i);
+        if (ra->offset != rb->offset || ra->type != rb->type ||
+            ra->target_offset != rb->target_offset)
+            return 0;
+    }
+    return 1;
+}
+
+// whether the relocations of a and b, which have the same contents, point to
+// the same sections or the ones of the same class.
+int same_icf_targets(Vector *secs, IcfSection *a, IcfSection *b)
+{
+    for (int i = 0; i < vector_size(a->relas); i++) {
+        IcfRela *ra = (IcfRela *)vector_get(a->relas, i),
+                *rb = (IcfRela *)vector_get(b->relas, i);
+        if (ra->obj == rb->obj && ra->index == rb->index) continue;
+        if (ra->index >= ra->obj->nshdr || rb->index >= rb->obj->nshdr)
+            return 0;
+        int ia = ra->obj->icf_sections[ra->index],
+            ib = rb->obj->icf_sections[rb->index];
+        if (ia < 0 || ib < 0) return 0;
+        if (((IcfSection *)vector_get(secs, ia))->class !=
+            ((IcfSection *)vector_get(secs, ib))->class)
+            return 0;
+    }
+    return 1;
+}
+
+// fold the identical code sections of objs into one, and return the folded
+// ones. Like lld does, the candidates are first grouped by their contents,
+// and then the groups are split until the targets of the relocations of the
+// sections in each group are in the same group. The first section of a group
+// is left and the others are folded into it.
+Vector *fold_identical_sections(Vector *objs, SymbolTable *symbols, int safe)
+{
+    Vector *secs = collect_icf_sections(objs, symbols, safe);
+    int nsecs = vector_size(secs);
+
+    int nbuckets = 16;
+    while (nbuckets < nsecs * 2) nbuckets *= 2;
+    Vector **buckets = (Vector **)safe_malloc(sizeof(Vector *) * nbuckets);
+    for (int i = 0; i < nbuckets; i++) buckets[i] = new_vector();
+    for (int i = 0; i < nsecs; i++) {
+        IcfSection *sec = (IcfSection *)vector_get(secs, i);
+        if (!sec->foldable) continue;
+        Vector *bucket = buckets[hash_icf_section(sec) & (nbuckets - 1)];
+        for (int j = 0; j < vector_size(bucket); j++) {
+            IcfSection *other = (IcfSection *)vector_get(bucket, j);
+            if (!same_icf_contents(other, sec)) continue;
+            sec->class = other->class;
+            break;
+        }
+        if (sec->class == i) vector_push_back(bucket, sec);
+    }
+
+    // reps[c] has the first sections of the new classes split from class c.
+    Vector **reps = (Vector **)safe_malloc(sizeof(Vector *) * nsecs);
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = 0; i < nsecs; i++) reps[i] = NULL;
+        for (int i = 0; i < nsecs; i++) {
+            IcfSection *sec = (IcfSection *)vector_get(secs, i);
+            if (reps[sec->class] == NULL) reps[sec->class] = new_vector();
+            Vector *rep = reps[sec->class];
+            sec->next_class = i;
+            for (int j = 0; j < vector_size(rep); j++) {
+                IcfSection *other = (IcfSection *)vector_get(rep, j);
+                if (!same_icf_targets(secs, other, sec)) continue;
+                sec->next_class = other->next_class;
+                break;
+            }
+            if (sec->next_class == i) vector_push_back(rep, sec);
+            if (sec->next_class != sec->class) changed = 1;
+        }
+        for (int i = 0; i < nsecs; i++) {
+            IcfSection *sec = (IcfSection *)vector_get(secs, i);
+            sec->class = sec->next_class;
+        }
+    }
+
+    Vector *folded = new_vector();
+    for (int i = 0; i < nsecs; i++) {
+        IcfSection *sec = (IcfSection *)vector_get(secs, i);
+        if (sec->class == i) continue;
+        sec->leader = (IcfSection *)vector_get(secs, sec->class);
+        sec->obj->folded_sections[sec->index] = 1;
+        vector_push_back(folded, sec);
+    }
+    return folded;
+}
+
+// add the sections defining the symbols listed in the file at path to
+// order_objs and order_indices in the order of the file. The symbols are
+// separated by white spaces, e.g. one per line, and the ones not defined are
+// warned and ignored. A profiler can make the file from the hot functions.
+void read_symbol_order(char *path, SymbolTable *symbols, Vector *order_objs,
+                       Vector *order_indices)
+{
+    int size = 0;
+    char *data = read_binary_file(path, &size);
+    for (int i = 0; i < size;) {
+        if (isspace(data[i])) {
+            i++;
+            continue;
+        }
+        int len = 0;
+        while (i + len < size && !isspace(data[i + len])) len++;
+        char *name = safe_malloc(len + 1);
+        memcpy(name, data + i, len);
+        name[len] = '\0';
+        i += len;
+
+        Symbol *sym = lookup_global_symbol(symbols, name);
+        if (sym == NULL) {
+            warn("%s: no such symbol: %s", path, name);
+            continue;
+        }
+        vector_push_back(order_objs, sym->obj);
+        vector_push_back(order_indices, (void *)read_word(sym->entry + 6));
+    }
+}
+
+// A code section in the call graph of --call-graph-order.
+typedef struct {
+    ObjectData *obj;
+    int index;
+    int cluster;  // the index of the cluster this section is in
+} CallGraphNode;
+
+// Calls from the section of index from to the one of index to, which are
+// CallGraphNodes.
+typedef struct {
+    int from, to;
+    int weight;  // the number of the calls
+} CallGraphEdge;
+
+// A list of sections which are laid out contiguously.
+typedef struct {
+    Vector *nodes;  // vector<CallGraphNode *>
+    int weight;     // the total weight of the edges merged into it
+} CallGraphCluster;
+
+// the loaded code sections of objs, which are the nodes of the call graph.
+Vector *collect_call_graph_nodes(Vector *objs)
+{
+    Vector *nodes = new_vector();
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        obj->call_graph_nodes = (int *)safe_malloc(sizeof(int) * obj->nshdr);
+        for (int j = 0; j < obj->nshdr; j++) {
+            char *entry = section_header(obj, j);
+            int flags = read_dword(entry + 8);
+            obj->call_graph_nodes[j] = -1;
+            if (j == 0 || !(flags & SHF_ALLOC) || !(flags & SHF_EXECINSTR) ||
+                read_dword(entry + 32) == 0 || !is_loaded_section(obj, j))
+                continue;
+
+            CallGraphNode *node =
+                (CallGraphNode *)safe_malloc(sizeof(CallGraphNode));
+            node->obj = obj;
+            node->index = j;
+            node->cluster = vector_size(nodes);
+            obj->call_graph_nodes[j] = vector_size(nodes);
+            vector_push_back(nodes, node);
+        }
+    }
+    return nodes;
+}
+
+// the edges of the call graph of nodes, i.e. the calls between different
+// sections found in the relocations of call and jmp. The calls of the same
+// caller and callee are counted in one edge.
+Vector *collect_call_graph_edges(Vector *objs, SymbolTable *symbols,
+                                 Vector *nodes)
+{
+    Vector *edges = new_vector();
+    Vector **out_edges =
+        (Vector **)safe_malloc(sizeof(Vector *) * vector_size(nodes));
+    for (int i = 0; i < vector_size(nodes); i++) out_edges[i] = new_vector();
+
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 1; j < obj->nshdr; j++) {
+            char *rela_shdr = section_header(obj, j);
+            int target = read_dword(rela_shdr + 44);
+            if (read_dword(rela_shdr + 4) != SHT_RELA ||
+                obj->call_graph_nodes[target] < 0)
+                continue;
+            int from = obj->call_graph_nodes[target];
+            char *rela = obj->data + read_dword(rela_shdr + 24),
+                 *target_data =
+                     obj->data + read_dword(section_header(obj, target) + 24);
+
+            for (int k = 0; k < read_dword(rela_shdr + 32) / 24; k++) {
+                char *entry = rela + k * 24;
+                int offset = read_dword(entry), index = 0, target_offset = 0;
+                // call rel32 is E8 and jmp rel32 is E9.
+                int opcode = 0;
+                if (offset > 0) opcode = read_byte(target_data + offset - 1);
+                if (read_dword(entry + 8) != 2 ||
+                    (opcode != 0xe8 && opcode != 0xe9))
+                    continue;
+                ObjectData *callee = resolve_rela_target(
+                    obj, obj->symtab + 24 * read_dword(entry + 12), symbols,
+                    &index, &target_offset);
+                if (callee == NULL || index >= callee->nshdr) continue;
+                int to = callee->call_graph_nodes[index];
+                if (to < 0 || to == from) continue;
+
+                CallGraphEdge *edge = NULL;
+                for (int l = 0; l < vector_size(out_edges[from]); l++) {
+                    CallGraphEdge *e =
+                        (CallGraphEdge *)vector_get(out_edges[from], l);
+                    if (e->to == to) edge = e;
+                }
+                if (edge == NULL) {
+                    edge = (CallGraphEdge *)safe_malloc(sizeof(CallGraphEdge));
+                    edge->from = from;
+                    edge->to = to;
+                    edge->weight = 0;
+                    vector_push_back(out_edges[from], edge);
+                    vector_push_back(edges, edge);
+                }
+                edge->weight++;
+            }
+        }
+    }
+    return edges;
+}
+
+// sort edges by their weights in descending order. It is a merge sort, which
+// is stable so that the order doesn't depend on anything but the inputs.
+void sort_call_graph_edges(Vector *edges)
+{
+    int n = vector_size(edges);
+    CallGraphEdge **src =
+        (CallGraphEdge **)safe_malloc(sizeof(CallGraphEdge *) * n);
+    CallGraphEdge **dst =
+        (CallGraphEdge **)safe_malloc(sizeof(CallGraphEdge *) * n);
+    for (int i = 0; i < n; i++) src[i] = vector_get(edges, i);
+
+    for (int width = 1; width < n; width *= 2) {
+        for (int begin = 0; begin < n; begin += width * 2) {
+            int mid = min(begin + width, n), end = min(begin + width * 2, n);
+            int i = begin, j = mid, k = begin;
+            while (i < mid && j < end) {
+                if (src[j]->weight > src[i]->weight)
+                    dst[k++] = src[j++];
+                else
+                    dst[k++] = src[i++];
+            }
+            while (i < mid) dst[k++] = src[i++];
+            while (j < end) dst[k++] = src[j++];
+        }
+        CallGraphEdge **tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    for (int i = 0; i < n; i++) vector_set(edges, i, src[i]);
+}
+
+// add the code sections of objs to order_objs and order_indices in the order
+// which puts callers and callees close, derived from the call graph of the
+// relocations. Like Pettis and Hansen's algorithm, each section starts as a
+// cluster, and the two clusters of the heaviest edge between different ones
+// are merged repeatedly, the callee's after the caller's. The clusters are
+// then laid out from the heaviest one. The weight of an edge is the number of
+// the calls in the code, since there is no profile. The sections not called
+// from or calling another are left to the default order.
+void order_by_call_graph(Vector *objs, SymbolTable *symbols, Vector *order_objs,
+                         Vector *order_indices)
+{
+    Vector *nodes = collect_call_graph_nodes(objs);
+    Vector *edges = collect_call_graph_edges(objs, symbols, nodes);
+    sort_call_graph_edges(edges);
+
+    int nnodes = vector_size(nodes);
+    CallGraphCluster **clusters = (CallGraphCluster **)safe_malloc(
+        sizeof(CallGraphCluster *) * nnodes);
+    for (int i = 0; i < nnodes; i++) {
+        clusters[i] =
+            (CallGraphCluster *)safe_malloc(sizeof(CallGraphCluster));
+        clusters[i]->nodes = new_vector_from_scalar(vector_get(nodes, i));
+        clusters[i]->weight = 0;
+    }
+
+    for (int i = 0; i < vector_size(edges); i++) {
+        CallGraphEdge *edge = (CallGraphEdge *)vector_get(edges, i);
+        int from = ((CallGraphNode *)vector_get(nodes, edge->from))->cluster,
+            to = ((CallGraphNode *)vector_get(nodes, edge->to))->cluster;
+        clusters[from]->weight += edge->weight;
+        if (from == to) continue;
+
+        // merge the cluster of the callee into the one of the caller.
+        Vector *moved = clusters[to]->nodes;
+        for (int j = 0; j < vector_size(moved); j++)
+            ((CallGraphNode *)vector_get(moved, j))->cluster = from;
+        vector_push_back_vector(clusters[from]->nodes, moved);
+        clusters[from]->weight += clusters[to]->weight;
+        clusters[to] = NULL;
+    }
+
+    // pick the heaviest cluster left, or the first one of them if tied.
+    while (1) {
+        CallGraphCluster *heaviest = NULL;
+        int index = -1;
+        for (int i = 0; i < nnodes; i++) {
+            CallGraphCluster *cluster = clusters[i];
+            if (cluster == NULL || vector_size(cluster->nodes) < 2) continue;
+            if (heaviest != NULL && cluster->weight <= heaviest->weight)
+                continue;
+            heaviest = cluster;
+            index = i;
+        }
+        if (heaviest == NULL) break;
+
+        for (int i = 0; i < vector_size(heaviest->nodes); i++) {
+            CallGraphNode *node =
+                (CallGraphNode *)vector_get(heaviest->nodes, i);
+            vector_push_back(order_objs, node->obj);
+            vector_push_back(order_indices, (void *)node->index);
+        }
+        clusters[index] = NULL;
+    }
+}
+
+// lay out objs in an image whose first header_size bytes are for headers.
+// opts may remove unused or duplicate sections, and reorder them.
+ExeImage *layout_objs(Vector *objs, int header_size, LinkOptions *opts)
+{
+    ExeImage *exe = (ExeImage *)safe_malloc(sizeof(ExeImage));
+    exe->objs = objs;
+    exe->header_size = header_size;
+    exe->nthreads = max(1, opts->threads);
+    exe->symbols = collect_global_symbols(objs, exe->nthreads);
+    if (opts->gc_sections)
+        mark_live_sections(objs, exe->symbols, "_start");
+    Vector *folded = new_vector();
+    if (opts->icf != ICF_NONE)
+        folded = fold_identical_sections(objs, exe->symbols,
+                                         opts->icf == ICF_SAFE);
+    // the sections listed in the ordering file come first, and then the ones
+    // ordered by the call graph.
+    Vector *order_objs = new_vector(), *order_indices = new_vector();
+    if (opts->symbol_ordering_file != NULL)
+        read_symbol_order(opts->symbol_ordering_file, exe->symbols, order_objs,
+                          order_indices);
+    if (opts->call_graph_order)
+        order_by_call_graph(objs, exe->symbols, order_objs, order_indices);
+    exe->sections =
+        merge_sections(objs, order_objs, order_indices, opts->incremental);
+    layout_sections(exe);
+
+    // make the offsets of the sections of objects relative to the image.
+    for (int i = 0; i < vector_size(objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(objs, i);
+        for (int j = 1; j < obj->nshdr; j++) {
+            if (obj->section_offsets[j] < 0) continue;
+            char *entry = section_header(obj, j);
+            OutputSection *sec = find_output_section(
+                exe->sections, output_section_name(obj, j),
+                read_dword(entry + 8), read_dword(entry + 4));
+            obj->section_offsets[j] += sec->offset;
+        }
+    }
+
+    // a folded section is at the same place as the one it is folded into,
+    // so the symbols in it point there.
+    int saved = 0;
+    for (int i = 0; i < vector_size(folded); i++) {
+        IcfSection *sec = (IcfSection *)vector_get(folded, i);
+        sec->obj->section_offsets[sec->index] =
+            sec->leader->obj->section_offsets[sec->leader->index];
+        saved += sec->size;
+    }
+    if (opts->print_icf)
+        printf("icf: folded %d sections, %d bytes\n", vector_size(folded),
+               saved);
+
+    exe->image = NULL;
+    exe->debug_sections = new_vector();
+    exe->debug_image = NULL;
+    exe->debug_size = 0;
+    return exe;
+}
+
+void write_dword(char *data, int val)
+{
+    data[0] = val & 0xff;
+    data[1] = (val >> 8) & 0xff;
+    data[2] = (val >> 16) & 0xff;
+    data[3] = (val >> 24) & 0xff;
+}
+
+// write addr to offset in image loaded at vaddr as the relocation of type.
+void apply_relocation(char *image, int offset, int type, int addr, int vaddr)
+{
+    switch (type) {
+        case 1:  // R_X86_64_64
+            // the executable is loaded below 2GiB, so the upper half is 0.
+            write_dword(image + offset, addr);
+            write_dword(image + offset + 4, 0);
+            break;
+
+        case 2:  // R_X86_64_PC32
+            write_dword(image + offset, addr - (vaddr + offset));
+            break;
+
+        default:
+            assert(0);
+    }
+}
+
+// apply the relocation section of index rela_index of obj to the image
+// loaded at vaddr.
+void relocate_section(ExeImage *exe, ObjectData *obj, int rela_index,
+                      int vaddr)
+{
+    char *rela_shdr = section_header(obj, rela_index);
+    char *rela = obj->data + read_dword(rela_shdr + 24);
+    int nrela = read_dword(rela_shdr + 32) / 24,
+        target = read_dword(rela_shdr + 44),
+        section_offset = obj->section_offsets[target];
+    // not loaded, or folded and relocated as the other one.
+    if (section_offset < 0 || !is_loaded_section(obj, target)) return;
+
+    for (int j = 0; j < nrela; j++) {
+        char *entry = rela + j * 24;
+        int r_offset = read_dword(entry), r_info_type = read_dword(entry + 8),
+            r_info_symtabidx = read_dword(entry + 12),
+            r_addend = read_dword(entry + 16);
+        char *symtab_entry = obj->symtab + 24 * r_info_symtabidx;
+        int st_info = read_byte(symtab_entry + 4),
+            st_shndx = read_word(symtab_entry + 6);
+
+        // search new address. A local symbol is in obj itself.
+        int reled_addr = -1;
+        if (st_shndx != 0 && !(st_info & 0x10)) {
+            reled_addr = vaddr + symbol_offset(obj, symtab_entry) + r_addend;
+        }
+        else {
+            char *name = obj->strtab + read_dword(symtab_entry);
+            reled_addr = search_symbol(exe->symbols, name, vaddr) + r_addend;
+        }
+
+        apply_relocation(exe->image, section_offset + r_offset, r_info_type,
+                         reled_addr, vaddr);
+    }
+}
+
+// copy the sections of the objects of exe in [begin, end) into the image.
+void copy_sections(ExeImage *exe, int begin, int end)
+{
+    for (int i = begin; i < end; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        for (int j = 1; j < obj->nshdr; j++) {
+            char *entry = section_header(obj, j);
+            if (obj->section_offsets[j] < 0 || !is_loaded_section(obj, j) ||
+                read_dword(entry + 4) == SHT_NOBITS)
+                continue;
+            memcpy(exe->image + obj->section_offsets[j],
+                   obj->data + read_dword(entry + 24), read_dword(entry + 32));
+        }
+    }
+}
+
+// apply the relocations of the objects of exe in [begin, end) to the image
+// loaded at vaddr.
+void relocate_objs(ExeImage *exe, int begin, int end, int vaddr)
+{
+    for (int i = begin; i < end; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        for (int j = 1; j < obj->nshdr; j++)
+            if (read_dword(section_header(obj, j) + 4) == SHT_RELA)
+                relocate_section(exe, obj, j, vaddr);
+    }
+}
+
+// copy the sections of the objects into image, which will be loaded at vaddr,
+// and relocate them.
+void build_image(ExeImage *exe, char *image, int vaddr)
+{
+    exe->image = image;
+    memset(image, 0, exe->data_offset + exe->data_memsz);
+
+    // the relocations are applied after all sections are copied.
+    LinkJob *job = new_link_job(JOB_COPY_SECTIONS, exe->objs);
+    job->exe = exe;
+    run_link_job_in_parallel(job, exe->nthreads);
+
+    job = new_link_job(JOB_RELOCATE, exe->objs);
+    job->exe = exe;
+    job->vaddr = vaddr;
+    run_link_job_in_parallel(job, exe->nthreads);
+}
+
+// load objs into memory laid out as in an executable, relocate them and
+// return the address of the symbol entry.
+int load_objs(Vector *objs, char *entry)
+{
+    LinkOptions opts;
+    memset(&opts, 0, sizeof(LinkOptions));
+    ExeImage *exe = layout_objs(objs, 0, &opts);
+    int size = roundup(exe->data_offset + exe->data_memsz, 4096);
+
+    // take the pages from the heap. It is below 2GiB as the code assumes, and
+    // unlike a new mapping it is never in the way of the heap of the program,
+    // which grows by brk from the current break.
+    int base = roundup((int)safe_malloc(size + 4096), 4096);
+    build_image(exe, (char *)base, base);
+
+    // the pages of the R+X segment become R+X like in the executable. The
+    // ones of the R+W segment are already R+W.
+    // __NR_mprotect with PROT_READ | PROT_EXEC
+    int text_size = roundup(exe->text_size, 4096);
+    if (text_size > 0 && (int)syscall(10, base, text_size, 1 | 4) < 0)
+        error("can't make the code executable");
+    return search_symbol(exe->symbols, entry, base);
 }
 
-int read_dword(char *data)
+// whether the section of index in obj has debug information e.g. the lines
+// of .debug_line, which isn't loaded into memory.
+int is_debug_section(ObjectData *obj, int index)
 {
-    return read_word(data) | (read_word(data + 2) << 16);
+    char *entry = section_header(obj, index);
+    return !(read_dword(entry + 8) & SHF_ALLOC) &&
+           read_dword(entry + 4) == SHT_PROGBITS &&
+           memcmp(section_name(obj, index), ".debug_", 7) == 0;
 }
 
-// assume that obj->shdr, obj->nshdr and obj->data are already filled.
-int get_section_offset(ObjectData *obj, char *name)
+// apply the relocation section of index rela_index of obj to its debug
+// section, which is at target in debug_image. A relocation against a debug
+// section gets the offset in its output section, and one against a section
+// removed from the image gets 0.
+void relocate_debug_section(ExeImage *exe, ObjectData *obj, int rela_index,
+                            char *target)
 {
-    char *section_strtab =
-        obj->data +
-        read_dword(obj->shdr + 0x40 * read_word(obj->data + 62) + 24);
+    char *rela_shdr = section_header(obj, rela_index);
+    char *rela = obj->data + read_dword(rela_shdr + 24);
+    int nrela = read_dword(rela_shdr + 32) / 24;
 
-    for (int i = 1; i < obj->nshdr; i++) {
-        char *entry = obj->shdr + 0x40 * i;
-        int offset = read_dword(entry + 24);
-        if (strcmp(name, section_strtab + read_dword(entry)) == 0)
-            return offset;
-    }
+    for (int j = 0; j < nrela; j++) {
+        char *entry = rela + j * 24;
+        int r_offset = read_dword(entry), r_info_type = read_dword(entry + 8),
+            r_addend = read_dword(entry + 16);
+        char *symtab_entry = obj->symtab + 24 * read_dword(entry + 12);
+        int st_info = read_byte(symtab_entry + 4),
+            st_shndx = read_word(symtab_entry + 6);
 
-    assert(0);
-}
+        int value = 0;
+        if (st_shndx == 0 || st_info & 0x10) {
+            char *name = obj->strtab + read_dword(symtab_entry);
+            value = search_symbol(exe->symbols, name, EXE_VADDR) + r_addend;
+        }
+        else if (st_shndx >= obj->nshdr)
+            error("%s: unexpected relocation in debug section", obj->path);
+        else if (obj->debug_offsets[st_shndx] >= 0)
+            value = obj->debug_offsets[st_shndx] +
+                    read_dword(symtab_entry + 8) + r_addend;
+        else if (obj->section_offsets[st_shndx] >= 0)
+            value = EXE_VADDR + symbol_offset(obj, symtab_entry) + r_addend;
 
-ObjectData *new_object_data(char *data, int data_size)
-{
-    ObjectData *obj = (ObjectData *)safe_malloc(sizeof(ObjectData));
-    obj->data = data;
-    obj->data_size = data_size;
-    obj->entire_size = roundup(data_size, 16);
-    obj->shdr = obj->symtab = obj->strtab = NULL;
+        switch (r_info_type) {
+            case 1:  // R_X86_64_64
+                write_dword(target + r_offset, value);
+                write_dword(target + r_offset + 4, 0);
+                break;
 
-    // parse data
-    obj->shdr = data + read_dword(data + 40);
-    char *section_strtab =
-        data + read_dword(obj->shdr + 0x40 * read_word(data + 62) + 24);
-    obj->nshdr = read_word(data + 60);
+            case 10:  // R_X86_64_32
+                write_dword(target + r_offset, value);
+                break;
 
-    for (int i = 1; i < obj->nshdr; i++) {
-        char *entry = obj->shdr + 0x40 * i;
-        char *offset = data + read_dword(entry + 24);
-        int size = read_dword(entry + 32);
-        char *name = section_strtab + read_dword(entry);
-        if (obj->symtab == NULL && strcmp(name, ".symtab") == 0) {
-            obj->symtab = offset;
-            obj->nsymtab = size / 24;
+            default:
+                error("%s: unexpected relocation in debug section",
+                      obj->path);
         }
-        if (obj->strtab == NULL && strcmp(name, ".strtab") == 0)
-            obj->strtab = offset;
-        if (obj->rela_text == NULL && strcmp(name, ".rela.text") == 0) {
-            obj->rela_text = offset;
-            obj->nrela_text = size / 24;
+    }
+}
+
+// merge the debug sections of the objects of exe by name into debug_image,
+// and relocate them.
+void link_debug_sections(ExeImage *exe)
+{
+    Vector *sections = exe->debug_sections;
+    for (int i = 0; i < vector_size(exe->objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        obj->debug_offsets = (int *)safe_malloc(sizeof(int) * obj->nshdr);
+        for (int j = 0; j < obj->nshdr; j++) {
+            obj->debug_offsets[j] = -1;
+            if (j == 0 || !is_debug_section(obj, j)) continue;
+            OutputSection *sec = find_output_section(
+                sections, section_name(obj, j), 0, SHT_PROGBITS);
+            // the pieces are contiguous, since a reader goes from one unit
+            // to the next by its length.
+            obj->debug_offsets[j] = sec->size;
+            sec->size += read_dword(section_header(obj, j) + 32);
         }
     }
-    assert(obj->shdr != NULL && obj->symtab != NULL && obj->strtab != NULL);
+    for (int i = 0; i < vector_size(sections); i++) {
+        OutputSection *sec = (OutputSection *)vector_get(sections, i);
+        sec->offset = exe->debug_size;
+        exe->debug_size += sec->size;
+    }
+    exe->debug_image = safe_malloc(exe->debug_size);
 
-    return obj;
+    for (int i = 0; i < vector_size(exe->objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        for (int j = 1; j < obj->nshdr; j++) {
+            if (obj->debug_offsets[j] < 0) continue;
+            char *entry = section_header(obj, j);
+            OutputSection *sec = find_output_section(
+                sections, section_name(obj, j), 0, SHT_PROGBITS);
+            char *data =
+                exe->debug_image + sec->offset + obj->debug_offsets[j];
+            memcpy(data, obj->data + read_dword(entry + 24),
+                   read_dword(entry + 32));
+
+            for (int k = 1; k < obj->nshdr; k++) {
+                char *rela_shdr = section_header(obj, k);
+                if (read_dword(rela_shdr + 4) == SHT_RELA &&
+                    read_dword(rela_shdr + 44) == j)
+                    relocate_debug_section(exe, obj, k, data);
+            }
+        }
+    }
 }
 
-ObjectData *read_entire_binary(char *filepath)
+// link the objects and archives at obj_paths.
+ExeImage *link_objs(Vector *obj_paths, LinkOptions *opts)
 {
-    FILE *fh = fopen(filepath, "rb");
-    if (fh == NULL) error("no such binary file: '%s'", filepath);
+    Vector *objs = new_vector();
+    read_input_files(objs, obj_paths);
 
-    // read the file all
-    StringBuilder *sb = new_string_builder();
-    int ch;
-    while ((ch = fgetc(fh)) != EOF) string_builder_append(sb, ch);
+    ExeImage *exe = layout_objs(objs, EXE_HEADER_SIZE, opts);
+    build_image(exe, safe_malloc(exe->data_offset + exe->data_memsz),
+                EXE_VADDR);
+    link_debug_sections(exe);
+    return exe;
+}
 
-    fclose(fh);
+// emit PT_LOAD program header.
+void emit_load_segment(int flags, int offset, int vaddr, int filesz, int memsz)
+{
+    // PT_LOAD
+    emit_dword_int(1);
+    emit_dword_int(flags);
+    // offset
+    emit_qword_int(offset, 0);
+    // virtual address in memory
+    emit_qword_int(vaddr, 0);
+    // reserved (phisical address in memory ?)
+    emit_qword_int(vaddr, 0);
+    // size of segment in file
+    emit_qword_int(filesz, 0);
+    // size of segment in memory
+    emit_qword_int(memsz, 0);
+    // alignment
+    emit_qword_int(0x1000, 0);
+}
 
-    // string_builder_size() returns the size including a null character.
-    return new_object_data(string_builder_get(sb), string_builder_size(sb) - 1);
+// emit the section header of the executable.
+void emit_exe_section_header(int name, int type, int flags, int addr,
+                             int offset, int size, int link, int info,
+                             int align, int entsize)
+{
+    emit_dword_int(name);
+    emit_dword_int(type);
+    emit_qword_int(flags, 0);
+    emit_qword_int(addr, 0);
+    emit_qword_int(offset, 0);
+    emit_qword_int(size, 0);
+    emit_dword_int(link);
+    emit_dword_int(info);
+    emit_qword_int(align, 0);
+    emit_qword_int(entsize, 0);
 }
 
-int *search_symbol_maybe(Vector *objs, const char *name, int header_offset)
+// the index of the output section of the section of index in obj, in the
+// section header table of the executable.
+int output_section_index(ExeImage *exe, ObjectData *obj, int index)
 {
-    int prev_offset = header_offset;
+    char *entry = section_header(obj, index);
+    OutputSection *sec =
+        find_output_section(exe->sections, output_section_name(obj, index),
+                            read_dword(entry + 8), read_dword(entry + 4));
+    for (int i = 0; i < vector_size(exe->sections); i++)
+        if (vector_get(exe->sections, i) == sec) return 1 + i;
+    assert(0);
+}
 
-    for (int i = 0; i < vector_size(objs); i++) {
-        ObjectData *obj = (ObjectData *)vector_get(objs, i);
-        for (int j = 0; j < obj->nsymtab; j++) {
-            char *entry = obj->symtab + 24 * j;
-            if (strcmp(obj->strtab + read_dword(entry), name) != 0) continue;
-            int st_info = read_byte(entry + 4), st_shndx = read_word(entry + 6),
-                st_value = read_dword(entry + 8);
-            if (st_shndx == 0 || !(st_info & 0x10)) continue;
-            return new_int(prev_offset +
-                           read_dword(obj->shdr + 0x40 * st_shndx + 24) +
-                           st_value);
-        }
-        prev_offset += obj->entire_size;
-    }
+// .symtab and .strtab of the executable.
+typedef struct {
+    char *symtab, *strtab;
+    int nsyms, nlocals, strtab_size;
+} OutputSymbols;
 
-    return NULL;
+// whether the symbol of symtab_entry of obj goes to the executable. The
+// labels local to functions and data, whose names start with '.', are left
+// out.
+int is_output_symbol(ObjectData *obj, char *symtab_entry)
+{
+    char *name = obj->strtab + read_dword(symtab_entry);
+    int st_info = read_byte(symtab_entry + 4),
+        st_shndx = read_word(symtab_entry + 6);
+    // STT_SECTION, or SHN_UNDEF or the special ones.
+    if ((st_info & 0xf) == 3 || st_shndx == 0 || st_shndx >= obj->nshdr)
+        return 0;
+    return obj->section_offsets[st_shndx] >= 0 && name[0] != '\0' &&
+           name[0] != '.';
 }
 
-int search_symbol(Vector *objs, const char *name, int header_offset)
+// fill the entry sym of .symtab of the executable but its name with the
+// symbol of symtab_entry of obj.
+void write_output_symbol(ExeImage *exe, char *sym, ObjectData *obj,
+                         char *symtab_entry)
 {
-    int *offset = search_symbol_maybe(objs, name, header_offset);
-    if (offset != NULL) return *offset;
-    error("undefined symbol: %s", name);
+    int index = output_section_index(exe, obj, read_word(symtab_entry + 6));
+    sym[4] = symtab_entry[4];  // st_info
+    sym[6] = index & 0xff;     // st_shndx
+    sym[7] = (index >> 8) & 0xff;
+    write_dword(sym + 8, EXE_VADDR + symbol_offset(obj, symtab_entry));
+    write_dword(sym + 16, read_dword(symtab_entry + 16));  // st_size
 }
 
-void link_objs_detail(Vector *objs, int header_offset)
+// add the symbol of symtab_entry of obj to syms with its address in the
+// executable.
+void add_output_symbol(ExeImage *exe, OutputSymbols *syms, ObjectData *obj,
+                       char *symtab_entry)
 {
-    int prev_offset = header_offset;
+    char *name = obj->strtab + read_dword(symtab_entry);
+    int len = strlen(name) + 1;
+    char *sym = syms->symtab + 24 * syms->nsyms++;
+    write_dword(sym, syms->strtab_size);  // st_name
+    write_output_symbol(exe, sym, obj, symtab_entry);
 
-    for (int i = 0; i < vector_size(objs); i++) {
-        ObjectData *obj = (ObjectData *)vector_get(objs, i);
-        for (int j = 0; j < obj->nrela_text; j++) {
-            char *entry = obj->rela_text + j * 24;
-            int r_offset = read_dword(entry),
-                r_info_type = read_dword(entry + 8),
-                r_info_symtabidx = read_dword(entry + 12),
-                r_addend = read_dword(entry + 16);
-            char *symtab_entry = obj->symtab + 24 * r_info_symtabidx;
-            int st_shndx = read_word(symtab_entry + 6);
-
-            // search new address
-            int reled_addr = -1;
-            char *name = obj->strtab + read_dword(symtab_entry);
-            int *reled_addr_maybe =
-                search_symbol_maybe(objs, name, header_offset);
-            if (reled_addr_maybe != NULL) {
-                reled_addr = *reled_addr_maybe + r_addend;
-            }
-            else {
-                if (st_shndx == 0) error("undefined symbol: %s", name);
-                reled_addr = prev_offset +
-                             read_dword(obj->shdr + 0x40 * st_shndx + 24) +
-                             read_dword(symtab_entry + 8) + r_addend;
-            }
-            assert(reled_addr != -1);
-
-            int offset = r_offset + get_section_offset(obj, ".text");
-            switch (r_info_type) {
-                case 2: {  // R_X86_64_PC32
-                    int addr = reled_addr - (prev_offset + offset);
-                    obj->data[offset] = addr & 0xff;
-                    obj->data[offset + 1] = (addr >> 8) & 0xff;
-                    obj->data[offset + 2] = (addr >> 16) & 0xff;
-                    obj->data[offset + 3] = (addr >> 24) & 0xff;
-                } break;
-
-                default:
-                    assert(0);
-            }
+    memcpy(syms->strtab + syms->strtab_size, name, len);
+    syms->strtab_size += len;
+}
+
+// the symbols of the objects of exe, whose local ones come first as ELF
+// requires.
+OutputSymbols *collect_output_symbols(ExeImage *exe)
+{
+    // count them first to allocate the tables at once.
+    int nsyms = 1, strtab_size = 1;
+    for (int i = 0; i < vector_size(exe->objs); i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        for (int j = 1; j < obj->nsymtab; j++) {
+            char *entry = obj->symtab + 24 * j;
+            if (!is_output_symbol(obj, entry)) continue;
+            nsyms++;
+            strtab_size += strlen(obj->strtab + read_dword(entry)) + 1;
         }
+    }
+
+    OutputSymbols *syms = (OutputSymbols *)safe_malloc(sizeof(OutputSymbols));
+    syms->symtab = safe_malloc(24 * nsyms);
+    memset(syms->symtab, 0, 24 * nsyms);
+    syms->strtab = safe_malloc(strtab_size);
+    syms->strtab[0] = '\0';
+    syms->nsyms = syms->strtab_size = 1;  // the null symbol and name
 
-        prev_offset += obj->entire_size;
+    for (int global = 0; global <= 1; global++) {
+        for (int i = 0; i < vector_size(exe->objs); i++) {
+            ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+            for (int j = 1; j < obj->nsymtab; j++) {
+                char *entry = obj->symtab + 24 * j;
+                if (is_output_symbol(obj, entry) &&
+                    ((read_byte(entry + 4) & 0x10) != 0) == global)
+                    add_output_symbol(exe, syms, obj, entry);
+            }
+        }
+        if (!global) syms->nlocals = syms->nsyms;
     }
+    assert(syms->nsyms == nsyms && syms->strtab_size == strtab_size);
+    return syms;
 }
 
-ExeImage *link_objs(Vector *obj_paths)
+// the bytes of .shstrtab and the section header table. They follow .symtab
+// and .strtab of syms at offset in the file, which follow the segments and
+// the debug sections. The table is at *shoff and has *shnum entries whose
+// last one is of .shstrtab.
+Vector *emit_section_table(ExeImage *exe, OutputSymbols *syms, int offset,
+                           int *shoff, int *shnum)
 {
-    int vaddr_offset = 0x400000, header_size = 4096,  // 64 + 56 + 8,
-        header_offset = vaddr_offset + header_size;
+    Vector *dumped = new_vector();
+    set_buffer_to_emit(dumped);
+    int nsections = vector_size(exe->sections),
+        ndebugs = vector_size(exe->debug_sections);
+    int strtab_offset = offset + 24 * syms->nsyms;
+    int shstrtab_offset = strtab_offset + syms->strtab_size;
 
-    Vector *objs = new_vector();
+    // .shstrtab has the names of the output sections, the debug ones and
+    // then the others.
+    emit_byte(0x00);
+    Vector *name_offsets = new_vector();
+    for (int i = 0; i < nsections + ndebugs; i++) {
+        OutputSection *sec =
+            i < nsections ? vector_get(exe->sections, i)
+                          : vector_get(exe->debug_sections, i - nsections);
+        vector_push_back(name_offsets, (void *)emitted_size());
+        emit_string(sec->name, strlen(sec->name) + 1);
+    }
+    int symtab_name = emitted_size();
+    emit_string(".symtab\0", 8);
+    emit_string(".strtab\0", 8);
+    emit_string(".shstrtab\0", 10);
+    int shstrtab_size = emitted_size();
+    while ((shstrtab_offset + emitted_size()) % 8 != 0) emit_byte(0);
 
-    for (int i = 0; i < vector_size(obj_paths); i++)
-        vector_push_back(objs,
-                         read_entire_binary((char *)vector_get(obj_paths, i)));
+    //
+    // *** SECTION HEADER ***
+    //
 
-    link_objs_detail(objs, header_offset);
+    *shoff = shstrtab_offset + emitted_size();
+    *shnum = nsections + ndebugs + 4;
 
-    ExeImage *exe = (ExeImage *)safe_malloc(sizeof(ExeImage));
-    exe->objs = objs;
-    exe->vaddr_offset = vaddr_offset;
-    exe->header_size = header_size;
-    return exe;
+    // NULL
+    emit_exe_section_header(0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    // the sections of the R+W segment are at data_file_offset in the file.
+    for (int i = 0; i < nsections; i++) {
+        OutputSection *sec = (OutputSection *)vector_get(exe->sections, i);
+        int file_offset = sec->offset;
+        if (segment_rank(sec->flags, sec->type) != 0)
+            file_offset += exe->data_file_offset - exe->data_offset;
+        emit_exe_section_header(
+            (int)vector_get(name_offsets, i), sec->type,
+            sec->flags & (SHF_WRITE | SHF_ALLOC | SHF_EXECINSTR),
+            EXE_VADDR + sec->offset, file_offset, sec->size, 0, 0, 16, 0);
+    }
+
+    // the debug sections directly follow the R+W segment in the file.
+    for (int i = 0; i < ndebugs; i++) {
+        OutputSection *sec =
+            (OutputSection *)vector_get(exe->debug_sections, i);
+        emit_exe_section_header(
+            (int)vector_get(name_offsets, nsections + i), SHT_PROGBITS, 0, 0,
+            exe->data_file_offset + exe->data_filesz + sec->offset, sec->size,
+            0, 0, 1, 0);
+    }
+
+    // .symtab, whose sh_info is the index of the first global symbol.
+    emit_exe_section_header(symtab_name, 0x02, 0, 0, offset,
+                            24 * syms->nsyms, nsections + ndebugs + 2,
+                            syms->nlocals, 8, 0x18);
+    // .strtab
+    emit_exe_section_header(symtab_name + 8, 0x03, 0, 0, strtab_offset,
+                            syms->strtab_size, 0, 0, 1, 0);
+    // .shstrtab
+    emit_exe_section_header(symtab_name + 16, 0x03, 0, 0, shstrtab_offset,
+                            shstrtab_size, 0, 0, 1, 0);
+
+    return dumped;
+}
+
+// where .symtab is in the file of the executable. The debug sections, the
+// symbols and the section headers follow the R+W segment.
+int exe_symtab_offset(ExeImage *exe)
+{
+    return roundup(exe->data_file_offset + exe->data_filesz + exe->debug_size,
+                   8);
 }
 
 void dump_exe_image(ExeImage *exeimg, FILE *fh)
 {
+    int debug_offset = exeimg->data_file_offset + exeimg->data_filesz;
+    int symtab_offset = exe_symtab_offset(exeimg);
+    OutputSymbols *syms = collect_output_symbols(exeimg);
+    int shoff = 0, shnum = 0;
+    Vector *table =
+        emit_section_table(exeimg, syms, symtab_offset, &shoff, &shnum);
+
     Vector *dumped = new_vector();
     set_buffer_to_emit(dumped);
 
@@ -202,8 +1804,6 @@ void dump_exe_image(ExeImage *exeimg, FILE *fh)
     // *** ELF HEADER ***
     //
 
-    int header_offset = 0;
-
     // ELF magic number
     emit_dword(0x7f, 0x45, 0x4c, 0x46);
     // 64bit
@@ -229,7 +1829,7 @@ void dump_exe_image(ExeImage *exeimg, FILE *fh)
     // addr of program header table
     emit_qword(0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
     // addr of section header table
-    emit_qword(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+    emit_qword_int(shoff, 0);
 
     // flag
     emit_dword(0x00, 0x00, 0x00, 0x00);
@@ -240,78 +1840,721 @@ void dump_exe_image(ExeImage *exeimg, FILE *fh)
     // size of program header table entry
     emit_word(0x38, 0x00);
     // number of entries in program header table
-    emit_word(0x01, 0x00);
+    emit_word(0x02, 0x00);
 
     // size of section header table entry
-    emit_word(0x00, 0x00);
+    emit_word(0x40, 0x00);
     // number of entries in section header table
-    emit_word(0x00, 0x00);
+    emit_word_int(shnum);
     // index of section header entry containing section names
-    emit_word(0x00, 0x00);
-
-    int header_size = emitted_size() - header_offset;
+    emit_word_int(shnum - 1);
 
     //
     // *** PROGRAM HEADER ***
     //
 
-    // PT_LOAD
-    emit_dword_int(1);
-    // PF_X | PF_W | PF_R
-    emit_dword_int(1 | 2 | 4);
-    // offset
-    emit_qword_int(0, 0);
-    // virtual address in memory
-    emit_qword_int(exeimg->vaddr_offset, 0);
-    // reserved (phisical address in memory ?)
-    emit_qword_int(exeimg->vaddr_offset, 0);
-    // size of segment in file (placeholder)
-    int filesz_addr = emitted_size();
-    emit_qword_int(0, 0);
-    // size of segment in memory (placeholder)
-    int memsz_addr = emitted_size();
-    emit_qword_int(0, 0);
-    // alignment
-    emit_qword_int(0x1000, 0);
-
-    // padding
-    for (int i = emitted_size(); i < exeimg->header_size; i++) emit_byte(0);
+    // PF_X | PF_R
+    emit_load_segment(1 | 4, 0, EXE_VADDR, exeimg->text_size,
+                      exeimg->text_size);
+    // PF_W | PF_R
+    emit_load_segment(2 | 4, exeimg->data_file_offset,
+                      EXE_VADDR + exeimg->data_offset, exeimg->data_filesz,
+                      exeimg->data_memsz);
     assert(emitted_size() == exeimg->header_size);
 
-    //
-    // *** BODY ***
-    //
-
-    int body_offset = emitted_size();
-
-    for (int i = 0; i < vector_size(exeimg->objs); i++) {
-        ObjectData *obj = (ObjectData *)vector_get(exeimg->objs, i);
-        for (int j = 0; j < obj->data_size; j++) emit_byte(obj->data[j]);
-        for (int j = 0; j < obj->entire_size - obj->data_size; j++)
-            emit_byte(0);
-    }
-
     // rewrite placeholders
-    int ep_offset = search_symbol(exeimg->objs, "_start",
-                                  exeimg->vaddr_offset + exeimg->header_size);
+    int ep_offset = search_symbol(exeimg->symbols, "_start", EXE_VADDR);
     reemit_byte(ep_addr + 0, (ep_offset >> 0) & 0xff);
     reemit_byte(ep_addr + 1, (ep_offset >> 8) & 0xff);
     reemit_byte(ep_addr + 2, (ep_offset >> 16) & 0xff);
     reemit_byte(ep_addr + 3, (ep_offset >> 24) & 0xff);
 
-    int filesize = emitted_size();
-    reemit_byte(filesz_addr + 0, (filesize >> 0) & 0xff);
-    reemit_byte(filesz_addr + 1, (filesize >> 8) & 0xff);
-    reemit_byte(filesz_addr + 2, (filesize >> 16) & 0xff);
-    reemit_byte(filesz_addr + 3, (filesize >> 24) & 0xff);
-    reemit_byte(memsz_addr + 0, (filesize >> 0) & 0xff);
-    reemit_byte(memsz_addr + 1, (filesize >> 8) & 0xff);
-    reemit_byte(memsz_addr + 2, (filesize >> 16) & 0xff);
-    reemit_byte(memsz_addr + 3, (filesize >> 24) & 0xff);
-
-    // write dumped to file
+    // the headers are put in the space for them at the start of the image.
     for (int i = 0; i < vector_size(dumped); i++)
-        write_byte(fh, (int)vector_get(dumped, i));
+        exeimg->image[i] = (int)vector_get(dumped, i);
+
+    // the R+W segment follows the R+X one, which is padded to its offset.
+    fwrite(exeimg->image, 1, exeimg->text_size, fh);
+    char padding[16];
+    memset(padding, 0, 16);
+    fwrite(padding, 1, exeimg->data_file_offset - exeimg->text_size, fh);
+    fwrite(exeimg->image + exeimg->data_offset, 1, exeimg->data_filesz, fh);
+    fwrite(exeimg->debug_image, 1, exeimg->debug_size, fh);
+
+    fwrite(padding, 1, symtab_offset - (debug_offset + exeimg->debug_size),
+           fh);
+    fwrite(syms->symtab, 24, syms->nsyms, fh);
+    fwrite(syms->strtab, 1, syms->strtab_size, fh);
+    char *bytes = safe_malloc(vector_size(table));
+    for (int i = 0; i < vector_size(table); i++)
+        bytes[i] = (int)vector_get(table, i);
+    fwrite(bytes, 1, vector_size(table), fh);
+}
+
+// What the state of --incremental keeps of an object, so that the object can
+// be patched into the executable without reading the others.
+typedef struct {
+    int input;  // the index of the input file which it is from
+    // the offset in the image, the reserved size and the index in the output
+    // sections of each loaded section, in the order of them in the object.
+    int nslots, *slots;
+    // where its local and global symbols are in .symtab of the executable,
+    // and the hash of their names.
+    int first_local, nlocals, first_global, nglobals, symbols_hash;
+    // the index of the global symbol, the offset in the image, the type and
+    // the addend of each relocation against a global symbol.
+    int nsites, *sites;
+} ObjectState;
+
+// The state of --incremental, which is saved in <output>.ldstate after
+// linking. exe has the layout of the executable but no objects.
+typedef struct {
+    ExeImage *exe;
+    int nsyms;  // of .symtab of the executable
+    // the size and the mtime (2 dwords) of the executable, which tell that
+    // it isn't rewritten since the state was saved.
+    int *exe_stamp;
+    // the size, the mtime (2 dwords), the hash (2 dwords) and whether it is
+    // an archive of each input file.
+    int ninputs, *inputs;
+    Symbol **globals;  // the global symbols in the order of objects
+    int nglobals, *global_objs;  // and the index in objs of their ones
+    Vector *objs;  // vector<ObjectState *>
+} LinkState;
+
+// whether the executable linked with opts can be patched by --incremental.
+// The sections must not be removed, folded or reordered.
+int is_relinkable(LinkOptions *opts)
+{
+    return !opts->gc_sections && opts->icf == ICF_NONE &&
+           opts->symbol_ordering_file == NULL && !opts->call_graph_order;
+}
+
+// fill stamp with the size and the mtime of the file at path, which tell
+// that it isn't changed without reading it. Return 0 if it doesn't exist.
+int stat_input_file(char *path, int *stamp)
+{
+    char st[144];
+    if ((int)syscall(4, path, st) < 0) return 0;  // __NR_stat
+    stamp[0] = read_dword(st + 48);               // st_size
+    stamp[1] = read_dword(st + 88);               // st_mtim
+    stamp[2] = read_dword(st + 96);
+    return 1;
+}
+
+// hash data into 2 dwords as the cache of the driver does.
+void hash_input_data(int *hash, char *data, int size)
+{
+    hash[0] = -2128831035;  // 2166136261
+    hash[1] = 5381;
+    for (int i = 0; i < size; i++) {
+        int ch = data[i] & 0xff;
+        hash[0] = (hash[0] ^ ch) * 16777619;  // FNV-1a
+        hash[1] = hash[1] * 33 + ch;          // djb2
+    }
+    // keep them as read_dword() reads them from the state.
+    char buf[4];
+    for (int i = 0; i < 2; i++) {
+        write_dword(buf, hash[i]);
+        hash[i] = read_dword(buf);
+    }
+}
+
+// the number of the local or global symbols of obj in the executable.
+int count_output_symbols(ObjectData *obj, int global)
+{
+    int nsyms = 0;
+    for (int j = 1; j < obj->nsymtab; j++) {
+        char *entry = obj->symtab + 24 * j;
+        if (is_output_symbol(obj, entry) &&
+            ((read_byte(entry + 4) & 0x10) != 0) == global)
+            nsyms++;
+    }
+    return nsyms;
+}
+
+// the hash of the names of the symbols of obj in the executable, which tells
+// whether they can be rewritten in place.
+int hash_output_symbol_names(ObjectData *obj)
+{
+    int hash = 5381;
+    for (int j = 1; j < obj->nsymtab; j++) {
+        char *entry = obj->symtab + 24 * j;
+        if (!is_output_symbol(obj, entry)) continue;
+        char *name = obj->strtab + read_dword(entry);
+        for (int i = 0; name[i] != '\0'; i++) hash = hash * 33 + name[i];
+        hash = hash * 33 + (read_byte(entry + 4) & 0x10);
+    }
+    char buf[4];
+    write_dword(buf, hash);
+    return read_dword(buf);
+}
+
+// collect the relocations of obj against global symbols into os. They are
+// applied again when the objects defining the symbols are patched. Return 0
+// if one of the symbols isn't defined.
+int collect_reloc_sites(ExeImage *exe, ObjectData *obj, ObjectState *os)
+{
+    Vector *sites = new_vector();
+    for (int j = 1; j < obj->nshdr; j++) {
+        char *rela_shdr = section_header(obj, j);
+        int target = read_dword(rela_shdr + 44);
+        if (read_dword(rela_shdr + 4) != SHT_RELA ||
+            obj->section_offsets[target] < 0)
+            continue;
+
+        char *rela = obj->data + read_dword(rela_shdr + 24);
+        int nrela = read_dword(rela_shdr + 32) / 24;
+        for (int k = 0; k < nrela; k++) {
+            char *entry = rela + 24 * k;
+            char *symtab_entry = obj->symtab + 24 * read_dword(entry + 12);
+            if (read_word(symtab_entry + 6) != 0 &&
+                !(read_byte(symtab_entry + 4) & 0x10))
+                continue;
+            Symbol *sym = lookup_global_symbol(
+                exe->symbols, obj->strtab + read_dword(symtab_entry));
+            if (sym == NULL) return 0;
+            vector_push_back(sites, (void *)sym->index);
+            int offset = obj->section_offsets[target] + read_dword(entry);
+            vector_push_back(sites, (void *)offset);
+            vector_push_back(sites, (void *)read_dword(entry + 8));
+            vector_push_back(sites, (void *)read_dword(entry + 16));
+        }
+    }
+
+    os->nsites = vector_size(sites) / 4;
+    os->sites = (int *)safe_malloc(sizeof(int) * vector_size(sites));
+    for (int i = 0; i < vector_size(sites); i++)
+        os->sites[i] = (int)vector_get(sites, i);
+    return 1;
+}
+
+// the state of --incremental after linking exe from the files at paths.
+LinkState *new_link_state(ExeImage *exe, Vector *paths)
+{
+    LinkState *state = (LinkState *)safe_malloc(sizeof(LinkState));
+    state->exe = exe;
+    state->ninputs = vector_size(paths);
+    state->inputs = (int *)safe_malloc(sizeof(int) * 6 * state->ninputs);
+    for (int i = 0; i < state->ninputs; i++) {
+        char *path = (char *)vector_get(paths, i);
+        int *input = state->inputs + 6 * i, size = 0;
+        stat_input_file(path, input);
+        char *data = read_binary_file(path, &size);
+        hash_input_data(input + 3, data, size);
+        input[5] = is_archive(data, size);
+    }
+
+    // number the global symbols, which the relocations refer to.
+    int nobjs = vector_size(exe->objs), nsyms = count_symbols(exe->objs);
+    state->globals = (Symbol **)safe_malloc(sizeof(Symbol *) * nsyms);
+    state->global_objs = (int *)safe_malloc(sizeof(int) * nsyms);
+    state->nglobals = 0;
+    int nlocals = 1;
+    for (int i = 0; i < nobjs; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        for (int j = 0; j < obj->nsymtab; j++) {
+            char *entry = obj->symtab + 24 * j;
+            if (read_word(entry + 6) == 0 || !(read_byte(entry + 4) & 0x10))
+                continue;
+            Symbol *sym = lookup_global_symbol(
+                exe->symbols, obj->strtab + read_dword(entry));
+            sym->index = state->nglobals;
+            state->globals[state->nglobals] = sym;
+            state->global_objs[state->nglobals++] = i;
+        }
+        nlocals += count_output_symbols(obj, 0);
+    }
+
+    // the symbols in .symtab of the executable are in the order of
+    // collect_output_symbols().
+    state->objs = new_vector();
+    state->nsyms = nlocals;
+    nlocals = 1;
+    for (int i = 0; i < nobjs; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(exe->objs, i);
+        ObjectState *os = (ObjectState *)safe_malloc(sizeof(ObjectState));
+        os->input = obj->input;
+        os->nslots = 0;
+        os->slots = (int *)safe_malloc(sizeof(int) * 3 * obj->nshdr);
+        for (int j = 1; j < obj->nshdr; j++) {
+            if (obj->section_offsets[j] < 0) continue;
+            int *slot = os->slots + 3 * os->nslots++;
+            slot[0] = obj->section_offsets[j];
+            slot[1] =
+                reserved_section_size(read_dword(section_header(obj, j) + 32));
+            slot[2] = output_section_index(exe, obj, j) - 1;
+        }
+        os->first_local = nlocals;
+        os->nlocals = count_output_symbols(obj, 0);
+        nlocals += os->nlocals;
+        os->first_global = state->nsyms;
+        os->nglobals = count_output_symbols(obj, 1);
+        state->nsyms += os->nglobals;
+        os->symbols_hash = hash_output_symbol_names(obj);
+        collect_reloc_sites(exe, obj, os);
+        vector_push_back(state->objs, os);
+    }
+    return state;
+}
+
+// The bytes of the state file being written.
+typedef struct {
+    char *data;
+    int size, capacity;
+} StateBuffer;
+
+void put_state_bytes(StateBuffer *buf, char *src, int len)
+{
+    if (buf->size + len > buf->capacity) {
+        buf->capacity = max(buf->capacity * 2, buf->size + len);
+        char *data = safe_malloc(buf->capacity);
+        memcpy(data, buf->data, buf->size);
+        buf->data = data;
+    }
+    memcpy(buf->data + buf->size, src, len);
+    buf->size += len;
+}
+
+void put_state_int(StateBuffer *buf, int val)
+{
+    char bytes[4];
+    write_dword(bytes, val);
+    put_state_bytes(buf, bytes, 4);
+}
+
+void put_state_string(StateBuffer *buf, char *str)
+{
+    put_state_int(buf, strlen(str));
+    put_state_bytes(buf, str, strlen(str));
+}
+
+// save state to the state file of the executable at exe_path, which has just
+// been written. If state is NULL, the executable can't be patched.
+void write_link_state(LinkState *state, char *exe_path)
+{
+    StateBuffer *buf = (StateBuffer *)safe_malloc(sizeof(StateBuffer));
+    buf->capacity = 4096;
+    buf->data = safe_malloc(buf->capacity);
+    buf->size = 0;
+    put_state_bytes(buf, "AQLD", 4);
+    put_state_int(buf, state != NULL);
+    if (state != NULL) {
+        ExeImage *exe = state->exe;
+        int stamp[3];
+        if (!stat_input_file(exe_path, stamp))
+            error("can't stat '%s'", exe_path);
+        for (int i = 0; i < 3; i++) put_state_int(buf, stamp[i]);
+        put_state_int(buf, state->nsyms);
+        put_state_int(buf, exe->header_size);
+        put_state_int(buf, exe->text_size);
+        put_state_int(buf, exe->data_offset);
+        put_state_int(buf, exe->data_file_offset);
+        put_state_int(buf, exe->data_filesz);
+        put_state_int(buf, exe->data_memsz);
+
+        put_state_int(buf, state->ninputs);
+        for (int i = 0; i < 6 * state->ninputs; i++)
+            put_state_int(buf, state->inputs[i]);
+
+        put_state_int(buf, vector_size(exe->sections));
+        for (int i = 0; i < vector_size(exe->sections); i++) {
+            OutputSection *sec = (OutputSection *)vector_get(exe->sections, i);
+            put_state_string(buf, sec->name);
+            put_state_int(buf, sec->flags);
+            put_state_int(buf, sec->type);
+            put_state_int(buf, sec->offset);
+            put_state_int(buf, sec->size);
+        }
+
+        put_state_int(buf, state->nglobals);
+        for (int i = 0; i < state->nglobals; i++) {
+            put_state_string(buf, state->globals[i]->name);
+            put_state_int(buf, state->global_objs[i]);
+            put_state_int(buf, global_symbol_offset(state->globals[i]));
+        }
+
+        put_state_int(buf, vector_size(state->objs));
+        for (int i = 0; i < vector_size(state->objs); i++) {
+            ObjectState *os = (ObjectState *)vector_get(state->objs, i);
+            put_state_int(buf, os->input);
+            put_state_int(buf, os->nslots);
+            for (int j = 0; j < 3 * os->nslots; j++)
+                put_state_int(buf, os->slots[j]);
+            put_state_int(buf, os->first_local);
+            put_state_int(buf, os->nlocals);
+            put_state_int(buf, os->first_global);
+            put_state_int(buf, os->nglobals);
+            put_state_int(buf, os->symbols_hash);
+            put_state_int(buf, os->nsites);
+            for (int j = 0; j < 4 * os->nsites; j++)
+                put_state_int(buf, os->sites[j]);
+        }
+    }
+
+    char *path = format("%s.ldstate", exe_path);
+    FILE *fh = fopen(path, "wb");
+    if (fh == NULL) error("can't write '%s'", path);
+    fwrite(buf->data, 1, buf->size, fh);
+    fclose(fh);
+}
+
+// save the state of --incremental after linking exe from the files at
+// obj_paths into exe_path.
+void save_link_state(ExeImage *exe, Vector *obj_paths, LinkOptions *opts,
+                     char *exe_path)
+{
+    // the debug sections are merged from all objects, so they can't be
+    // patched for some of them.
+    if (!is_relinkable(opts) || exe->debug_size > 0)
+        write_link_state(NULL, exe_path);
+    else
+        write_link_state(new_link_state(exe, obj_paths), exe_path);
+}
+
+// remove the state file of the executable at exe_path, which has just been
+// linked without --incremental.
+void remove_link_state(char *exe_path)
+{
+    syscall(87, format("%s.ldstate", exe_path));  // __NR_unlink
+}
+
+int read_state_int(char *data, int *pos)
+{
+    int val = read_dword(data + *pos);
+    *pos += 4;
+    return val;
+}
+
+char *read_state_string(char *data, int *pos)
+{
+    int len = read_state_int(data, pos);
+    char *str = safe_malloc(len + 1);
+    memcpy(str, data + *pos, len);
+    str[len] = '\0';
+    *pos += len;
+    return str;
+}
+
+// read the state of the executable at exe_path, or return NULL if it can't
+// be patched.
+LinkState *load_link_state(char *exe_path)
+{
+    char *path = format("%s.ldstate", exe_path);
+    int stamp[3], size = 0, pos = 4;
+    if (!stat_input_file(path, stamp)) return NULL;
+    char *data = read_binary_file(path, &size);
+    if (size < 8 || memcmp(data, "AQLD", 4) != 0 ||
+        !read_state_int(data, &pos))
+        return NULL;
+
+    LinkState *state = (LinkState *)safe_malloc(sizeof(LinkState));
+    ExeImage *exe = (ExeImage *)safe_malloc(sizeof(ExeImage));
+    memset(exe, 0, sizeof(ExeImage));
+    state->exe = exe;
+    state->exe_stamp = (int *)safe_malloc(sizeof(int) * 3);
+    for (int i = 0; i < 3; i++)
+        state->exe_stamp[i] = read_state_int(data, &pos);
+    state->nsyms = read_state_int(data, &pos);
+    exe->header_size = read_state_int(data, &pos);
+    exe->text_size = read_state_int(data, &pos);
+    exe->data_offset = read_state_int(data, &pos);
+    exe->data_file_offset = read_state_int(data, &pos);
+    exe->data_filesz = read_state_int(data, &pos);
+    exe->data_memsz = read_state_int(data, &pos);
+    exe->nthreads = 1;
+    exe->debug_sections = new_vector();
+
+    state->ninputs = read_state_int(data, &pos);
+    state->inputs = (int *)safe_malloc(sizeof(int) * 6 * state->ninputs);
+    for (int i = 0; i < 6 * state->ninputs; i++)
+        state->inputs[i] = read_state_int(data, &pos);
+
+    exe->sections = new_vector();
+    int nsections = read_state_int(data, &pos);
+    for (int i = 0; i < nsections; i++) {
+        OutputSection *sec =
+            (OutputSection *)safe_malloc(sizeof(OutputSection));
+        sec->name = read_state_string(data, &pos);
+        sec->flags = read_state_int(data, &pos);
+        sec->type = read_state_int(data, &pos);
+        sec->offset = read_state_int(data, &pos);
+        sec->size = read_state_int(data, &pos);
+        vector_push_back(exe->sections, sec);
+    }
+
+    // the global symbols have only their offsets until their objects are
+    // read again.
+    state->nglobals = read_state_int(data, &pos);
+    state->globals = (Symbol **)safe_malloc(sizeof(Symbol *) * state->nglobals);
+    state->global_objs = (int *)safe_malloc(sizeof(int) * state->nglobals);
+    Symbol *syms = (Symbol *)safe_malloc(sizeof(Symbol) * state->nglobals);
+    exe->symbols = new_symbol_table(state->nglobals);
+    for (int i = 0; i < state->nglobals; i++) {
+        Symbol *sym = syms + i;
+        sym->name = read_state_string(data, &pos);
+        sym->hash = hash_symbol_name(sym->name);
+        sym->obj = NULL;
+        sym->entry = NULL;
+        sym->index = i;
+        state->global_objs[i] = read_state_int(data, &pos);
+        sym->offset = read_state_int(data, &pos);
+        state->globals[i] = sym;
+        exe->symbols->slots[find_symbol_slot(exe->symbols, sym->name,
+                                             sym->hash)] = sym;
+    }
+
+    state->objs = new_vector();
+    int nobjs = read_state_int(data, &pos);
+    for (int i = 0; i < nobjs; i++) {
+        ObjectState *os = (ObjectState *)safe_malloc(sizeof(ObjectState));
+        os->input = read_state_int(data, &pos);
+        os->nslots = read_state_int(data, &pos);
+        os->slots = (int *)safe_malloc(sizeof(int) * 3 * os->nslots);
+        for (int j = 0; j < 3 * os->nslots; j++)
+            os->slots[j] = read_state_int(data, &pos);
+        os->first_local = read_state_int(data, &pos);
+        os->nlocals = read_state_int(data, &pos);
+        os->first_global = read_state_int(data, &pos);
+        os->nglobals = read_state_int(data, &pos);
+        os->symbols_hash = read_state_int(data, &pos);
+        os->nsites = read_state_int(data, &pos);
+        os->sites = (int *)safe_malloc(sizeof(int) * 4 * os->nsites);
+        for (int j = 0; j < 4 * os->nsites; j++)
+            os->sites[j] = read_state_int(data, &pos);
+        vector_push_back(state->objs, os);
+    }
+    return state;
+}
+
+// the objects of the input files at paths which have changed since state was
+// saved, or NULL if one of them can't be patched e.g. an archive.
+Vector *read_changed_objects(LinkState *state, Vector *paths)
+{
+    Vector *changed = new_vector();
+    for (int i = 0; i < state->ninputs; i++) {
+        char *path = (char *)vector_get(paths, i);
+        int *input = state->inputs + 6 * i, stamp[3], hash[2], size = 0;
+        if (!stat_input_file(path, stamp)) return NULL;
+        // as make does, a file of the same size and mtime is taken as
+        // unchanged without reading it.
+        if (memcmp(stamp, input, sizeof(int) * 3) == 0) continue;
+        memcpy(input, stamp, sizeof(int) * 3);
+
+        char *data = read_binary_file(path, &size);
+        hash_input_data(hash, data, size);
+        if (hash[0] == input[3] && hash[1] == input[4]) continue;
+        if (input[5] || is_archive(data, size)) return NULL;
+        input[3] = hash[0];
+        input[4] = hash[1];
+
+        ObjectData *obj = new_object_data(data, size);
+        obj->path = path;
+        obj->input = i;
+        vector_push_back(changed, obj);
+    }
+    return changed;
+}
+
+// place obj, the new version of the index-th object of state, in the space
+// of the old one in the executable, and collect its relocation sites. Return
+// 0 if it doesn't fit, or the symbols which it defines or the executable has
+// differ.
+int place_changed_object(LinkState *state, int index, ObjectData *obj)
+{
+    ObjectState *os = (ObjectState *)vector_get(state->objs, index);
+    ExeImage *exe = state->exe;
+    int nslots = 0;
+    obj->section_offsets[0] = -1;
+    for (int j = 1; j < obj->nshdr; j++) {
+        char *entry = section_header(obj, j);
+        int flags = read_dword(entry + 8), type = read_dword(entry + 4);
+        obj->section_offsets[j] = -1;
+        if (is_debug_section(obj, j)) return 0;
+        if (!(flags & SHF_ALLOC)) continue;
+
+        if (nslots == os->nslots) return 0;
+        int *slot = os->slots + 3 * nslots++;
+        OutputSection *sec =
+            (OutputSection *)vector_get(exe->sections, slot[2]);
+        if (strcmp(sec->name, output_section_name(obj, j)) != 0 ||
+            segment_rank(sec->flags, sec->type) != segment_rank(flags, type) ||
+            read_dword(entry + 32) > slot[1] ||
+            slot[0] % max(1, read_dword(entry + 48)) != 0)
+            return 0;
+        obj->section_offsets[j] = slot[0];
+    }
+    if (nslots != os->nslots) return 0;
+
+    // it must define the same global symbols, and the others must define
+    // the ones it refers to.
+    int ndefined = 0;
+    for (int j = 1; j < obj->nsymtab; j++) {
+        char *entry = obj->symtab + 24 * j;
+        if (read_word(entry + 6) == 0 || !(read_byte(entry + 4) & 0x10))
+            continue;
+        Symbol *sym =
+            lookup_global_symbol(exe->symbols, obj->strtab + read_dword(entry));
+        if (sym == NULL || state->global_objs[sym->index] != index) return 0;
+        sym->obj = obj;
+        sym->entry = entry;
+        ndefined++;
+    }
+    for (int i = 0; i < state->nglobals; i++)
+        if (state->global_objs[i] == index) ndefined--;
+    if (ndefined != 0 || !collect_reloc_sites(exe, obj, os)) return 0;
+
+    // its symbols in .symtab of the executable are rewritten but their
+    // names.
+    return count_output_symbols(obj, 0) == os->nlocals &&
+           count_output_symbols(obj, 1) == os->nglobals &&
+           hash_output_symbol_names(obj) == os->symbols_hash;
+}
+
+// write size bytes of data at offset in the file of fd.
+void write_file_range(int fd, char *data, int size, int offset)
+{
+    if ((int)syscall(18, fd, data, size, offset) != size)  // __NR_pwrite64
+        error("can't write the executable");
+}
+
+// write size bytes at offset in the image to the file of the executable.
+void write_image_range(ExeImage *exe, int fd, int offset, int size)
+{
+    int file_offset = offset;
+    if (offset >= exe->data_offset)
+        file_offset += exe->data_file_offset - exe->data_offset;
+    write_file_range(fd, exe->image + offset, size, file_offset);
+}
+
+// rewrite the symbols of obj, which is described by os, in .symtab of the
+// file of fd.
+void patch_output_symbols(ExeImage *exe, int fd, ObjectState *os,
+                          ObjectData *obj)
+{
+    for (int global = 0; global <= 1; global++) {
+        int nsyms = global ? os->nglobals : os->nlocals,
+            offset = exe_symtab_offset(exe) +
+                     24 * (global ? os->first_global : os->first_local);
+        // keep st_name, which is the same, by reading them first.
+        char *symtab = safe_malloc(24 * nsyms);
+        if ((int)syscall(17, fd, symtab, 24 * nsyms, offset) !=
+            24 * nsyms)  // __NR_pread64
+            error("can't read the executable");
+        char *sym = symtab;
+        for (int j = 1; j < obj->nsymtab; j++) {
+            char *entry = obj->symtab + 24 * j;
+            if (!is_output_symbol(obj, entry) ||
+                ((read_byte(entry + 4) & 0x10) != 0) != global)
+                continue;
+            write_output_symbol(exe, sym, obj, entry);
+            sym += 24;
+        }
+        write_file_range(fd, symtab, 24 * nsyms, offset);
+    }
+}
+
+// write the changed objects, which are placed at indices of them in state,
+// into the file of fd of the executable, relocated. The relocations of the
+// others against their symbols are applied again. The other bytes of the
+// file are kept.
+void patch_changed_objects(LinkState *state, Vector *changed, int *indices,
+                           int fd)
+{
+    ExeImage *exe = state->exe;
+    int nchanged = vector_size(changed);
+
+    // the changed bytes are made in the image as in memory, where the
+    // relocations are applied, and then written to the file.
+    exe->image = safe_malloc(exe->data_offset + exe->data_memsz);
+    exe->objs = changed;
+    char *is_changed = safe_malloc(vector_size(state->objs));
+    memset(is_changed, 0, vector_size(state->objs));
+    for (int i = 0; i < nchanged; i++) {
+        ObjectState *os = (ObjectState *)vector_get(state->objs, indices[i]);
+        is_changed[indices[i]] = 1;
+        for (int j = 0; j < os->nslots; j++)
+            memset(exe->image + os->slots[3 * j], 0, os->slots[3 * j + 1]);
+    }
+    copy_sections(exe, 0, nchanged);
+    relocate_objs(exe, 0, nchanged, EXE_VADDR);
+
+    for (int i = 0; i < nchanged; i++) {
+        ObjectState *os = (ObjectState *)vector_get(state->objs, indices[i]);
+        for (int j = 0; j < os->nslots; j++) {
+            int *slot = os->slots + 3 * j;
+            OutputSection *sec =
+                (OutputSection *)vector_get(exe->sections, slot[2]);
+            // .bss has no bytes in the file.
+            if (segment_rank(sec->flags, sec->type) != 2)
+                write_image_range(exe, fd, slot[0], slot[1]);
+        }
+        patch_output_symbols(exe, fd, os,
+                             (ObjectData *)vector_get(changed, i));
+    }
+
+    // only the symbols of the changed objects have their objects.
+    for (int i = 0; i < vector_size(state->objs); i++) {
+        if (is_changed[i]) continue;
+        ObjectState *os = (ObjectState *)vector_get(state->objs, i);
+        for (int j = 0; j < os->nsites; j++) {
+            int *site = os->sites + 4 * j;
+            Symbol *sym = state->globals[site[0]];
+            if (sym->obj == NULL) continue;
+            apply_relocation(exe->image, site[1], site[2],
+                             EXE_VADDR + global_symbol_offset(sym) + site[3],
+                             EXE_VADDR);
+            write_image_range(exe, fd, site[1], site[2] == 1 ? 8 : 4);
+        }
+    }
+
+    // e_entry
+    char entry[8];
+    memset(entry, 0, 8);
+    write_dword(entry, search_symbol(exe->symbols, "_start", EXE_VADDR));
+    write_file_range(fd, entry, 8, 24);
+}
+
+// patch the executable at exe_path, which was linked with --incremental from
+// the files at obj_paths, rewriting only the sections of the changed objects
+// and the relocations pointing into them. Return 0 if it has to be linked
+// from scratch instead, e.g. when a section outgrows the space reserved for
+// it.
+int relink_exe(Vector *obj_paths, LinkOptions *opts, char *exe_path)
+{
+    if (!is_relinkable(opts)) return 0;
+    LinkState *state = load_link_state(exe_path);
+    int stamp[3];
+    if (state == NULL || state->ninputs != vector_size(obj_paths) ||
+        !stat_input_file(exe_path, stamp) || stamp[0] != state->exe_stamp[0] ||
+        stamp[1] != state->exe_stamp[1] || stamp[2] != state->exe_stamp[2])
+        return 0;
+    Vector *changed = read_changed_objects(state, obj_paths);
+    if (changed == NULL) return 0;
+
+    int nchanged = vector_size(changed);
+    int *indices = (int *)safe_malloc(sizeof(int) * (nchanged + 1));
+    for (int i = 0; i < nchanged; i++) {
+        ObjectData *obj = (ObjectData *)vector_get(changed, i);
+        indices[i] = -1;
+        for (int j = 0; j < vector_size(state->objs); j++)
+            if (((ObjectState *)vector_get(state->objs, j))->input ==
+                obj->input)
+                indices[i] = j;
+        if (indices[i] < 0 || !place_changed_object(state, indices[i], obj))
+            return 0;
+    }
+
+    if (nchanged > 0) {
+        int fd = open(exe_path, 2, 0);  // O_RDWR
+        if (fd < 0) error("can't write '%s'", exe_path);
+        patch_changed_objects(state, changed, indices, fd);
+        close(fd);
+    }
+    write_link_state(state, exe_path);
 
-    return;
+    if (opts->print_incremental)
+        printf("incremental: patched %d of %d objects\n", nchanged,
+               vector_size(state->objs));
+    return 1;
 }
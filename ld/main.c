@@ -9,19 +9,60 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    if (argc < 3) goto usage;
-
     Vector *objs = new_vector();
-    for (int i = 1; i < argc - 1; i++) vector_push_back(objs, argv[i]);
+    LinkOptions opts;
+    memset(&opts, 0, sizeof(LinkOptions));
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--gc-sections") == 0)
+            opts.gc_sections = 1;
+        else if (strcmp(argv[i], "--icf=all") == 0)
+            opts.icf = ICF_ALL;
+        else if (strcmp(argv[i], "--icf=safe") == 0)
+            opts.icf = ICF_SAFE;
+        else if (strcmp(argv[i], "--print-icf") == 0)
+            opts.print_icf = 1;
+        else if (memcmp(argv[i], "--symbol-ordering-file=", 23) == 0)
+            opts.symbol_ordering_file = argv[i] + 23;
+        else if (strcmp(argv[i], "--call-graph-order") == 0)
+            opts.call_graph_order = 1;
+        else if (strcmp(argv[i], "--incremental") == 0)
+            opts.incremental = 1;
+        else if (strcmp(argv[i], "--print-incremental") == 0)
+            opts.print_incremental = 1;
+        else if (memcmp(argv[i], "--threads=", 10) == 0) {
+            opts.threads = atoi(argv[i] + 10);
+            if (opts.threads <= 0) goto usage;
+        }
+        else
+            vector_push_back(objs, argv[i]);
+    }
+    if (vector_size(objs) == 0) goto usage;
+
+    // --incremental patches the executable if it can, and otherwise links it
+    // from scratch as usual.
+    char *exe_path = argv[argc - 1];
+    if (opts.incremental) {
+        if (relink_exe(objs, &opts, exe_path)) return 0;
+        if (opts.print_incremental) printf("incremental: full link\n");
+    }
 
-    ExeImage *exe = link_objs(objs);
+    ExeImage *exe = link_objs(objs, &opts);
 
-    FILE *fh = fopen(argv[argc - 1], "wb");
+    FILE *fh = fopen(exe_path, "wb");
     dump_exe_image(exe, fh);
     fclose(fh);
+    // a state of an earlier --incremental would describe another executable.
+    if (opts.incremental)
+        save_link_state(exe, objs, &opts, exe_path);
+    else
+        remove_link_state(exe_path);
 
     return 0;
 
 usage:
-    error("Usage: ld input-obj-file-path... output-exe-file-path");
+    error("Usage: ld [--gc-sections] [--icf=all, --icf=safe] [--print-icf] "
+          "[--threads=N]\n"
+          "          [--symbol-ordering-file=FILE] [--call-graph-order]\n"
+          "          [--incremental] [--print-incremental]\n"
+          "          input-obj-or-archive-path... output-exe-file-path");
 }
@@ -4,7 +4,7 @@ syscall:
 	mov %rsi, %rdi
 	mov %rdx, %rsi
 	mov %rcx, %rdx
-	mov %r8, %rcx
+	mov %r8, %r10
 	mov %r9, %r8
 	mov 8(%rsp), %r9
 	syscall
@@ -16,5 +16,20 @@ _start:
 	lea 8(%rsp), %rsi
 	call main
 	mov %rax, %rdi
+	mov $231, %eax
+	syscall
+
+.global clone_thread
+clone_thread:
+	mov %rdx, %r10
+	mov $56, %eax
+	syscall
+	cmp $0, %rax
+	jne .clone_thread_parent
+	pop %rdi
+	call thread_main
+	mov $0, %rdi
 	mov $60, %eax
 	syscall
+.clone_thread_parent:
+	ret
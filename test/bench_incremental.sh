@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# Measure how long ld takes to link many objects again after one of them is
+# changed. N generated C files (2000 by default) like the ones of bench_ld.sh
+# are linked from scratch, and then with --incremental after each of CHANGES
+# files (1 by default) is changed, which should patch only those objects.
+# Both executables are run to check that they work.
+
+function fail(){
+    echo -ne "\e[1;31m[ERROR]\e[0m "
+    echo "$1"
+    exit 1
+}
+
+N=${1:-2000}
+CHANGES=${2:-1}
+DIR=_bench_incremental
+
+rm -rf $DIR
+mkdir -p $DIR
+
+# gen_$i.c with g_$i initialized to val.
+function generate(){
+    local i=$1 val=$2
+    local next=$(( (i + 1) % N ))
+    {
+        [ $next -eq $i ] || echo "int f_$next(int x);"
+        echo "int g_$i = $val;"
+        echo "int f_$i(int x) { if (x <= 0) return 0;"
+        echo "    return g_$i + f_$next(x - 1); }"
+        echo "int h_$i(int x) { return f_$i(x) + g_$i; }"
+    } > $DIR/gen_$i.c
+}
+
+for ((i = 0; i < N; i++)); do generate $i $i; done
+echo "int f_0(int x); int main() { return f_0($N) & 0xff; }" > $DIR/main.c
+
+ls $DIR/*.c | sed 's/\.c$//' | xargs -P "$(nproc)" -I{} $AQCC_CC -c {}.c {}.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+$AQCC_CC -c stdlib.c $DIR/stdlib.o && $AQCC_AS system.s $DIR/system.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+
+exe=$DIR/bench_exe
+expected=$(( N * (N - 1) / 2 & 0xff ))
+start=$(date +%s%N)
+$AQCC_LD --incremental $DIR/*.o $exe
+[ $? -eq 0 ] || fail "$AQCC_LD --incremental"
+end=$(date +%s%N)
+chmod +x $exe && $exe
+[ $? -eq $expected ] || fail "$exe"
+echo "linked $((N + 3)) objects from scratch in" \
+    "$(( (end - start) / 1000000 )) ms"
+
+# change the value of g_$i, which doesn't change the size of the code, in
+# files spread over the objects.
+for ((k = 0; k < CHANGES; k++)); do
+    i=$(( k * N / CHANGES ))
+    generate $i $(( i + 1 ))
+    $AQCC_CC -c $DIR/gen_$i.c $DIR/gen_$i.o || fail "$AQCC_CC -c"
+done
+start=$(date +%s%N)
+$AQCC_LD --incremental --print-incremental $DIR/*.o $exe |
+    grep -q "patched $CHANGES of"
+[ $? -eq 0 ] || fail "$AQCC_LD --incremental (relink)"
+end=$(date +%s%N)
+$exe
+[ $? -eq $(( (expected + CHANGES) & 0xff )) ] || fail "$exe (relinked)"
+echo "relinked $CHANGES changed objects in" \
+    "$(( (end - start) / 1000000 )) ms"
+rm -rf $DIR
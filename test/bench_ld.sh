@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Measure how long ld takes to link many objects. N generated C files (2000
+# by default) each define a global variable and some functions calling the
+# functions of other files, so ld has many symbols and relocations to resolve.
+# They are linked with each number of threads in THREADS ("1 2 4 8" by
+# default), which should all make the same executable.
+
+function fail(){
+    echo -ne "\e[1;31m[ERROR]\e[0m "
+    echo "$1"
+    exit 1
+}
+
+N=${1:-2000}
+THREADS=${2:-1 2 4 8}
+DIR=_bench_ld
+
+rm -rf $DIR
+mkdir -p $DIR
+
+for ((i = 0; i < N; i++)); do
+    next=$(( (i + 1) % N ))
+    callees=($next)
+    for ((k = 1; k <= 4; k++)); do callees+=($(( (i * 7 + k) % N ))); done
+    {
+        # declare each function once, before its definition if it is in
+        # this file.
+        for j in $(printf "%s\n" $i "${callees[@]}" | sort -un); do
+            echo "int f_$j(int x);"
+        done
+        echo "int g_$i = $i;"
+        echo "int f_$i(int x) { if (x <= 0) return 0; return g_$i + f_$next(x - 1); }"
+        for ((k = 1; k <= 4; k++)); do
+            echo "int h_${i}_$k() { return f_${callees[$k]}(0) + g_$i; }"
+        done
+    } > $DIR/gen_$i.c
+done
+echo "int f_0(int x); int main() { return f_0($N) & 0xff; }" > $DIR/main.c
+
+ls $DIR/*.c | sed 's/\.c$//' | xargs -P "$(nproc)" -I{} $AQCC_CC -c {}.c {}.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+$AQCC_CC -c stdlib.c $DIR/stdlib.o && $AQCC_AS system.s $DIR/system.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+
+first=
+for t in $THREADS; do
+    exe=$DIR/bench_exe_$t
+    start=$(date +%s%N)
+    $AQCC_LD --threads=$t $DIR/*.o $exe
+    [ $? -eq 0 ] || fail "$AQCC_LD --threads=$t"
+    end=$(date +%s%N)
+
+    if [ -z "$first" ]; then
+        first=$exe
+        chmod +x $exe && $exe
+        [ $? -eq $(( N * (N - 1) / 2 & 0xff )) ] || fail "$exe"
+    fi
+    cmp $first $exe || fail "$AQCC_LD --threads=$t (not deterministic)"
+
+    echo "linked $((N + 3)) objects with $t threads in" \
+        "$(( (end - start) / 1000000 )) ms"
+done
+rm -rf $DIR
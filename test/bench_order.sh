@@ -0,0 +1,80 @@
+#!/bin/bash
+
+# Measure how the order of functions in the executable affects its speed. N
+# generated C files (1000 by default) each define a small hot function, which
+# calls the one of the next file, and a cold function of about 4KiB, which is
+# rarely called. In the default order every hot function is on its own page,
+# while --call-graph-order and --symbol-ordering-file put them together, so
+# the hot loop of ITER iterations (20000 by default) touches fewer pages and
+# cache lines. Each executable is run some times and the best time is shown.
+
+function fail(){
+    echo -ne "\e[1;31m[ERROR]\e[0m "
+    echo "$1"
+    exit 1
+}
+
+N=${1:-1000}
+ITER=${2:-20000}
+DIR=_bench_order
+
+rm -rf $DIR
+mkdir -p $DIR
+
+for ((i = 0; i < N; i++)); do
+    next=$(( i + 1 ))
+    {
+        echo "int cold_$i(int x);"
+        if [ $next -lt $N ]; then
+            echo "int hot_$next(int x);"
+            echo "int cold_$next(int x);"
+            echo "int hot_$i(int x) { return hot_$next(x) + 1; }"
+        else
+            echo "int hot_$i(int x) { return x; }"
+        fi
+        echo "int cold_$i(int x) {"
+        echo "    if (x > 0) return 0;"
+        for ((k = 0; k < 100; k++)); do echo "    x = x * 3 + $k;"; done
+        [ $next -lt $N ] && echo "    x += cold_$next(x);"
+        echo "    return x;"
+        echo "}"
+    } > $DIR/gen_$i.c
+done
+{
+    echo "int hot_0(int x); int cold_0(int x);"
+    echo "int main(int argc) {"
+    echo "    int sum = 0;"
+    echo "    if (argc > 1) sum = cold_0(-1);"
+    echo "    for (int i = 0; i < $ITER; i++) sum += hot_0(i) + hot_0(i + 1);"
+    echo "    return sum & 0xff;"
+    echo "}"
+} > $DIR/main.c
+for ((i = 0; i < N; i++)); do echo "hot_$i"; done > $DIR/order.txt
+
+ls $DIR/*.c | sed 's/\.c$//' |
+    xargs -P "$(nproc)" -I{} $AQCC_CC -ffunction-sections -c {}.c {}.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+$AQCC_CC -c stdlib.c $DIR/stdlib.o && $AQCC_AS system.s $DIR/system.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+
+expected=$(( (ITER * ITER + 2 * ITER * (N - 1)) & 0xff ))
+for opt in "" --call-graph-order --symbol-ordering-file=$DIR/order.txt; do
+    exe=$DIR/bench_exe
+    $AQCC_LD $opt $DIR/*.o $exe
+    [ $? -eq 0 ] || fail "$AQCC_LD $opt"
+    chmod +x $exe
+
+    # take the best of some runs, which are noisy.
+    best=
+    for ((r = 0; r < 5; r++)); do
+        start=$(date +%s%N)
+        $exe
+        [ $? -eq $expected ] || fail "$exe ($opt)"
+        end=$(date +%s%N)
+        time=$(( (end - start) / 1000000 ))
+        [ -z "$best" ] || [ $time -lt $best ] && best=$time
+    done
+
+    echo "ran with ${opt:-the default order} in $best ms"
+done
+rm -rf $DIR
@@ -2092,6 +2092,472 @@ int test350()
     test350allcorrect_va_arg(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7);
 }
 
+static int test351sq(int x) { return x * x; }
+static int test351clamp(int v, int lo, int hi)
+{
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+static int test351inc(int *p)
+{
+    int old = *p;
+    *p = old + 1;
+    return old;
+}
+static int test351sub(int a, int b) { return a - b; }
+static int test351param(int a)
+{
+    a = a * 2;
+    return a + 1;
+}
+static int test351addr(int a)
+{
+    int *p = &a;
+    *p = 10;
+    return a;
+}
+static void test351set(int *p, int v) { *p = v; }
+static char test351char(char c) { return c; }
+static int test351fib(int n)
+{
+    if (n < 2) return n;
+    return test351fib(n - 1) + test351fib(n - 2);
+}
+static int test351nest(int a) { return test351sq(a) + test351sq(a + 1); }
+int test351()
+{
+    int i = 3, a = 0;
+    EXPECT_INT(test351sq(5), 25);
+    EXPECT_INT(test351sq(i) + test351sq(i + 1), 25);
+    EXPECT_INT(test351clamp(-3, 0, 10), 0);
+    EXPECT_INT(test351clamp(30, 0, 10), 10);
+    EXPECT_INT(test351clamp(i, 0, 10), 3);
+    EXPECT_INT(test351inc(&i), 3);
+    EXPECT_INT(i, 4);
+    EXPECT_INT(test351sub(test351inc(&i), test351inc(&i)), 1);
+    EXPECT_INT(i, 6);
+    EXPECT_INT(test351param(4), 9);
+    EXPECT_INT(test351param(i), 13);
+    EXPECT_INT(i, 6);
+    EXPECT_INT(test351addr(4), 10);
+    test351set(&a, 7);
+    EXPECT_INT(a, 7);
+    EXPECT_INT(test351char(300), 44);
+    EXPECT_INT(test351fib(10), 55);
+    EXPECT_INT(test351nest(2), 13);
+    EXPECT_INT(1 + (2 + (3 + (4 + test351nest(test351sq(1))))), 15);
+}
+
+struct test352struct {
+    int n;
+    int ary[10];
+};
+int test352global;
+void test352set_global(int v) { test352global = v; }
+int test352()
+{
+    struct test352struct st, *p = &st;
+    int sum, k = 3, *q = &k;
+
+    for (int i = 0; i < 10; i++) st.ary[i] = i;
+    st.n = 6;
+
+    sum = 0;
+    for (int i = 0; i < p->n - 1; i++) sum += p->ary[i] * (k + 1);
+    EXPECT_INT(sum, 40);
+
+    // stores through pointers and calls
+    sum = 0;
+    for (int i = 0; i < p->n; i++) {
+        sum += k * 2;
+        *q = *q + 1;
+    }
+    EXPECT_INT(sum, 66);
+    EXPECT_INT(k, 9);
+
+    sum = 0;
+    test352global = 1;
+    for (int i = 0; i < 4; i++) {
+        sum += test352global * 10;
+        test352set_global(test352global + 1);
+    }
+    EXPECT_INT(sum, 100);
+
+    sum = 0;
+    for (int i = 0; i < p->n; i++) {
+        p->n = 3;
+        sum++;
+    }
+    EXPECT_INT(sum, 3);
+
+    // nested loops
+    sum = 0;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++) sum += (i + k) * (k - 1) + j;
+    EXPECT_INT(sum, 978);
+
+    // do-while and while
+    int i = 0;
+    sum = 0;
+    do {
+        sum += k << 2;
+        i++;
+    } while (i < 5);
+    EXPECT_INT(sum, 180);
+    while (i < p->n + 7) i++;
+    EXPECT_INT(i, 10);
+
+    // jump into a loop
+    sum = 0;
+    i = 0;
+    goto test352label;
+    while (i < 5) {
+        sum += k + 1;
+    test352label:
+        i++;
+    }
+    EXPECT_INT(sum, 40);
+}
+
+int test353divisor;
+int test353dividends[40];
+void test353error(int x, int d)
+{
+    printf("[ERROR] test353: %d / %d or %d %% %d\n", x, d, x, d);
+}
+#define TEST353_CHECK(d)                                   \
+    do {                                                   \
+        test353divisor = (d);                              \
+        for (int i = 0; i < 40; i++) {                     \
+            int x = test353dividends[i];                   \
+            if (x / (d) != x / test353divisor ||           \
+                x % (d) != x % test353divisor)             \
+                test353error(x, test353divisor);           \
+        }                                                  \
+    } while (0)
+#define TEST353_CHECK_PM(d) \
+    TEST353_CHECK(d);       \
+    TEST353_CHECK(-(d))
+#define TEST353_CHECK8(d)       \
+    TEST353_CHECK_PM(d);        \
+    TEST353_CHECK_PM((d) + 1);  \
+    TEST353_CHECK_PM((d) + 2);  \
+    TEST353_CHECK_PM((d) + 3);  \
+    TEST353_CHECK_PM((d) + 4);  \
+    TEST353_CHECK_PM((d) + 5);  \
+    TEST353_CHECK_PM((d) + 6);  \
+    TEST353_CHECK_PM((d) + 7)
+int test353()
+{
+    int *p = test353dividends;
+    p[0] = 0;
+    p[1] = 1;
+    p[2] = -1;
+    p[3] = 2;
+    p[4] = -2;
+    p[5] = 6;
+    p[6] = -6;
+    p[7] = 7;
+    p[8] = -7;
+    p[9] = 100;
+    p[10] = -100;
+    p[11] = 12345;
+    p[12] = -12345;
+    p[13] = 65535;
+    p[14] = 2147483647;
+    p[15] = -2147483647;
+    int seed = 20181103;
+    for (int i = 16; i < 40; i++) {
+        seed = seed * 1103515245 + 12345;
+        test353dividends[i] = (i & 1) ? (seed | 1) : seed >> ((i & 15) + 1);
+    }
+
+    // all divisors in [-72, 72] except 0
+    TEST353_CHECK8(1);
+    TEST353_CHECK8(9);
+    TEST353_CHECK8(17);
+    TEST353_CHECK8(25);
+    TEST353_CHECK8(33);
+    TEST353_CHECK8(41);
+    TEST353_CHECK8(49);
+    TEST353_CHECK8(57);
+    TEST353_CHECK8(65);
+    TEST353_CHECK_PM(100);
+    TEST353_CHECK_PM(641);
+    TEST353_CHECK_PM(1000);
+    TEST353_CHECK_PM(65536);
+    TEST353_CHECK_PM(1000000007);
+    TEST353_CHECK_PM(1073741824);
+    TEST353_CHECK_PM(2147483647);
+
+    int int_min = -2147483647;
+    int_min--;
+    EXPECT_INT(int_min / 7, -306783378);
+    EXPECT_INT(int_min % 7, -2);
+    EXPECT_INT(int_min / 16, -134217728);
+    EXPECT_INT(int_min % 16, 0);
+    EXPECT_INT(int_min / -3, 715827882);
+    EXPECT_INT(int_min % -3, -2);
+    EXPECT_INT(int_min % 1, 0);
+}
+
+struct test354struct {
+    char c;
+    int ary[40];
+    int *ptr;
+};
+int test354()
+{
+    int ary[50], *p = ary + 10, k = 3;
+    char str[10];
+    char *strs[4];
+    struct test354struct st, *stp = &st;
+
+    for (int i = 0; i < 50; i++) ary[i] = i * 2;
+    for (int i = 0; i < 10; i++) str[i] = 'a' + i;
+    for (int i = 0; i < 40; i++) st.ary[i] = i + 100;
+    strs[0] = "zero";
+    strs[3] = "three";
+
+    EXPECT_INT(ary[k], 6);
+    EXPECT_INT(ary[k * 10 + 1], 62);
+    EXPECT_INT(p[k], 26);
+    EXPECT_INT(p[-k], 14);
+    EXPECT_INT(*(p - k), 14);
+    EXPECT_INT(*(p + 39), 98);
+    EXPECT_INT(str[k], 'd');
+    EXPECT_INT(str[k + 6], 'j');
+    EXPECT_INT(strs[k][1], 'h');
+    EXPECT_INT(stp->ary[k], 103);
+    EXPECT_INT(stp->ary[k + 36], 139);
+    EXPECT_INT(st.ary[39 - k], 136);
+
+    stp->ptr = &stp->ary[k];
+    EXPECT_INT(stp->ptr[1], 104);
+    stp->ptr[2] = 7;
+    EXPECT_INT(st.ary[5], 7);
+
+    p[k] = 77;
+    p[-k] = 33;
+    str[k] = 'X';
+    EXPECT_INT(ary[13], 77);
+    EXPECT_INT(ary[7], 33);
+    EXPECT_INT(str[3], 'X');
+
+    int sum = 0;
+    for (int i = 0; i < 50; i++) sum += ary[i];
+    EXPECT_INT(sum, 2450 + 77 - 26 + 33 - 14);
+    int *q = ary + 49;
+    sum = 0;
+    for (int i = 0; i < 50; i++) sum += *(q - i);
+    EXPECT_INT(sum, 2450 + 77 - 26 + 33 - 14);
+}
+
+int test355dense(int x)
+{
+    switch (x) {
+        case 3:
+            return 30;
+        case 4:
+            return 40;
+        case 5:
+        case 6:
+            return 56;
+        case 8:
+            return 80;
+        case 10:
+            x = 100;
+        case 11:
+            return x + 1;
+        default:
+            return -1;
+    }
+}
+
+int test355sparse(int x)
+{
+    int r = 0;
+    switch (x) {
+        case -2147483647 - 1:
+            r = 1;
+            break;
+        case -1000:
+            r = 2;
+            break;
+        case -7:
+            r = 3;
+            break;
+        case 0:
+            r = 4;
+            break;
+        case 7:
+            r = 5;
+        case 100:
+            r += 6;
+            break;
+        case 5000:
+            r = 7;
+            break;
+        case 123456:
+            r = 8;
+            break;
+        case 2147483647:
+            r = 9;
+            break;
+    }
+    return r;
+}
+
+int test355()
+{
+    int sum = 0;
+    for (int i = -3; i < 15; i++) sum += test355dense(i);
+    EXPECT_INT(sum, 30 + 40 + 56 * 2 + 80 + 101 + 12 - 11);
+    EXPECT_INT(test355dense(7), -1);
+    EXPECT_INT(test355dense(11), 12);
+
+    EXPECT_INT(test355sparse(-2147483647 - 1), 1);
+    EXPECT_INT(test355sparse(-1000), 2);
+    EXPECT_INT(test355sparse(-7), 3);
+    EXPECT_INT(test355sparse(0), 4);
+    EXPECT_INT(test355sparse(7), 11);
+    EXPECT_INT(test355sparse(100), 6);
+    EXPECT_INT(test355sparse(5000), 7);
+    EXPECT_INT(test355sparse(123456), 8);
+    EXPECT_INT(test355sparse(2147483647), 9);
+    EXPECT_INT(test355sparse(1), 0);
+    EXPECT_INT(test355sparse(-8), 0);
+    EXPECT_INT(test355sparse(123457), 0);
+
+    // dense cases around negative values
+    sum = 0;
+    for (int i = -6; i < 2; i++) {
+        switch (i) {
+            case -5:
+                sum += 1;
+                break;
+            case -4:
+                sum += 10;
+                break;
+            case -3:
+                sum += 100;
+                break;
+            case -1:
+                sum += 1000;
+                break;
+            case 0:
+                sum += 10000;
+                break;
+        }
+    }
+    EXPECT_INT(sum, 11111);
+}
+
+int test356count;
+
+int test356inc(int ret)
+{
+    test356count++;
+    return ret;
+}
+
+int test356()
+{
+    int a = 3, b = 5, z = 0, x;
+    int *p = &a, *np = 0;
+
+    x = a && b;
+    EXPECT_INT(x, 1);
+    x = a && z;
+    EXPECT_INT(x, 0);
+    x = z || b;
+    EXPECT_INT(x, 1);
+    x = z || z;
+    EXPECT_INT(x, 0);
+    EXPECT_INT(!a || (a < b && b != 4), 1);
+    EXPECT_INT(a >= b || (a <= 3 && !z), 1);
+
+    x = 0;
+    if (a < b && b > 4 && !(a == b)) x += 1;
+    if (a > b || 7 < a || 3 <= a) x += 10;
+    if (p && !np && *p == 3) x += 100;
+    if (5 == b && 6 != b && 4 < b && 5 >= b) x += 1000;
+    if (1 && 0) x += 10000;
+    EXPECT_INT(x, 1111);
+
+    // short-circuit evaluation
+    test356count = 0;
+    if (test356inc(0) && test356inc(1)) x = 0;
+    if (test356inc(1) || test356inc(1)) x = 1;
+    if (!(test356inc(0) || test356inc(0))) x = 2;
+    EXPECT_INT(test356count, 4);
+    EXPECT_INT(x, 2);
+
+    int i = 0, j = 0;
+    while (i < 10 && j != 5) {
+        i++;
+        j++;
+    }
+    EXPECT_INT(i, 5);
+    for (i = 0; !(i >= 10 || i == 7); i++)
+        ;
+    EXPECT_INT(i, 7);
+    do {
+        i--;
+    } while (i > 2 && i != 4);
+    EXPECT_INT(i, 4);
+    EXPECT_INT(a < b ? a : b, 3);
+    EXPECT_INT(a > b || !b ? a : b, 5);
+}
+
+// the bodies are longer than 127 bytes, so the branches over them and back to
+// the top of the loops are relaxed to rel32.
+int test357()
+{
+    int a = 0, b = 1, c = 2, d = 3, i;
+    for (i = 0; i < 10; i++) {
+        if (i == 7) break;
+        a += b * i + c;
+        b = b * 3 + d;
+        c = c ^ a;
+        d = d + (a & 15);
+        a -= c % 7;
+        b = b % 1000 + i;
+        c = c * 5 + b;
+        d = d - (c & 3);
+        a = a + b - c + d;
+        b = b ^ (a >> 2);
+        c = c % 911 + 2;
+        d = d * 7 % 101;
+        if (i % 2) continue;
+        a = a % 10007;
+    }
+    EXPECT_INT(i, 7);
+    EXPECT_INT(a + b + c + d, -28537);
+
+    int x = 0;
+    while (x < 100) {
+        if (x % 3 == 0) {
+            a = a * 3 + 1;
+            b = b * 5 + 2;
+            c = c * 7 + 3;
+            d = d * 11 + 4;
+            a = a % 1009 + b % 1013;
+            b = b % 1019 + c % 1021;
+            c = c % 1031 + d % 1033;
+            d = d % 1039 + a % 1049;
+        }
+        else {
+            a += x;
+            b -= x;
+        }
+        x += 1;
+    }
+    EXPECT_INT(x, 100);
+    EXPECT_INT(a + b + c + d, 5421);
+}
+
 int main()
 {
     EXPECT_INT(2, 2);
@@ -2444,6 +2910,13 @@ int main()
     test347();
     test348();
     test350();
+    test351();
+    test352();
+    test353();
+    test354();
+    test355();
+    test356();
+    test357();
 
     static int d = -1;
 }
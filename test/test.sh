@@ -17,6 +17,10 @@ $AQCC_LD test
 
 AQCC=../aqcc
 
+# don't let the objects cached by earlier builds hide a change of the
+# compiler. The test of the cache sets its own directory.
+export AQCC_CACHE_DIR=
+
 $AQCC test_define.c testutil.c stdlib.c system.s -o _test_define_exe.o -v
 [ $? -eq 0 ] || fail "$AQCC"
 ./_test_define_exe.o
@@ -28,7 +32,170 @@ $AQCC _test.c testutil.c stdlib.c system.s -o _test_exe.o -v
 ./_test_exe.o
 [ $? -eq 0 ] || fail "./_test_exe.o"
 
+# the code and the data should be in separate R+X and R+W segments.
+readelf -lW _test_exe.o | grep -q "LOAD .* R E " &&
+    readelf -lW _test_exe.o | grep -q "LOAD .* RW "
+[ $? -eq 0 ] || fail "$AQCC_LD (segments)"
+
+# the executable should have the symbols of the functions with their sizes,
+# e.g. for profilers.
+MAIN_SYMBOL=" [1-9][0-9]* FUNC +GLOBAL +DEFAULT +[0-9]+ main$"
+readelf -sW _test_exe.o | grep -qE "$MAIN_SYMBOL" &&
+    readelf -SW _test_exe.o | grep -q " \.text .* AX "
+[ $? -eq 0 ] || fail "$AQCC_LD (symtab)"
+
+# with -g, addr2line should map the code back to the lines of the source,
+# and cc -c and as should still make the same object.
+$AQCC -g test_run.c stdlib.c system.s -o _test_exe.o &&
+    addr2line -e _test_exe.o $(nm _test_exe.o | grep " main$" | cut -c1-16) |
+    grep -q "test_run.c:5$" &&
+    ./_test_exe.o foo bar
+[ $? -eq 42 ] || fail "$AQCC -g"
+$AQCC_CC -g test_run.c _test.s && $AQCC_AS _test.s _test_as.o &&
+    $AQCC_CC -g -c test_run.c _test_cc.o && cmp _test_as.o _test_cc.o
+[ $? -eq 0 ] || fail "$AQCC_CC -g -c"
+
+# with a section per function and data object, ld should drop the unused
+# ones and the program should still work.
+SECTIONS="-ffunction-sections -fdata-sections"
+$AQCC $SECTIONS --gc-sections _test.c testutil.c stdlib.c system.s \
+    -o _test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC (gc-sections)"
+./_test_gc_exe.o
+[ $? -eq 0 ] || fail "./_test_gc_exe.o"
+$AQCC test_run.c stdlib.c system.s -o _test_exe.o &&
+    $AQCC $SECTIONS --gc-sections test_run.c stdlib.c system.s \
+        -o _test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC (gc-sections)"
+./_test_gc_exe.o foo bar
+[ $? -eq 42 ] || fail "./_test_gc_exe.o (gc-sections)"
+[ $(stat -c %s _test_gc_exe.o) -lt $(stat -c %s _test_exe.o) ] ||
+    fail "$AQCC_LD (gc-sections size)"
+
+# ld should fold the identical functions in test_icf.c, except with
+# --icf=safe, since the address of one of them is taken.
+$AQCC -ffunction-sections --icf=all --print-icf test_icf.c test_icf.s \
+    system.s -o _test_gc_exe.o | grep -q "folded 1 sections" &&
+    ./_test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC_LD (icf)"
+$AQCC -ffunction-sections --icf=safe --print-icf test_icf.c test_icf.s \
+    system.s -o _test_gc_exe.o | grep -q "folded 0 sections" &&
+    ./_test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC_LD (icf=safe)"
+
+# ld should lay out the functions in the order of the symbols in the file,
+# or the one derived from the call graph, instead of the one in the source.
+ORDER="-ffunction-sections test_order.c test_order.s system.s -o _test_gc_exe.o"
+$AQCC $ORDER && ./_test_gc_exe.o
+[ $? -eq 1 ] || fail "./_test_gc_exe.o (order)"
+$AQCC --symbol-ordering-file=test_order.txt $ORDER && ./_test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC_LD --symbol-ordering-file"
+$AQCC --call-graph-order $ORDER && ./_test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC_LD --call-graph-order"
+
+# ld should make the same executable with any number of threads.
+$AQCC _test.c testutil.c stdlib.c system.s -o _test_exe.o &&
+    $AQCC --threads=4 _test.c testutil.c stdlib.c system.s \
+        -o _test_gc_exe.o &&
+    cmp _test_exe.o _test_gc_exe.o
+[ $? -eq 0 ] || fail "$AQCC_LD --threads=4"
+
+# with --incremental, ld should patch only the changed object into the
+# executable, which then is the same as linked from scratch if the object is
+# changed back, and link from scratch when the object outgrows its space.
+INC="--incremental --print-incremental test_link.c _test_inc.c test_link.s \
+    test_link2.s -o _test_inc_exe.o"
+rm -f _test_inc_exe.o _test_inc_exe.o.ldstate &&
+    cp test_link2.c _test_inc.c &&
+    $AQCC $INC | grep -q "full link" && cp _test_inc_exe.o _test_exe.o
+[ $? -eq 0 ] || fail "$AQCC --incremental"
+sed 's/return test003004var;/int x = 3; return test003004var + x - 3;/' \
+    test_link2.c > _test_inc.c &&
+    $AQCC $INC | grep -q "patched 1 of 4 objects" && ./_test_inc_exe.o
+[ $? -eq 1 ] || fail "./_test_inc_exe.o (incremental)"
+cp test_link2.c _test_inc.c &&
+    $AQCC $INC | grep -q "patched 1 of 4 objects" &&
+    cmp _test_inc_exe.o _test_exe.o
+[ $? -eq 0 ] || fail "$AQCC --incremental (changed back)"
+for i in $(seq 100); do echo "int pad$i() { return $i; }"; done \
+    >> _test_inc.c && $AQCC $INC | grep -q "full link" && ./_test_inc_exe.o
+[ $? -eq 1 ] || fail "./_test_inc_exe.o (incremental, grown)"
+# the executable rewritten by others, even with the same size, or linked
+# without --incremental shouldn't be patched.
+cp test_link2.c _test_inc.c && $AQCC $INC > /dev/null &&
+    cp _test_exe.o _test_inc_exe.o && touch -d "1 hour ago" _test_inc_exe.o &&
+    $AQCC $INC | grep -q "full link"
+[ $? -eq 0 ] || fail "$AQCC --incremental (rewritten)"
+$AQCC ${INC#--incremental} > /dev/null && [ ! -e _test_inc_exe.o.ldstate ]
+[ $? -eq 0 ] || fail "$AQCC (ldstate removed)"
+
+# the driver should make the same executable with any number of jobs, and
+# fail without an executable if a compile fails while others are running.
+$AQCC -j4 _test.c testutil.c stdlib.c system.s -o _test_j4_exe.o &&
+    $AQCC -j1 _test.c testutil.c stdlib.c system.s -o _test_exe.o &&
+    cmp _test_exe.o _test_j4_exe.o
+[ $? -eq 0 ] || fail "$AQCC -j4"
+echo "int f() { return undefined_var; }" > _test_error.c &&
+    rm -f _test_j4_exe.o &&
+    ! $AQCC -j4 _test_error.c _test.c testutil.c stdlib.c system.s \
+        -o _test_j4_exe.o > /dev/null 2>&1 &&
+    [ ! -e _test_j4_exe.o ]
+[ $? -eq 0 ] || fail "$AQCC -j4 (compile error)"
+
+$AQCC -run _test.c testutil.c stdlib.c system.s
+[ $? -eq 0 ] || fail "$AQCC -run"
+
+$AQCC -run test_run.c stdlib.c system.s -- foo bar
+[ $? -eq 42 ] || fail "$AQCC -run (args)"
+
+# cc should zero registers with xor, both the ones without REX and r8-r15.
+$AQCC_CC _test.c _test.s &&
+    grep -q "^xor %eax, %eax$" _test.s &&
+    grep -qE "^xor (%r(8|9|1[0-5])d), \1$" _test.s
+[ $? -eq 0 ] || fail "$AQCC_CC (xor zeroing)"
+
+# cc -c should make the same object as cc and as do.
+$AQCC_CC _test.c _test.s && $AQCC_AS _test.s _test_as.o &&
+    $AQCC_CC -c _test.c _test_cc.o && cmp _test_as.o _test_cc.o
+[ $? -eq 0 ] || fail "$AQCC_CC -c"
+
 $AQCC test_link.c test_link2.c test_link.s test_link2.s -o _test_exe.o -v
 [ $? -eq 0 ] || fail "$AQCC"
 ./_test_exe.o
 [ $? -eq 1 ] || fail "./_test_exe.o (link)"
+
+# the second compile should copy the object from the cache.
+CACHE_ENV="AQCC_CACHE_DIR=$PWD/_cache"
+rm -rf _cache
+env $CACHE_ENV $AQCC -c testutil.c -o _test_miss.o &&
+    env $CACHE_ENV $AQCC -c testutil.c -o _test_hit.o &&
+    cmp _test_miss.o _test_hit.o &&
+    env $CACHE_ENV $AQCC --cache-stats | grep -q "^hits: 1$"
+[ $? -eq 0 ] || fail "$AQCC (cache)"
+
+# an entry of other sources under the name of the key, as a collision of the
+# hash would make, should be a miss.
+entry=$(ls _cache/*.o) &&
+    env $CACHE_ENV $AQCC -c test_link.c -o _test_cc.o &&
+    cp $(ls _cache/*.o | grep -v $entry) $entry &&
+    env $CACHE_ENV $AQCC -c testutil.c -o _test_hit.o &&
+    cmp _test_miss.o _test_hit.o &&
+    env $CACHE_ENV $AQCC --cache-stats | grep -q "^misses: 3$"
+[ $? -eq 0 ] || fail "$AQCC (cache collision)"
+
+# ld should reject a symbol defined in two objects.
+$AQCC_LD _test_miss.o _test_hit.o _test_exe.o | grep -q "duplicate symbol"
+[ $? -eq 0 ] || fail "$AQCC_LD (duplicate symbol)"
+
+# ld should take only the needed members from an archive. The member of
+# test_archive.c refers to an undefined symbol, so it must be left out.
+$AQCC -c stdlib.c -o _test_stdlib.o &&
+    $AQCC -c test_archive.c -o _test_archive_member.o &&
+    rm -f _test_lib.a &&
+    ar rc _test_lib.a _test_archive_member.o _test_stdlib.o &&
+    $AQCC test_run.c system.s _test_lib.a -o _test_exe.o
+[ $? -eq 0 ] || fail "$AQCC (archive)"
+./_test_exe.o foo bar
+[ $? -eq 42 ] || fail "./_test_exe.o (archive)"
+$AQCC -run test_run.c system.s _test_lib.a -- foo bar
+[ $? -eq 42 ] || fail "$AQCC -run (archive)"
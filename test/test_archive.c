@@ -0,0 +1,4 @@
+int undefined_in_archive();
+
+// This is archived but never linked, since nothing uses unused_in_archive.
+int unused_in_archive() { return undefined_in_archive(); }
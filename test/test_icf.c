@@ -0,0 +1,6 @@
+int twice_a(int x) { return x * 2; }
+
+// the address of twice_b is taken in test_icf.s.
+int twice_b(int x) { return x * 2; }
+
+int main() { return twice_a(3) + twice_b(4) - 14; }
@@ -0,0 +1,4 @@
+.data
+.global icf_table
+icf_table:
+.quad twice_b
@@ -0,0 +1,18 @@
+// order_table in test_order.s has the addresses of the functions.
+extern char *order_table[3];
+
+int hot_b(int x) { return x + 1; }
+
+int cold(int x) { return x * 2; }
+
+// hot_a calls hot_b three times, the heaviest edge of the call graph, so
+// --call-graph-order should put hot_b right after hot_a.
+int hot_a(int x) { return hot_b(x) + hot_b(x + 1) + hot_b(x + 2); }
+
+// return 0 if hot_a, hot_b and cold are in this order.
+int main()
+{
+    if (hot_a(0) + cold(0) != 6) return 2;
+    return !(order_table[0] < order_table[1] &&
+             order_table[1] < order_table[2]);
+}
@@ -0,0 +1,6 @@
+.data
+.global order_table
+order_table:
+.quad hot_a
+.quad hot_b
+.quad cold
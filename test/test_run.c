@@ -0,0 +1,11 @@
+int strcmp(const char *s1, const char *s2);
+
+int count = 10;
+
+int main(int argc, char **argv)
+{
+    count++;
+    if (argc != 3 || count != 11) return 1;
+    if (strcmp(argv[1], "foo") != 0 || strcmp(argv[2], "bar") != 0) return 2;
+    return 42;
+}